@@ -3,193 +3,1167 @@
 #include <math.h>
 #include <ArduinoJson.h>
 #include <EEPROM.h>
+#include <SD.h>
 #include <cstdarg>
 #include <cstdio>
 #include <cstddef>  // offsetof
+#include <atomic>   // atomic_signal_fence（CAN RX 环形缓冲）、FwLog 槽位领取
+#include "sliding_window_stats.h"
+#include "session_rec_format.h"
 
 // ============================================================================
-// 轻量固件日志（环形缓冲，故障时仅写内存，无格式化输出）
+// 轻量固件事件日志（环形缓冲，仅写内存，无格式化输出；多标签 + µs 时间戳）
 // ============================================================================
+// 追加无锁：槽位由原子 fetch_add 领取（Cortex-M7 上为 LDREX/STREX），ISR 与 loop 可同时追加，
+// 不再关中断。每个槽位先清 seq、写字段、最后写 seq 提交；读取方前后两次比对 seq，
+// 不一致（正在写入或已被覆盖）的条目跳过。
+// 载荷：a(u8) b(u16) v(i32)，含义见各标签注释。热路径只调用 append()，格式化只在 dump 时发生。
 namespace FwLog {
 
-static constexpr size_t kRingCap = 128;
+static constexpr size_t kRingCap = 512;
 
 enum Tag : uint8_t {
-  TAG_CAN_TX_FAIL = 1,
+  TAG_NONE = 0,
+  TAG_CAN_TX_FAIL,      // a=电机 ID（0=广播），b=命令字
+  TAG_PHASE,            // a=新 2 相，b=旧 2 相
+  TAG_PHASE4,           // a=新 4 相，b=旧 4 相
+  TAG_PH4_DEGRADED,     // a=1 进入 / 0 恢复
+  TAG_SAFETY_COMPLIANT, // a=关节（0=踝，1=髋），v=进入时 iq_cmd
+  TAG_SAFETY_COOLDOWN,  // a=关节
+  TAG_ABN,              // a=AbnormalReason（ABN_REV_DIR / ABN_NO_MOVE），v=iq 指令
+  TAG_EEPROM_LOAD,      // a=1 成功 / 0 失败或无有效数据
+  TAG_CMD,              // a=端口（0=USB，1=蓝牙），b=命令长度，v=命令前 4 字节
+  TAG_SLOT_OVERRUN,     // a=循环执行器槽位，b=预算 µs，v=实际 µs
+  TAG_FRAME_SKIP,       // v=本次跳过的帧数
+  TAG_ESTOP,            // a=电机 ID，b=错误码
+  TAG_BB_FREEZE,        // a=黑匣子触发原因
+  TAG_CAN_RX_CFG,       // a=登记电机数，b=RX 应答邮箱上限（超限电机无应答邮箱）
+  TAG_COUNT
+};
+
+static const char *const kTagNames[TAG_COUNT] = {
+    "none", "can_tx_fail", "phase", "phase4", "ph4_degraded", "compliant", "cooldown",
+    "abn", "eeprom", "cmd", "overrun", "skip", "estop", "bb_freeze",
+    "canrx_cfg",
 };
 
 struct Entry {
-  uint32_t ms;
-  Tag tag;
-  uint8_t motor_id;
-  uint8_t cmd;
+  volatile uint32_t seq;  // 提交标记：0=写入中
+  uint32_t us;
+  uint8_t tag;
+  uint8_t a;
+  uint16_t b;
+  int32_t v;
 };
 
 static Entry g_ring[kRingCap];
-static volatile uint32_t g_seq = 0;               // 单调递增，用于槽位 (seq-1)%kRingCap
-static volatile uint32_t g_can_tx_fail_total = 0; // CAN 写队列失败累计次数
+static std::atomic<uint32_t> g_seq(0);               // 单调递增，用于槽位 (seq-1)%kRingCap
+static std::atomic<uint32_t> g_can_tx_fail_total(0); // CAN 写队列失败累计次数
+static uint32_t g_dumpFrom = 0;                      // fwlog clear 之后只导出新条目
+
+void append(Tag tag, uint8_t a = 0, uint16_t b = 0, int32_t v = 0) {
+  const uint32_t s = g_seq.fetch_add(1, std::memory_order_relaxed) + 1;
+  Entry &e = g_ring[(s - 1) % kRingCap];
+  e.seq = 0;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  e.us = micros();
+  e.tag = tag;
+  e.a = a;
+  e.b = b;
+  e.v = v;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  e.seq = s;
+}
 
 void appendCanTxFail(uint8_t motor_id, uint8_t cmd) {
-  uint32_t t = millis();
-  noInterrupts();
-  uint32_t next = g_seq + 1;
-  g_seq = next;
-  g_can_tx_fail_total++;
-  size_t idx = (next - 1) % kRingCap;
-  g_ring[idx].ms = t;
-  g_ring[idx].tag = TAG_CAN_TX_FAIL;
-  g_ring[idx].motor_id = motor_id;
-  g_ring[idx].cmd = cmd;
-  interrupts();
+  g_can_tx_fail_total.fetch_add(1, std::memory_order_relaxed);
+  append(TAG_CAN_TX_FAIL, motor_id, cmd);
 }
 
 uint32_t sequence() {
-  return g_seq;
+  return g_seq.load(std::memory_order_relaxed);
 }
 
 uint32_t canTxFailTotal() {
-  return g_can_tx_fail_total;
+  return g_can_tx_fail_total.load(std::memory_order_relaxed);
 }
 
-void printDump(Print& out) {
-  uint32_t seq_snap;
-  uint32_t fail_total;
-  noInterrupts();
-  seq_snap = g_seq;
-  fail_total = g_can_tx_fail_total;
-  interrupts();
+// 读取序号为 s 的条目；已被覆盖或正在写入返回 false
+bool read(uint32_t s, Entry &out) {
+  const Entry &e = g_ring[(s - 1) % kRingCap];
+  if (e.seq != s) {
+    return false;
+  }
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  out.us = e.us;
+  out.tag = e.tag;
+  out.a = e.a;
+  out.b = e.b;
+  out.v = e.v;
+  std::atomic_signal_fence(std::memory_order_seq_cst);
+  out.seq = s;
+  return e.seq == s;
+}
 
-  out.printf("fwlog ring=%u seq_total=%lu can_tx_fail_total=%lu\n",
-             (unsigned)kRingCap, (unsigned long)seq_snap, (unsigned long)fail_total);
+// 可导出的序号范围 [first, last]（first > last 表示为空）
+void range(uint32_t &first, uint32_t &last) {
+  last = sequence();
+  first = (last > kRingCap) ? last - kRingCap + 1 : 1;
+  if (first <= g_dumpFrom) {
+    first = g_dumpFrom + 1;
+  }
+}
 
-  uint32_t n = seq_snap;
-  if (n == 0) {
-    out.println("(empty)");
-    return;
+void clear() {
+  g_dumpFrom = sequence();
+}
+
+int8_t tagFromName(const char *name) {
+  for (uint8_t t = 1; t < TAG_COUNT; ++t) {
+    if (strcmp(kTagNames[t], name) == 0) {
+      return static_cast<int8_t>(t);
+    }
   }
-  uint32_t count = (n < kRingCap) ? n : kRingCap;
-  uint32_t first_seq = n - count + 1;
-  for (uint32_t s = first_seq; s <= n; ++s) {
-    size_t idx = (s - 1) % kRingCap;
-    const Entry& e = g_ring[idx];
-    if (e.tag == TAG_CAN_TX_FAIL) {
-      out.printf("  #%lu t=%lums CAN_TX_FAIL motor=%u cmd=0x%02X\n",
-                 (unsigned long)s, (unsigned long)e.ms,
-                 (unsigned)e.motor_id, (unsigned)e.cmd);
+  return -1;
+}
+
+static void printEntry(Print &out, const Entry &e) {
+  out.printf("  #%lu t=%lu.%03lums %s", (unsigned long)e.seq, (unsigned long)(e.us / 1000),
+             (unsigned long)(e.us % 1000), e.tag < TAG_COUNT ? kTagNames[e.tag] : "?");
+  switch (e.tag) {
+    case TAG_CAN_TX_FAIL:
+      out.printf(" motor=%u cmd=0x%02X\n", (unsigned)e.a, (unsigned)e.b);
+      break;
+    case TAG_PHASE:
+    case TAG_PHASE4:
+      out.printf(" %u -> %u\n", (unsigned)e.b, (unsigned)e.a);
+      break;
+    case TAG_PH4_DEGRADED:
+      out.printf(" %s\n", e.a ? "enter" : "recover");
+      break;
+    case TAG_SAFETY_COMPLIANT:
+    case TAG_SAFETY_COOLDOWN:
+      out.printf(" joint=%s iq=%ld\n", e.a ? "hip" : "ankle", (long)e.v);
+      break;
+    case TAG_ABN:
+      out.printf(" reason=%u iq=%ld\n", (unsigned)e.a, (long)e.v);
+      break;
+    case TAG_EEPROM_LOAD:
+      out.printf(" %s\n", e.a ? "ok" : "failed");
+      break;
+    case TAG_CMD: {
+      char c[5];
+      memcpy(c, &e.v, 4);
+      c[4] = '\0';
+      for (uint8_t i = 0; i < 4; ++i) {
+        if (c[i] != '\0' && (c[i] < 0x20 || c[i] > 0x7E)) {
+          c[i] = '?';
+        }
+      }
+      out.printf(" port=%s len=%u \"%s\"\n", e.a ? "bt" : "usb", (unsigned)e.b, c);
+      break;
     }
+    case TAG_SLOT_OVERRUN:
+      out.printf(" slot=%u %ldus (budget %uus)\n", (unsigned)e.a, (long)e.v, (unsigned)e.b);
+      break;
+    case TAG_FRAME_SKIP:
+      out.printf(" frames=%ld\n", (long)e.v);
+      break;
+    case TAG_ESTOP:
+      out.printf(" motor=%u err=0x%02X\n", (unsigned)e.a, (unsigned)e.b);
+      break;
+    case TAG_BB_FREEZE:
+      out.printf(" reason=%u\n", (unsigned)e.a);
+      break;
+    case TAG_CAN_RX_CFG:
+      out.printf(" motors=%u exceeds %u reply mailboxes\n", (unsigned)e.a, (unsigned)e.b);
+      break;
+    default:
+      out.printf(" a=%u b=%u v=%ld\n", (unsigned)e.a, (unsigned)e.b, (long)e.v);
+      break;
   }
 }
 
+// 文本导出表头；返回导出范围，条目由调用方分段输出（见 fwlogTextStep）
+void printDumpHeader(Print& out, uint32_t &first, uint32_t &last) {
+  range(first, last);
+  out.printf("fwlog ring=%u seq_total=%lu can_tx_fail_total=%lu\n",
+             (unsigned)kRingCap, (unsigned long)last, (unsigned long)canTxFailTotal());
+}
+
 }  // namespace FwLog
 
+// ============================================================================
+// 热点剖析（Cortex-M7 DWT 周期计数器，作用域计时）
+// ============================================================================
+// 用法：在函数体首行写 PROF_ZONE(ZONE_xxx);，作用域结束时累计调用次数、min/mean/max 周期与粗直方图。
+// 编译时 -D FW_PROFILING=0 可整体去掉：PROF_ZONE 展开为空，prof 命令只提示未编译。
+// 区域计时为包含式（嵌套区域的耗时同时计入外层）。仅在 loop 上下文使用，ISR 中不要放 PROF_ZONE。
+#ifndef FW_PROFILING
+#define FW_PROFILING 1
+#endif
+
+#if FW_PROFILING
+namespace Prof {
+
+enum Zone : uint8_t {
+  ZONE_ESTIMATION = 0,
+  ZONE_CONTROL_ALGO,
+  ZONE_HANDLE_CAN,
+  ZONE_ADAPTIVE_THRESHOLD,
+  ZONE_CAN_TX_SERVICE,
+  ZONE_SEND_GAIT_DATA,
+  ZONE_SEND_PHASE4_RT,
+  ZONE_COUNT
+};
+
+static const char *const kZoneNames[ZONE_COUNT] = {
+    "estimation", "control_algo", "handle_can", "adaptive_thr", "cantx_service", "send_gait", "send_ph4_rt",
+};
+
+// 直方图：桶 i 统计 [2^(i+6), 2^(i+7)) 周期（桶 0 含 <128，末桶含以上全部）；600MHz 下 64 周期≈0.1µs
+static constexpr uint8_t kHistBuckets = 14;
+static constexpr uint8_t kHistMinShift = 7;
+
+struct ZoneStat {
+  uint32_t calls;
+  uint32_t minCyc;
+  uint32_t maxCyc;
+  uint64_t sumCyc;
+  uint32_t hist[kHistBuckets];
+};
+
+static ZoneStat g_zones[ZONE_COUNT];
+
+void reset() {
+  for (uint8_t z = 0; z < ZONE_COUNT; ++z) {
+    g_zones[z] = ZoneStat{};
+    g_zones[z].minCyc = UINT32_MAX;
+  }
+}
+
+// 打开 DWT 周期计数器（Teensy 内核启动时通常已打开，重复设置无副作用）
+void begin() {
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+  reset();
+}
+
+static inline void record(Zone z, uint32_t cyc) {
+  ZoneStat &st = g_zones[z];
+  st.calls++;
+  st.sumCyc += cyc;
+  if (cyc < st.minCyc) {
+    st.minCyc = cyc;
+  }
+  if (cyc > st.maxCyc) {
+    st.maxCyc = cyc;
+  }
+  uint8_t b = 0;
+  uint32_t v = cyc >> kHistMinShift;
+  while (v != 0 && b < kHistBuckets - 1) {
+    v >>= 1;
+    b++;
+  }
+  st.hist[b]++;
+}
+
+struct Scope {
+  Zone zone;
+  uint32_t c0;
+  explicit Scope(Zone z) : zone(z), c0(ARM_DWT_CYCCNT) {}
+  ~Scope() { record(zone, ARM_DWT_CYCCNT - c0); }
+};
+
+void printReport(Print &out) {
+  const float cycPerUs = F_CPU_ACTUAL / 1000000.0f;
+  out.printf("Profile (DWT @ %luMHz, cycles; us in brackets)\n", static_cast<unsigned long>(F_CPU_ACTUAL / 1000000u));
+  for (uint8_t z = 0; z < ZONE_COUNT; ++z) {
+    const ZoneStat &st = g_zones[z];
+    if (st.calls == 0) {
+      out.printf("  %-14s calls=0\n", kZoneNames[z]);
+      continue;
+    }
+    uint32_t mean = static_cast<uint32_t>(st.sumCyc / st.calls);
+    out.printf("  %-14s calls=%lu min=%lu mean=%lu max=%lu [%.2f/%.2f/%.2f]\n", kZoneNames[z],
+               static_cast<unsigned long>(st.calls), static_cast<unsigned long>(st.minCyc),
+               static_cast<unsigned long>(mean), static_cast<unsigned long>(st.maxCyc),
+               st.minCyc / cycPerUs, mean / cycPerUs, st.maxCyc / cycPerUs);
+    out.print("    hist");
+    for (uint8_t b = 0; b < kHistBuckets; ++b) {
+      if (st.hist[b] != 0) {
+        out.printf(" <%lu:%lu", static_cast<unsigned long>(1ul << (b + kHistMinShift)),
+                   static_cast<unsigned long>(st.hist[b]));
+      }
+    }
+    out.println();
+  }
+}
+
+}  // namespace Prof
+
+#define PROF_CONCAT_INNER(a, b) a##b
+#define PROF_CONCAT(a, b) PROF_CONCAT_INNER(a, b)
+#define PROF_ZONE(z) Prof::Scope PROF_CONCAT(prof_scope_, __LINE__)(Prof::z)
+#else
+#define PROF_ZONE(z) \
+  do {               \
+  } while (0)
+#endif  // FW_PROFILING
+
 // ISR 上下文标志：当定时器回调在运行时置位，用于抑制 Serial 输出
 volatile bool inIsrContext = false;
 
 // HC-06 经典蓝牙接 Serial1（TTL 3.3V：TX1/RX1）；无 USB 时可仅靠蓝牙调试
 HardwareSerial& BT_SERIAL = Serial1;
 static constexpr uint32_t BT_HC06_BAUD = 115200;
-bool useBluetoothTelemetry = false;  // false=USB发送完整数据，true=蓝牙发送精简数据
+bool useBluetoothTelemetry = false;  // false=USB，true=蓝牙（开启时默认订阅临床通道集，见 Telem）
+
+// ============================================================================
+// 定点格式化：遥测 JSON / 命令回显的整数与定点小数写出，替代热路径上的 vsnprintf("%.2f")
+// ============================================================================
+// newlib 的浮点 printf 在 Cortex-M 上单行要数百 µs；这里按固定小数位把值放大取整后逐位写出。
+// 舍入为四舍五入（远离零），与 printf 仅在二进制表示恰好落在 .5 边界时可能差 1 个末位；
+// 舍入为零的负数写作 0（printf 为 -0.00）。
+// NaN/Inf 写作 nan/inf（与 printf 一致）；放大后超出 uint64 的极端值回退到 snprintf。
+// 缓冲区不足时截断并置 truncated()，始终以 '\0' 结尾。对比测试：fmtbench 命令。
+namespace Fmt {
+
+static constexpr uint8_t kMaxDecimals = 6;
+
+class Writer {
+ public:
+  Writer(char *buf, size_t cap) : buf_(buf), cap_(cap), len_(0), trunc_(false) {
+    if (cap_ > 0) {
+      buf_[0] = '\0';
+    }
+  }
+
+  Writer &ch(char c) {
+    if (len_ + 1 < cap_) {
+      buf_[len_++] = c;
+      buf_[len_] = '\0';
+    } else {
+      trunc_ = true;
+    }
+    return *this;
+  }
+
+  Writer &str(const char *s) {
+    while (*s) {
+      ch(*s++);
+    }
+    return *this;
+  }
+
+  Writer &u64(uint64_t v) {
+    if (v <= 0xFFFFFFFFull) {
+      return u32(static_cast<uint32_t>(v));
+    }
+    char tmp[20];
+    uint8_t n = 0;
+    do {
+      tmp[n++] = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (n) {
+      ch(tmp[--n]);
+    }
+    return *this;
+  }
+
+  Writer &u32(uint32_t v) {
+    char tmp[10];
+    uint8_t n = 0;
+    do {
+      tmp[n++] = static_cast<char>('0' + v % 10);
+      v /= 10;
+    } while (v);
+    while (n) {
+      ch(tmp[--n]);
+    }
+    return *this;
+  }
+
+  Writer &i32(int32_t v) {
+    if (v < 0) {
+      ch('-');
+      return u32(0u - static_cast<uint32_t>(v));
+    }
+    return u32(static_cast<uint32_t>(v));
+  }
+
+  Writer &i64(int64_t v) {
+    if (v < 0) {
+      ch('-');
+      return u64(0ull - static_cast<uint64_t>(v));
+    }
+    return u64(static_cast<uint64_t>(v));
+  }
+
+  // 两位大写十六进制（对应 %02X）
+  Writer &hex2(uint8_t v) {
+    static const char kHex[] = "0123456789ABCDEF";
+    ch(kHex[v >> 4]);
+    return ch(kHex[v & 0x0F]);
+  }
+
+  // 定点小数（对应 %.<decimals>f）
+  Writer &fixed(float v, uint8_t decimals) {
+    static const uint32_t kPow10[kMaxDecimals + 1] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+    if (isnan(v)) {
+      return str("nan");
+    }
+    if (isinf(v)) {
+      return str(v < 0.0f ? "-inf" : "inf");
+    }
+    if (decimals > kMaxDecimals) {
+      decimals = kMaxDecimals;
+    }
+    const uint32_t p = kPow10[decimals];
+    const double scaled = fabs(static_cast<double>(v)) * p + 0.5;
+    if (scaled >= 1.8e19) {
+      char tmp[48];
+      snprintf(tmp, sizeof(tmp), "%.*f", decimals, static_cast<double>(v));
+      return str(tmp);
+    }
+    const uint64_t q = static_cast<uint64_t>(scaled);
+    if (v < 0.0f && q != 0) {
+      ch('-');
+    }
+    uint32_t frac;
+    if (q <= 0xFFFFFFFFull) {
+      const uint32_t q32 = static_cast<uint32_t>(q);
+      u32(q32 / p);
+      frac = q32 % p;
+    } else {
+      u64(q / p);
+      frac = static_cast<uint32_t>(q % p);
+    }
+    if (decimals > 0) {
+      ch('.');
+      for (uint32_t d = p / 10; d > 0; d /= 10) {
+        ch(static_cast<char>('0' + (frac / d) % 10));
+      }
+    }
+    return *this;
+  }
+
+  // JSON 字段：,"key":<value>（首字段前缀用 str("{\"k\":") 自行写出）
+  Writer &key(const char *k) {
+    ch(',');
+    ch('"');
+    str(k);
+    ch('"');
+    return ch(':');
+  }
+
+  Writer &field(const char *k, int32_t v) { return key(k).i32(v); }
+  Writer &fieldU(const char *k, uint32_t v) { return key(k).u32(v); }
+  Writer &field(const char *k, float v, uint8_t decimals) { return key(k).fixed(v, decimals); }
+
+  const char *c_str() const { return buf_; }
+  size_t length() const { return len_; }
+  bool truncated() const { return trunc_; }
+
+ private:
+  char *buf_;
+  size_t cap_;
+  size_t len_;
+  bool trunc_;
+};
+
+// 实机对比：同一条 12 字段遥测行分别用 snprintf 与 Writer 生成 iters 次，报告平均周期数/µs
+void bench(Print &out, uint32_t iters) {
+  static const char *const kKeys[] = {"h", "hf", "hvf", "s", "a", "ar", "hm", "ank", "v", "hip", "hipv", "st"};
+  static const uint8_t kDec[] = {2, 2, 2, 3, 2, 2, 2, 2, 2, 2, 2, 3};
+  float vals[12];
+  for (uint8_t i = 0; i < 12; ++i) {
+    vals[i] = (i & 1 ? -1.0f : 1.0f) * (12.345f + 7.61f * i);
+  }
+  char a[320];
+  char b[320];
+  volatile size_t sink = 0;
+
+  ARM_DEMCR |= ARM_DEMCR_TRCENA;
+  ARM_DWT_CTRL |= ARM_DWT_CTRL_CYCCNTENA;
+
+  uint32_t c0 = ARM_DWT_CYCCNT;
+  for (uint32_t it = 0; it < iters; ++it) {
+    int n = snprintf(a, sizeof(a), "{\"t\":%lu", static_cast<unsigned long>(it));
+    for (uint8_t i = 0; i < 12; ++i) {
+      n += snprintf(a + n, sizeof(a) - n, ",\"%s\":%.*f", kKeys[i], kDec[i], vals[i]);
+    }
+    sink = sink + n;
+  }
+  const uint32_t cyclesPrintf = ARM_DWT_CYCCNT - c0;
+
+  c0 = ARM_DWT_CYCCNT;
+  for (uint32_t it = 0; it < iters; ++it) {
+    Writer w(b, sizeof(b));
+    w.str("{\"t\":").u32(it);
+    for (uint8_t i = 0; i < 12; ++i) {
+      w.field(kKeys[i], vals[i], kDec[i]);
+    }
+    sink = sink + w.length();
+  }
+  const uint32_t cyclesFmt = ARM_DWT_CYCCNT - c0;
+
+  const float cpuMhz = F_CPU_ACTUAL / 1.0e6f;
+  const float perPrintf = static_cast<float>(cyclesPrintf) / iters;
+  const float perFmt = static_cast<float>(cyclesFmt) / iters;
+  out.printf("=== Fmt bench (%lu lines, 12 float fields) ===\n", static_cast<unsigned long>(iters));
+  out.printf("snprintf : %8.0f cycles/line (%.1f us)\n", perPrintf, perPrintf / cpuMhz);
+  out.printf("Fmt      : %8.0f cycles/line (%.1f us)  speedup x%.1f\n", perFmt, perFmt / cpuMhz,
+             perFmt > 0.0f ? perPrintf / perFmt : 0.0f);
+  out.printf("match=%s\n  printf: %s\n  fmt   : %s\n", strcmp(a, b) == 0 ? "YES" : "NO", a, b);
+}
+
+}  // namespace Fmt
+
+// ============================================================================
+// 异步输出：每个端口（USB / 蓝牙）一对环形缓冲，loop 中按端口可写空间非阻塞排空
+// ============================================================================
+// 调用方（hostPrintf / telemetryPrintf / 命令回显）只把字节放入环形缓冲，不再直接 print：
+// HC-06 的 UART 发送缓冲满时 Serial1.print() 会忙等，慢速或已断开的蓝牙客户端会拖住整个控制循环。
+// service() 每次只写 availableForWrite() 允许的字节数，真正的移位由 UART 发送中断（USB 由 USB 栈）完成。
+// 溢出策略：
+//   - 遥测环：按整条消息存放（2 字节长度前缀），放不下时丢弃最旧的整条消息，计入 telemDroppedBytes/Msgs
+//   - 回显环：控制循环关闭时不丢弃，放不下先阻塞排空本端口已排队内容再直接写出（保持顺序），计入 replyBlockingBytes；
+//     控制循环运行中从不阻塞：放不下的内容丢弃，回显环排空后补一行截断提示，计入 replyDroppedBytes
+//   - 大段导出（fwlog / fwlog bin / bb dump）不一次写入：登记为分段导出任务，service() 在回显环有余量时
+//     每次推进若干条，慢速端口只会让导出变慢，不会拖住控制循环
+// 行完整性：遥测消息整条取出后才切换；回显写到半行时，遥测暂缓 kMidLineHoldUs 等待该行写完。
+static bool hostOutMayBlock();  // 控制循环关闭时才允许阻塞排空（定义在 controlLoop 之后）
+
+namespace HostOut {
+
+enum PortId : uint8_t { PORT_USB = 0, PORT_BT, PORT_COUNT };
+
+static constexpr uint16_t kReplyRingSize = 4096;
+static constexpr uint16_t kTelemRingSize = 4096;
+static constexpr uint16_t kMaxTelemMsg = 704;       // ≥ telemetryPrintf 的 640 字节格式化缓冲
+static constexpr uint32_t kMidLineHoldUs = 20000;   // 回显半行时遥测最多暂缓 20ms
+static constexpr uint16_t kBtUartExtra = 1024;      // 追加给 Serial1 中断发送缓冲的内存
+static constexpr uint16_t kDumpReserve = 256;       // 分段导出单步最大输出（fwlog 一行 / bb 一帧）
+static constexpr uint8_t kDumpStepsPerService = 16;
+
+template <uint16_t N>
+struct ByteRing {
+  uint8_t buf[N];
+  uint16_t head = 0;  // 读位置
+  uint16_t count = 0;
+
+  uint16_t space() const { return N - count; }
+
+  void push(const uint8_t *data, uint16_t len) {
+    uint16_t w = static_cast<uint16_t>((head + count) % N);
+    for (uint16_t i = 0; i < len; ++i) {
+      buf[w] = data[i];
+      w = static_cast<uint16_t>((w + 1) % N);
+    }
+    count = static_cast<uint16_t>(count + len);
+  }
+
+  uint16_t pop(uint8_t *out, uint16_t len) {
+    if (len > count) {
+      len = count;
+    }
+    for (uint16_t i = 0; i < len; ++i) {
+      out[i] = buf[head];
+      head = static_cast<uint16_t>((head + 1) % N);
+    }
+    count = static_cast<uint16_t>(count - len);
+    return len;
+  }
+
+  uint8_t peek(uint16_t off) const { return buf[(head + off) % N]; }
 
-// 处理串口命令时指向发起命令的端口；为 nullptr 时 host* 同时发到 USB 与蓝牙（启动/急停等）
+  void discard(uint16_t len) {
+    if (len > count) {
+      len = count;
+    }
+    head = static_cast<uint16_t>((head + len) % N);
+    count = static_cast<uint16_t>(count - len);
+  }
+};
+
+// 分段导出任务：step 每次输出一条记录，返回 false 表示导出结束；游标含义由生产者决定
+struct DumpJob;
+typedef bool (*DumpStep)(Print &out, DumpJob &job);
+struct DumpJob {
+  DumpStep step;   // nullptr = 空闲
+  uint32_t next;   // 下一条
+  uint32_t last;   // 最后一条（登记时快照）
+  uint32_t arg;    // 生产者参数（如标签掩码、环起点）
+  uint32_t shown;  // 已输出条数
+};
+
+struct Port {
+  Print *dev;
+  DumpJob dump;
+  ByteRing<kReplyRingSize> reply;
+  ByteRing<kTelemRingSize> telem;
+  uint8_t staging[kMaxTelemMsg];  // 正在写出的遥测消息（整条取出，写完前不切换）
+  uint16_t stagingLen;
+  uint16_t stagingPos;
+  bool replyMidLine;
+  uint32_t lastReplyUs;
+  // 统计
+  uint32_t replyBytes;
+  uint32_t replyBlockingBytes;
+  uint32_t replyDroppedBytes;
+  uint32_t replyTruncPending;     // 已丢弃、尚未补截断提示的字节数
+  uint32_t telemBytes;
+  uint32_t telemDroppedBytes;
+  uint32_t telemDroppedMsgs;
+  uint16_t replyHighWater;
+  uint16_t telemHighWater;
+};
+
+static Port g_ports[PORT_COUNT];
+static uint8_t g_btUartExtra[kBtUartExtra];
+
+// 回显入口：cmdReplyPort 指向这里，printStatus 之类的 Print& 输出同样走回显环
+class ReplyWriter : public Print {
+ public:
+  explicit ReplyWriter(PortId id) : id_(id) {}
+  size_t write(uint8_t b) override;
+  size_t write(const uint8_t *data, size_t len) override;
+  using Print::write;
+  PortId id() const { return id_; }
+
+ private:
+  PortId id_;
+};
+
+static ReplyWriter g_replyWriters[PORT_COUNT] = {ReplyWriter(PORT_USB), ReplyWriter(PORT_BT)};
+
+void begin() {
+  g_ports[PORT_USB].dev = &Serial;
+  g_ports[PORT_BT].dev = &BT_SERIAL;
+  BT_SERIAL.addMemoryForWrite(g_btUartExtra, sizeof(g_btUartExtra));
+}
+
+Print &replyWriter(PortId id) {
+  return g_replyWriters[id];
+}
+
+// Stream（命令来源端口）→ 对应的回显入口
+Print *replyWriterFor(const Print *dev) {
+  return (dev == static_cast<const Print *>(&BT_SERIAL)) ? &g_replyWriters[PORT_BT] : &g_replyWriters[PORT_USB];
+}
+
+static void noteReplyBytes(Port &p, const uint8_t *data, size_t len) {
+  if (len > 0) {
+    p.replyMidLine = (data[len - 1] != '\n');
+    p.lastReplyUs = micros();
+  }
+}
+
+// 阻塞写完本端口已排队的全部内容（当前遥测消息余下部分 → 回显环）
+static void drainBlocking(Port &p) {
+  if (p.stagingPos < p.stagingLen) {
+    p.dev->write(p.staging + p.stagingPos, p.stagingLen - p.stagingPos);
+    p.stagingPos = p.stagingLen;
+  }
+  uint8_t chunk[128];
+  while (p.reply.count > 0) {
+    uint16_t n = p.reply.pop(chunk, sizeof(chunk));
+    p.dev->write(chunk, n);
+    noteReplyBytes(p, chunk, n);
+  }
+}
+
+void reply(PortId id, const uint8_t *data, size_t len) {
+  Port &p = g_ports[id];
+  if (!p.dev || len == 0) {
+    return;
+  }
+  p.replyBytes += len;
+  if (p.replyTruncPending > 0) {
+    // 截断中：提示行写出前后续内容一并丢弃，避免半段输出与后文拼接
+    p.replyTruncPending += len;
+    p.replyDroppedBytes += len;
+    return;
+  }
+  if (len <= p.reply.space()) {
+    p.reply.push(data, static_cast<uint16_t>(len));
+    if (p.reply.count > p.replyHighWater) {
+      p.replyHighWater = p.reply.count;
+    }
+    return;
+  }
+  if (!hostOutMayBlock()) {
+    p.replyTruncPending = len;
+    p.replyDroppedBytes += len;
+    return;
+  }
+  // 控制循环关闭：回显不丢，排空后直接写（阻塞），保持输出顺序
+  p.replyBlockingBytes += len;
+  drainBlocking(p);
+  p.dev->write(data, len);
+  noteReplyBytes(p, data, len);
+}
+
+size_t ReplyWriter::write(uint8_t b) {
+  reply(id_, &b, 1);
+  return 1;
+}
+
+size_t ReplyWriter::write(const uint8_t *data, size_t len) {
+  reply(id_, data, len);
+  return len;
+}
+
+void telemetry(PortId id, const uint8_t *data, size_t len) {
+  Port &p = g_ports[id];
+  if (!p.dev || len == 0) {
+    return;
+  }
+  const uint16_t need = static_cast<uint16_t>(len + 2);
+  if (len > kMaxTelemMsg || need > kTelemRingSize) {
+    p.telemDroppedBytes += len;
+    p.telemDroppedMsgs++;
+    return;
+  }
+  // 丢弃最旧的整条消息直到放得下
+  while (p.telem.space() < need && p.telem.count >= 2) {
+    uint16_t oldLen = static_cast<uint16_t>(p.telem.peek(0) | (p.telem.peek(1) << 8));
+    p.telem.discard(static_cast<uint16_t>(oldLen + 2));
+    p.telemDroppedBytes += oldLen;
+    p.telemDroppedMsgs++;
+  }
+  uint8_t hdr[2] = {static_cast<uint8_t>(len & 0xFF), static_cast<uint8_t>(len >> 8)};
+  p.telem.push(hdr, 2);
+  p.telem.push(data, static_cast<uint16_t>(len));
+  p.telemBytes += len;
+  if (p.telem.count > p.telemHighWater) {
+    p.telemHighWater = p.telem.count;
+  }
+}
+
+// 非阻塞排空一个端口：只写 availableForWrite() 允许的字节数
+static void servicePort(Port &p, uint32_t nowUs) {
+  if (!p.dev) {
+    return;
+  }
+  if (p.replyTruncPending > 0 && p.reply.count == 0) {
+    char note[64];
+    int n = snprintf(note, sizeof(note), "\n[output truncated: %lu bytes dropped]\n",
+                     static_cast<unsigned long>(p.replyTruncPending));
+    p.reply.push(reinterpret_cast<const uint8_t *>(note), static_cast<uint16_t>(n));
+    p.replyTruncPending = 0;
+  }
+  int room = p.dev->availableForWrite();
+  uint8_t chunk[128];
+  while (room > 0) {
+    if (p.stagingPos < p.stagingLen) {
+      uint16_t n = static_cast<uint16_t>(constrain(static_cast<int>(p.stagingLen - p.stagingPos), 0, room));
+      p.dev->write(p.staging + p.stagingPos, n);
+      p.stagingPos = static_cast<uint16_t>(p.stagingPos + n);
+      room -= n;
+      continue;
+    }
+    if (p.reply.count > 0) {
+      uint16_t n = p.reply.pop(chunk, static_cast<uint16_t>(constrain(room, 0, static_cast<int>(sizeof(chunk)))));
+      p.dev->write(chunk, n);
+      noteReplyBytes(p, chunk, n);
+      room -= n;
+      continue;
+    }
+    if (p.replyMidLine && (nowUs - p.lastReplyUs) < kMidLineHoldUs) {
+      break;
+    }
+    if (p.telem.count < 2) {
+      break;
+    }
+    uint8_t hdr[2];
+    p.telem.pop(hdr, 2);
+    p.stagingLen = p.telem.pop(p.staging, static_cast<uint16_t>(hdr[0] | (hdr[1] << 8)));
+    p.stagingPos = 0;
+    p.replyMidLine = false;
+  }
+}
+
+// 登记分段导出；该端口已有导出在进行时返回 false
+bool startDump(PortId id, DumpStep step, uint32_t next, uint32_t last, uint32_t arg) {
+  DumpJob &job = g_ports[id].dump;
+  if (job.step != nullptr) {
+    return false;
+  }
+  job.next = next;
+  job.last = last;
+  job.arg = arg;
+  job.shown = 0;
+  job.step = step;
+  return true;
+}
+
+// 回显环余量足够时推进分段导出（每次最多 kDumpStepsPerService 步）
+static void serviceDump(PortId id) {
+  Port &p = g_ports[id];
+  for (uint8_t i = 0; i < kDumpStepsPerService && p.dump.step != nullptr; ++i) {
+    if (p.reply.space() < kDumpReserve || p.replyTruncPending > 0) {
+      return;
+    }
+    if (!p.dump.step(g_replyWriters[id], p.dump)) {
+      p.dump.step = nullptr;
+    }
+  }
+}
+
+void service() {
+  const uint32_t nowUs = micros();
+  for (uint8_t i = 0; i < PORT_COUNT; ++i) {
+    serviceDump(static_cast<PortId>(i));
+    servicePort(g_ports[i], nowUs);
+  }
+}
+
+void resetStats() {
+  for (uint8_t i = 0; i < PORT_COUNT; ++i) {
+    Port &p = g_ports[i];
+    p.replyBytes = p.replyBlockingBytes = p.replyDroppedBytes = p.telemBytes = 0;
+    p.telemDroppedBytes = p.telemDroppedMsgs = 0;
+    p.replyHighWater = p.reply.count;
+    p.telemHighWater = p.telem.count;
+  }
+}
+
+void printStatus(Print &out) {
+  static const char *const kNames[PORT_COUNT] = {"USB", "BT"};
+  out.println("=== Host Output Rings ===");
+  for (uint8_t i = 0; i < PORT_COUNT; ++i) {
+    const Port &p = g_ports[i];
+    out.printf("%-3s reply: %u/%u (hw=%u) bytes=%lu blocking=%lu dropped=%lu dump=%s\n", kNames[i],
+               static_cast<unsigned>(p.reply.count), static_cast<unsigned>(kReplyRingSize),
+               static_cast<unsigned>(p.replyHighWater), static_cast<unsigned long>(p.replyBytes),
+               static_cast<unsigned long>(p.replyBlockingBytes), static_cast<unsigned long>(p.replyDroppedBytes),
+               p.dump.step ? "active" : "idle");
+    out.printf("    telem: %u/%u (hw=%u) bytes=%lu dropped=%lu bytes / %lu msgs\n",
+               static_cast<unsigned>(p.telem.count), static_cast<unsigned>(kTelemRingSize),
+               static_cast<unsigned>(p.telemHighWater), static_cast<unsigned long>(p.telemBytes),
+               static_cast<unsigned long>(p.telemDroppedBytes), static_cast<unsigned long>(p.telemDroppedMsgs));
+  }
+}
+
+}  // namespace HostOut
+
+// 处理串口命令时指向发起命令端口的回显入口（HostOut::ReplyWriter）；为 nullptr 时 host* 发到 USB（启动/急停等）
 Print* cmdReplyPort = nullptr;
 
+static bool replyIsBluetooth() {
+  return cmdReplyPort == &HostOut::replyWriter(HostOut::PORT_BT);
+}
+
+static void hostWrite(const char* s, size_t len) {
+  const uint8_t* p = reinterpret_cast<const uint8_t*>(s);
+  if (cmdReplyPort) {
+    cmdReplyPort->write(p, len);
+    // 蓝牙口发来的命令，额外镜像到 USB，便于本地串口监视器观察
+    if (replyIsBluetooth()) {
+      HostOut::reply(HostOut::PORT_USB, p, len);
+    }
+  } else {
+    HostOut::reply(HostOut::PORT_USB, p, len);
+  }
+}
+
 void hostPrintf(const char* fmt, ...) {
   char buf[512];
   va_list ap;
   va_start(ap, fmt);
-  vsnprintf(buf, sizeof(buf), fmt, ap);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
   va_end(ap);
-  if (cmdReplyPort) {
-    cmdReplyPort->print(buf);
-    // 蓝牙口发来的命令，额外镜像到 USB，便于本地串口监视器观察
-    if (cmdReplyPort == static_cast<Print*>(&BT_SERIAL)) {
-      Serial.print(buf);
-    }
-  } else {
-    Serial.print(buf);
+  if (n > 0) {
+    hostWrite(buf, constrain(static_cast<size_t>(n), static_cast<size_t>(0), sizeof(buf) - 1));
   }
 }
 
 void hostPrintln(const char* s) {
-  if (cmdReplyPort) {
-    cmdReplyPort->println(s);
-    // 蓝牙口发来的命令，额外镜像到 USB，便于本地串口监视器观察
-    if (cmdReplyPort == static_cast<Print*>(&BT_SERIAL)) {
-      Serial.println(s);
-    }
-  } else {
-    Serial.println(s);
-  }
+  hostWrite(s, strlen(s));
+  hostWrite("\r\n", 2);
 }
 
-// 周期性 JSON 遥测：根据开关选择 USB 或蓝牙通道
+// 周期性 JSON 遥测：根据开关选择 USB 或蓝牙通道（整条消息入遥测环，满时丢最旧）
+void telemetryWrite(const uint8_t* data, size_t len);
+
 void telemetryPrintf(const char* fmt, ...) {
   char buf[640];
   va_list ap;
   va_start(ap, fmt);
-  vsnprintf(buf, sizeof(buf), fmt, ap);
+  int n = vsnprintf(buf, sizeof(buf), fmt, ap);
   va_end(ap);
-  if (useBluetoothTelemetry) {
-    BT_SERIAL.print(buf);
-  } else {
-    Serial.print(buf);
+  if (n > 0) {
+    telemetryWrite(reinterpret_cast<const uint8_t*>(buf),
+                   constrain(static_cast<size_t>(n), static_cast<size_t>(0), sizeof(buf) - 1));
   }
 }
 
+// 二进制遥测帧：与 telemetryPrintf 同一通道选择
+void telemetryWrite(const uint8_t* data, size_t len) {
+  HostOut::telemetry(useBluetoothTelemetry ? HostOut::PORT_BT : HostOut::PORT_USB, data, len);
+}
+
+// src 为命令来源端口（Serial / BT_SERIAL），回显经该端口的回显环输出
 struct CmdReplyScope {
   Print* prev;
-  explicit CmdReplyScope(Print* src) : prev(cmdReplyPort) { cmdReplyPort = src; }
+  explicit CmdReplyScope(Print* src) : prev(cmdReplyPort) { cmdReplyPort = HostOut::replyWriterFor(src); }
   ~CmdReplyScope() { cmdReplyPort = prev; }
 };
 
 #include <IntervalTimer.h>
 // 定时器前向声明与变量（方案二：ISR 仅节拍计数，CAN 收/发与控制在 loop 中统一调度）
+struct ControlFrame;
 void runControlLoopOnce();
 void runUnifiedCanCycle100Hz();
-static void runControlAlgorithmOnce();
+static void runEstimationOnce(ControlFrame &frame);
+static void runControlAlgorithmOnce(const ControlFrame &frame);
 static void sensorPollingScheduledTx(uint32_t now);
 void onCanCycleTimerTick();
 IntervalTimer controlTimer;
-// 100Hz 定时器仅累加待处理拍数，由 loop 消费，避免 ISR 与 loop 同时 sendCan
-volatile uint32_t g_canCycleTicksPending = 0;
-
-// ============================================================================
-// 全局安全状态（Global Safety State）
-// ============================================================================
-volatile bool isSystemError = false;     // 系统是否处于严重错误状态
-volatile uint8_t errorMotorId = 0;       // 报错的电机ID
-volatile uint8_t errorCode = 0;          // 错误码
-bool errorPrinted = false;               // 错误信息是否已打印到串口
 
 // ============================================================================
-// 前向声明与结构体移动（解决编译依赖顺序问题）
+// 循环执行器（Cyclic Executive）：控制帧（默认 100Hz，可选至 1kHz）由定时器节拍界定，loop 中按固定槽位执行
 // ============================================================================
+// 帧内槽位（按序）：RX 收包+本帧查询 → EST 估计 → CTRL 控制/转矩入队 → TX 释放待发帧
+// 帧间后台槽位：TELEM 遥测/诊断输出、CMD 串口命令
+// 每个槽位有 µs 预算，超出计入 overrun。落后的帧直接跳过（计入 skipped），
+// 不再像旧实现那样连续补跑积压节拍 —— 补跑会用同一份旧传感器数据连续算出多帧，并把转矩帧挤在一起。
+// ISR 只记录节拍序号和时间戳，不碰 CAN（与原约定一致）。
+namespace CycleExec {
+
+enum Slot : uint8_t { SLOT_RX = 0, SLOT_EST, SLOT_CTRL, SLOT_TX, SLOT_TELEM, SLOT_CMD, SLOT_REC, SLOT_COUNT };
+
+static constexpr uint32_t kDefaultPeriodUs = 10000;  // 100Hz
+static constexpr uint32_t kMinPeriodUs = 1000;       // 1kHz 上限
+static constexpr uint32_t kMaxPeriodUs = 10000;
+// 斜率限幅等“每周期”参数的标定周期：diq_* 均按 10ms 一步给出
+static constexpr uint32_t kSlewRefPeriodUs = 10000;
+
+static uint32_t g_periodUs = kDefaultPeriodUs;
+
+struct SlotStat {
+  const char *name;
+  uint32_t budgetUs;
+  uint32_t lastUs;
+  uint32_t maxUs;
+  uint32_t runs;
+  uint32_t overruns;
+};
 
-// 传感器轮询状态
-struct SensorPollingTimer {
-  bool enabled;              // 是否启用轮询（在ctrlon开启时自动启用）
-  uint32_t lastStatusPollMs; // 上次完成一轮 STATUS 分拍发送的时间
-  uint32_t pollIntervalMs;   // 保留：startSensorPolling/gc 传入，用于 JSON 输出间隔说明
+// 帧内槽位预算按 kDefaultPeriodUs 标定，setPeriodUs() 按周期等比缩放（合计占帧周期 35%）；
+// 帧间后台槽位预算是绝对耗时，不随周期变化
+static constexpr uint32_t kInFrameRefBudgetUs[SLOT_TELEM] = {600, 800, 1500, 600};
+
+static SlotStat g_slots[SLOT_COUNT] = {
+    {"rx", kInFrameRefBudgetUs[SLOT_RX], 0, 0, 0, 0},
+    {"est", kInFrameRefBudgetUs[SLOT_EST], 0, 0, 0, 0},
+    {"ctrl", kInFrameRefBudgetUs[SLOT_CTRL], 0, 0, 0, 0},
+    {"tx", kInFrameRefBudgetUs[SLOT_TX], 0, 0, 0, 0},
+    {"telem", 3000, 0, 0, 0, 0},
+    {"cmd", 5000, 0, 0, 0, 0},
+    {"rec", 1000, 0, 0, 0, 0},
 };
-SensorPollingTimer sensorPolling = {false, 0, 20};
 
-// 角度采集频率验证：在 handleCanMessage 中累加，angleDiagPrintIfDue 以 ≤10Hz 串口打印
-static volatile uint16_t s_angleDiagRxHipCnt;
-static volatile uint16_t s_angleDiagRxAnkCnt;
-static volatile uint16_t s_angleTxFailWindowCnt;
-static volatile uint16_t s_angleTxHipWindowCnt;   // 窗口内 angle 查询 TX 次数（应与 RX 对应）
-static volatile uint16_t s_angleTxAnkWindowCnt;
-static volatile uint32_t s_unifiedExeWindowCnt;  // 诊断窗口内 runUnified 执行次数（期望≈100Hz×窗口）
+static volatile uint32_t g_tickCount = 0;   // ISR 节拍序号（单调递增）
+static volatile uint32_t g_tickUs = 0;      // 最近一次节拍的 micros()
+static uint32_t g_lastFrameTick = 0;        // 已执行帧对应的节拍序号
+static uint32_t g_frames = 0;               // 已执行帧数
+static uint32_t g_skipped = 0;              // 因落后而跳过的帧数
+static uint32_t g_frameOverruns = 0;        // 帧内槽位总耗时超过帧周期
+static uint32_t g_startLatencyMaxUs = 0;    // 节拍到帧开始执行的最大延迟
+static uint32_t g_frameMaxUs = 0;           // 帧内槽位总耗时最大值
+static uint32_t g_telemDeferred = 0;        // 距下一帧时间不足而推迟的遥测次数
+
+// 定时器 ISR 调用
+void onTimerTick() {
+  g_tickUs = micros();
+  g_tickCount++;
+}
 
-// 50Hz/轴：10ms 交替代发踝/髋角度查询（每周期仅 1 帧），避免与转矩/STATUS 同拍挤爆 TX
-static uint32_t s_angleNextHalfPeriodUs = 0;
-static bool s_anglePollAnkleNext = true;
-// STATUS 分拍：0=空闲，1→2→3 连续三拍各发一帧
+// RAII 槽位计时：析构时记录耗时并与预算比较
+struct SlotTimer {
+  Slot slot;
+  uint32_t t0;
+  explicit SlotTimer(Slot s) : slot(s), t0(micros()) {}
+  ~SlotTimer() {
+    SlotStat &st = g_slots[slot];
+    uint32_t dt = micros() - t0;
+    st.lastUs = dt;
+    st.runs++;
+    if (dt > st.maxUs) {
+      st.maxUs = dt;
+    }
+    if (dt > st.budgetUs) {
+      st.overruns++;
+      FwLog::append(FwLog::TAG_SLOT_OVERRUN, slot, static_cast<uint16_t>(st.budgetUs),
+                    static_cast<int32_t>(dt));
+    }
+  }
+};
+
+// 若有新节拍则执行一帧（只执行最新一帧，落后的帧跳过）；返回是否执行
+bool runFrameIfDue() {
+  noInterrupts();
+  uint32_t tick = g_tickCount;
+  uint32_t tickUs = g_tickUs;
+  interrupts();
+  if (tick == g_lastFrameTick) {
+    return false;
+  }
+  uint32_t missed = tick - g_lastFrameTick - 1u;
+  if (g_frames > 0 && missed > 0) {
+    g_skipped += missed;
+    FwLog::append(FwLog::TAG_FRAME_SKIP, 0, 0, static_cast<int32_t>(missed));
+  }
+  g_lastFrameTick = tick;
+
+  uint32_t t0 = micros();
+  uint32_t lateUs = t0 - tickUs;
+  if (lateUs > g_startLatencyMaxUs) {
+    g_startLatencyMaxUs = lateUs;
+  }
+  runUnifiedCanCycle100Hz();
+  uint32_t dt = micros() - t0;
+  if (dt > g_frameMaxUs) {
+    g_frameMaxUs = dt;
+  }
+  if (dt > g_periodUs) {
+    g_frameOverruns++;
+  }
+  g_frames++;
+  return true;
+}
+
+// 距下一节拍的剩余时间（µs）
+uint32_t usUntilNextFrame() {
+  noInterrupts();
+  uint32_t tickUs = g_tickUs;
+  interrupts();
+  uint32_t elapsed = micros() - tickUs;
+  return (elapsed >= g_periodUs) ? 0u : (g_periodUs - elapsed);
+}
+
+// 后台槽位是否可在下一帧前跑完（按预算判断）；推迟不丢数据，下一空闲窗口再跑
+// 高速模式下预算可能大于整个周期：此时只要没有待执行的新节拍就放行（最多挤掉一帧，计入 skipped）
+bool backgroundSlotFits(Slot s) {
+  if (g_slots[s].budgetUs >= g_periodUs) {
+    if (g_tickCount == g_lastFrameTick) {
+      return true;
+    }
+  } else if (usUntilNextFrame() >= g_slots[s].budgetUs) {
+    return true;
+  }
+  if (s == SLOT_TELEM) {
+    g_telemDeferred++;
+  }
+  return false;
+}
+
+uint32_t skippedCount() {
+  return g_skipped;
+}
+
+// 最近节拍序号及其时间（下一帧约在 tickUs + periodUs 开始）
+void tickSnapshot(uint32_t &tick, uint32_t &tickUs) {
+  noInterrupts();
+  tick = g_tickCount;
+  tickUs = g_tickUs;
+  interrupts();
+}
+
+uint32_t periodUs() {
+  return g_periodUs;
+}
+
+// 本周期相对 10ms 标定周期的比例（diq_* 等每步斜率按此缩放）
+float slewScale() {
+  return static_cast<float>(g_periodUs) / static_cast<float>(kSlewRefPeriodUs);
+}
+
+// 切换控制帧周期（1000~10000µs）；定时器在下一节拍生效
+bool setPeriodUs(uint32_t us) {
+  if (us < kMinPeriodUs || us > kMaxPeriodUs) {
+    return false;
+  }
+  g_periodUs = us;
+  for (uint8_t i = 0; i < SLOT_TELEM; ++i) {
+    g_slots[i].budgetUs = kInFrameRefBudgetUs[i] * us / kDefaultPeriodUs;
+  }
+  controlTimer.update(us);
+  return true;
+}
+
+void reset() {
+  for (uint8_t i = 0; i < SLOT_COUNT; ++i) {
+    g_slots[i].lastUs = 0;
+    g_slots[i].maxUs = 0;
+    g_slots[i].runs = 0;
+    g_slots[i].overruns = 0;
+  }
+  g_frames = 0;
+  g_skipped = 0;
+  g_frameOverruns = 0;
+  g_startLatencyMaxUs = 0;
+  g_frameMaxUs = 0;
+  g_telemDeferred = 0;
+}
+
+void printStatus(Print &out) {
+  out.printf("Cycle: period=%luus frames=%lu skipped=%lu frame_overrun=%lu frame_max=%luus start_late_max=%luus telem_deferred=%lu\n",
+             static_cast<unsigned long>(g_periodUs), static_cast<unsigned long>(g_frames),
+             static_cast<unsigned long>(g_skipped), static_cast<unsigned long>(g_frameOverruns),
+             static_cast<unsigned long>(g_frameMaxUs), static_cast<unsigned long>(g_startLatencyMaxUs),
+             static_cast<unsigned long>(g_telemDeferred));
+  for (uint8_t i = 0; i < SLOT_COUNT; ++i) {
+    const SlotStat &st = g_slots[i];
+    out.printf("  %-5s budget=%5luus last=%5luus max=%6luus runs=%lu overrun=%lu\n", st.name,
+               static_cast<unsigned long>(st.budgetUs), static_cast<unsigned long>(st.lastUs),
+               static_cast<unsigned long>(st.maxUs), static_cast<unsigned long>(st.runs),
+               static_cast<unsigned long>(st.overruns));
+  }
+}
+
+}  // namespace CycleExec
+
+// ============================================================================
+// 全局安全状态（Global Safety State）
+// ============================================================================
+volatile bool isSystemError = false;     // 系统是否处于严重错误状态
+volatile uint8_t errorMotorId = 0;       // 报错的电机ID
+volatile uint8_t errorCode = 0;          // 错误码
+bool errorPrinted = false;               // 错误信息是否已打印到串口
+
+// ============================================================================
+// 前向声明与结构体移动（解决编译依赖顺序问题）
+// ============================================================================
+
+// 传感器轮询状态
+struct SensorPollingTimer {
+  bool enabled;              // 是否启用轮询（在ctrlon开启时自动启用）
+  uint32_t lastStatusPollMs; // 上次完成一轮 STATUS 分拍发送的时间
+  uint32_t pollIntervalMs;   // 保留：startSensorPolling/gc 传入，用于 JSON 输出间隔说明
+};
+SensorPollingTimer sensorPolling = {false, 0, 20};
+
+// 角度采集频率验证：在 handleCanMessage 中累加，angleDiagPrintIfDue 以 ≤10Hz 串口打印
+static volatile uint16_t s_angleDiagRxHipCnt;
+static volatile uint16_t s_angleDiagRxAnkCnt;
+static volatile uint16_t s_angleTxFailWindowCnt;
+static volatile uint16_t s_angleTxHipWindowCnt;   // 窗口内 angle 查询 TX 次数（应与 RX 对应）
+static volatile uint16_t s_angleTxAnkWindowCnt;
+static volatile uint32_t s_unifiedExeWindowCnt;  // 诊断窗口内 runUnified 执行次数（期望≈100Hz×窗口）
+
+// STATUS 分拍：0=空闲，1→2→3 连续三拍各发一帧
 static uint8_t s_statusBurstPhase = 0;
 // 最后一次踝角度查询 TX 时间：踝 STATUS 须间隔足够长，否则驱动侧易丢 0x92 应答（表现为 ank_rx < 50Hz）
 static uint32_t s_usLastAnkleAngleQueryTx = 0;
 // ctrlon 时 100Hz×2 A1 + 50Hz 角度查询易撑爆 CAN：转矩改为 50Hz 下发（与计数器同步）
 static uint8_t s_torqueTxDecimatePhase = 0;
+// 广播转矩模式：ctrlon 时髋/踝 iq 打包进一帧 0x280 下发，每周期都发（不降频）；bcast on/off 切换
+static bool s_torqueBroadcastMode = false;
 
 // 步态相位枚举（提前定义，ControlLoop需要）
 enum GaitPhase {
@@ -202,7 +1176,7 @@ float getStancePct(GaitPhase phase, uint32_t nowMs);
 // 控制循环状态结构体
 struct ControlLoop {
   uint32_t lastControlMs;      // 上次控制循环时间（毫秒）
-  uint32_t controlIntervalMs;  // 控制周期（毫秒），100Hz = 10ms
+  uint32_t controlIntervalMs;  // 控制周期（毫秒），100Hz = 10ms；rate 命令切换时同步（1kHz = 1ms）
   bool controlEnabled;         // 是否启用控制循环
   uint32_t controlCount;       // 控制循环计数（用于调试）
   bool ankleTorqueReleased;    // 兼容旧逻辑（保留但不再频繁使用 STOP）
@@ -221,6 +1195,11 @@ ControlLoop controlLoop = {
   5000      // motorSpeed (默认最大速度，协议单位，电机轴速度 dps)
 };
 
+// HostOut：控制循环运行时回显溢出不阻塞（慢速蓝牙客户端不得拖住 CAN 周期）
+static bool hostOutMayBlock() {
+  return !controlLoop.controlEnabled;
+}
+
 
 
 // ============================================================================
@@ -228,7 +1207,8 @@ ControlLoop controlLoop = {
 // ============================================================================
 
 // 使用 Teensy 4.1 的 CAN1 控制器（对应底板 CAN 引脚）
-FlexCAN_T4<CAN1, RX_SIZE_256, TX_SIZE_64> can1;
+// 软件 TX 环只留给板级 ACK 等少量直写帧：电机帧由 CanTx 按优先级排队，只在有空闲硬件邮箱时写出
+FlexCAN_T4<CAN1, RX_SIZE_256, TX_SIZE_8> can1;
 
 // 电机配置结构体
 struct MotorConfig {
@@ -236,6 +1216,7 @@ struct MotorConfig {
   float unitsPerDeg;    // 每 1° 对应的协议单位数
   int8_t dir;          // 方向系数（+1/-1），用于统一处理角度方向
   const char *name;     // 关节名称，便于调试打印
+  uint32_t encoderCounts; // 单圈编码器计数（0x9C/0xA1 应答 encoder 字段的满量程：14bit=16384，16/18bit=65536）
 };
 
 // 协议规定：位置和多圈角度的电机轴单位为 0.01°/LSB，即 1° = 100 单位（与具体电机 ID 无关）
@@ -249,8 +1230,9 @@ struct MotorConfig {
 //   - 用于统一处理角度方向，在"角度↔协议单位"转换的唯一入口统一处理
 //   - 逻辑角 * dir * unitsPerDeg -> 协议单位
 //   - 协议单位 / unitsPerDeg * dir -> 逻辑角
-MotorConfig hipMotor { 1, 3600.0f, +1, "Hip" };
-MotorConfig ankleMotor { 2, 1000.0f, -1, "Ankle" };  // 默认+1，可根据实际电机方向调整
+// encoderCounts：应答帧中单圈编码器的计数范围，用于由编码器展开多圈角（见 EncoderTracker）
+MotorConfig hipMotor { 1, 3600.0f, +1, "Hip", 65536 };
+MotorConfig ankleMotor { 2, 1000.0f, -1, "Ankle", 65536 };  // 默认+1，可根据实际电机方向调整
 
 // ============================================================================
 // 角度接口层：明确区分原始角和逻辑角
@@ -280,6 +1262,8 @@ struct MotorStatus {
   uint8_t errorState;          // 错误状态
   bool enabled;                // 是否使能
   uint32_t lastUpdateMs;       // 最后更新时间
+  uint32_t sampleUs;           // 最近一次角度样本的接收时间（µs，CAN RX ISR 打点；估计器 dt 用）
+  uint32_t speedSampleUs;      // 最近一次 speed 字段更新的接收时间（µs，0x9C/0xA1 应答）
   
   // ========== 兼容性字段（保留，但标记为废弃） ==========
   // 注意：这些字段保留用于向后兼容，但新代码应使用逻辑角接口
@@ -287,8 +1271,85 @@ struct MotorStatus {
   float angleDeg;              // [废弃] 使用 hip_deg 或 ankle_deg 替代
 };
 
-MotorStatus hipStatus = {0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0, false, 0, 0, 0.0f};
-MotorStatus ankleStatus = {0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0, false, 0, 0, 0.0f};
+MotorStatus hipStatus = {0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0, false, 0, 0, 0, 0, 0.0f};
+MotorStatus ankleStatus = {0, 0.0f, 0.0f, 0.0f, 0, 0, 0, 0, 0, false, 0, 0, 0, 0, 0.0f};
+
+// ============================================================================
+// 编码器展开跟踪：由 0xA1/0x9C 应答中的单圈编码器推算多圈角（协议单位 0.01°）
+// ============================================================================
+// raw_units = encUnwrapped * 36000 / encoderCounts + unitsOffset
+// - 每个带 encoder 的应答（转矩 0xA1、状态2 0x9C）都是一个角度样本，ctrlon 时每帧转矩即一次采样；
+// - 0x92 多圈角应答作为锚点：把最近编码器样本按速度外推到 0x92 到达时刻，求 unitsOffset；
+// - 相邻样本的跨圈增量按应答速度取最接近的整圈解；超过 ENC_TRACK_MAX_GAP_US 无样本则失锁，
+//   等下一次 0x92 重新锚定（失锁期间轮询自动恢复全速 0x92）。
+struct EncoderTracker {
+  bool hasSample;              // 展开计数已连续
+  bool anchored;               // 已由 0x92 锚定，可输出多圈角
+  uint16_t lastEnc;            // 上一样本编码器原值
+  int16_t lastSpeedDps;        // 上一样本电机轴速度（dps）
+  uint32_t lastSampleUs;       // 上一样本到达时间（CanRx 时间戳）
+  int64_t encUnwrapped;        // 展开后的编码器累计计数
+  int64_t unitsOffset;         // 多圈角与展开计数的偏移（协议单位）
+  int32_t lastAnchorCorrUnits; // 最近一次锚定相对跟踪值的修正量（诊断：反映漂移/丢圈）
+  uint32_t anchorCount;        // 锚定次数
+  uint32_t lastAnchorTxMs;     // 最近一次发出锚定用 0x92 的时间（轮询降频用）
+};
+
+EncoderTracker hipEncTrack = {};
+EncoderTracker ankleEncTrack = {};
+
+static constexpr uint32_t ENC_TRACK_MAX_GAP_US = 100000;  // 样本间隔上限：超过则认为连续性丢失
+
+static int64_t encoderCountsToUnits(const MotorConfig &m, int64_t counts) {
+  return counts * 36000 / static_cast<int64_t>(m.encoderCounts);
+}
+
+// 编码器样本：更新展开计数；已锚定时输出多圈角（协议单位）并返回 true
+bool encoderTrackerSample(EncoderTracker &t, const MotorConfig &m,
+                          uint16_t enc, int16_t speedDps, uint32_t rxUs, int64_t &unitsOut) {
+  const int32_t counts = static_cast<int32_t>(m.encoderCounts);
+  const int32_t dtUs = static_cast<int32_t>(rxUs - t.lastSampleUs);
+  if (t.hasSample && dtUs >= 0 && static_cast<uint32_t>(dtUs) <= ENC_TRACK_MAX_GAP_US) {
+    int32_t d = static_cast<int32_t>(enc) - static_cast<int32_t>(t.lastEnc);
+    // 按两端平均速度估计期望增量，取与之最接近的整圈解（高速/丢帧时仍能正确跨圈）
+    float expected = 0.5f * (speedDps + t.lastSpeedDps) * (dtUs * 1e-6f) * counts / 360.0f;
+    int32_t turns = static_cast<int32_t>(lroundf((expected - d) / counts));
+    d += turns * counts;
+    t.encUnwrapped += d;
+  } else {
+    // 连续性丢失：重新起算，须等 0x92 重新锚定
+    t.encUnwrapped = enc;
+    t.anchored = false;
+  }
+  t.hasSample = true;
+  t.lastEnc = enc;
+  t.lastSpeedDps = speedDps;
+  t.lastSampleUs = rxUs;
+  if (!t.anchored) {
+    return false;
+  }
+  unitsOut = encoderCountsToUnits(m, t.encUnwrapped) + t.unitsOffset;
+  return true;
+}
+
+// 0x92 锚点：以多圈角校正偏移；尚无连续编码器样本时仅等待
+void encoderTrackerAnchor(EncoderTracker &t, const MotorConfig &m, int64_t units, uint32_t rxUs) {
+  if (!t.hasSample) {
+    return;
+  }
+  const int32_t dtUs = static_cast<int32_t>(rxUs - t.lastSampleUs);
+  if (dtUs > static_cast<int32_t>(ENC_TRACK_MAX_GAP_US) || dtUs < -static_cast<int32_t>(ENC_TRACK_MAX_GAP_US)) {
+    return;
+  }
+  // 编码器样本外推到 0x92 到达时刻（速度 dps → 0.01°/s 为 ×100）
+  int64_t encUnitsAtRx = encoderCountsToUnits(m, t.encUnwrapped) +
+                         static_cast<int64_t>(t.lastSpeedDps * 100.0f * (dtUs * 1e-6f));
+  int64_t newOffset = units - encUnitsAtRx;
+  t.lastAnchorCorrUnits = t.anchored ? static_cast<int32_t>(newOffset - t.unitsOffset) : 0;
+  t.unitsOffset = newOffset;
+  t.anchored = true;
+  t.anchorCount++;
+}
 
 // 踝关节零点偏移（用于标定）
 // 在用户站立自然中立位时，读取的踝电机多圈编码器角度值
@@ -301,6 +1362,55 @@ bool ankle_zero_calibrated = false;  // 是否已完成标定
 int64_t hip_reference_offset = 0;  // 协议单位（0.01°/LSB）
 bool hip_reference_set = false;  // 是否已设置参考姿态
 
+// ============================================================================
+// 电机注册表：按 CAN ID（1~32）直接索引的配置/状态/标定记录
+// ============================================================================
+// 所有“按电机”路径（角度换算、使能状态、应答解析、RX 滤波）都查此表，不再写 id==1/id==2 分支。
+// 增加关节（双侧 4 电机、膝关节等）只需新增 MotorConfig/MotorStatus 并在 initMotorRegistry() 中登记。
+struct MotorRecord {
+  const MotorConfig *config;        // nullptr = 该 ID 未登记
+  MotorStatus *status;
+  EncoderTracker *encTrack;
+  int64_t *calibOffset;             // 逻辑角零点（协议单位）
+  const bool *calibValid;           // 零点是否生效；nullptr = 始终生效
+  float MotorStatus::*logicalDeg;   // 逻辑角写入字段（hip_deg / ankle_deg）
+  float MotorStatus::*unusedDeg;    // 本关节不使用的逻辑角字段（保持 0）
+  volatile uint16_t *angleRxCounter; // 角度 RX 诊断计数（可为 nullptr）
+  void (*onAngleSample)(MotorStatus &status);  // 角度样本后的关节专属处理（可为 nullptr）
+};
+
+static constexpr uint8_t MOTOR_REGISTRY_MAX_ID = 32;
+MotorRecord motorRegistry[MOTOR_REGISTRY_MAX_ID + 1] = {};
+const MotorConfig *motorRegistryList[MOTOR_REGISTRY_MAX_ID];  // 已登记电机（登记顺序）
+uint8_t motorRegistryCount = 0;
+
+// O(1) 查表；未登记或越界返回 nullptr
+inline MotorRecord *motorRecord(uint8_t id) {
+  if (id == 0 || id > MOTOR_REGISTRY_MAX_ID || motorRegistry[id].config == nullptr) {
+    return nullptr;
+  }
+  return &motorRegistry[id];
+}
+
+void registerMotor(const MotorRecord &rec) {
+  uint8_t id = rec.config->id;
+  if (id == 0 || id > MOTOR_REGISTRY_MAX_ID) {
+    return;
+  }
+  if (motorRegistry[id].config == nullptr) {
+    motorRegistryList[motorRegistryCount++] = rec.config;
+  }
+  motorRegistry[id] = rec;
+}
+
+// 记录的当前零点偏移（未生效时为 0）
+inline int64_t motorCalibOffset(const MotorRecord &rec) {
+  if (rec.calibOffset == nullptr || (rec.calibValid != nullptr && !*rec.calibValid)) {
+    return 0;
+  }
+  return *rec.calibOffset;
+}
+
 // ====== 髋关节力矩模式状态 ======
 // 当为 true 时，主循环会定时向髋电机发送转矩闭环控制命令（CMD_TORQUE_CTRL）
 bool hipTorqueMode = false;      // 髋力矩模式使能标志
@@ -347,25 +1457,168 @@ float getAnkleRawDegMotor() {
   return ankleStatus.raw_deg_motor;
 }
 
+// ============================================================================
+// 关节状态估计器（角度 / 角速度 / 角加速度，常加速度模型 Kalman）
+// ============================================================================
+// 状态 x = [θ, ω, a]（deg, deg/s, deg/s²），过程噪声为白噪声 jerk（谱密度 q，deg²/s⁵）：
+// - 按样本真实时间戳的 dt 预测：采样不均匀或丢样时协方差随 dt 自然增大，
+//   下一个样本权重随之提高，不会像「差分 + EMA」那样在长间隔后出现速度尖峰或整体滞后
+// - 角度量测更新（r_angle，deg²）；同一 0x9C/0xA1 应答带回的电机速度折算为关节速度后
+//   作为第二个量测（r_vel，(deg/s)²），减小速度滞后
+// - 调参：q 越大 / r 越小，带宽越高（滞后小、噪声大）；稳态带宽约 (q/r_angle)^(1/6) rad/s
+// - 样本间隔超过 kEstMaxGapUs 视为数据中断，从当前样本重新初始化
+
+struct JointEstimatorTuning {
+  float q_jerk;        // jerk 谱密度（deg²/s⁵）
+  float r_angle;       // 角度量测方差（deg²）
+  float r_vel;         // 电机速度量测方差（(deg/s)²）
+  bool useMotorSpeed;  // 是否融合电机应答速度
+};
+
+struct JointStateEstimator {
+  float x[3];          // θ, ω, a
+  float P[3][3];       // 协方差
+  uint32_t lastUs;     // 上次样本时间（微秒）
+  bool initialized;
+  uint32_t resets;     // 因间隔过大/时间戳回退而重新初始化的次数
+  uint32_t speedFused; // 已融合的电机速度量测数
+  float innov;         // 最近一次角度新息（deg），观察调参效果用
+};
+
+// 默认：带宽约 4Hz（步态主要频率成分 < 3Hz），角度噪声按 0.05° 计
+JointEstimatorTuning hipEstTuning   = {1.0e6f, 0.0025f, 4.0f, true};
+JointEstimatorTuning ankleEstTuning = {1.0e6f, 0.0025f, 4.0f, true};
+JointStateEstimator hipEst = {};
+JointStateEstimator ankleEst = {};
+
+const uint32_t kEstMaxGapUs = 500000;  // 500ms（与原滤波的数据不连续判据一致）
+
+void jointEstimatorReset(JointStateEstimator &e, const JointEstimatorTuning &t, float deg, uint32_t us) {
+  e.x[0] = deg;
+  e.x[1] = 0.0f;
+  e.x[2] = 0.0f;
+  for (uint8_t i = 0; i < 3; ++i) {
+    for (uint8_t j = 0; j < 3; ++j) e.P[i][j] = 0.0f;
+  }
+  // 初始不确定度：角度取量测方差，速度/加速度按步态量级放宽（100 deg/s、3000 deg/s²）
+  e.P[0][0] = t.r_angle;
+  e.P[1][1] = 100.0f * 100.0f;
+  e.P[2][2] = 3000.0f * 3000.0f;
+  e.lastUs = us;
+  e.innov = 0.0f;
+  e.initialized = true;
+}
+
+// 预测：x = F x，P = F P Fᵀ + Q（F 为常加速度转移阵，Q 为白噪声 jerk 离散化结果）
+static void jointEstimatorPredict(JointStateEstimator &e, const JointEstimatorTuning &t, float dt) {
+  const float dt2 = dt * dt;
+  const float dt3 = dt2 * dt;
+  const float F[3][3] = {{1.0f, dt, 0.5f * dt2}, {0.0f, 1.0f, dt}, {0.0f, 0.0f, 1.0f}};
+
+  e.x[0] += e.x[1] * dt + 0.5f * e.x[2] * dt2;
+  e.x[1] += e.x[2] * dt;
+
+  float FP[3][3];
+  for (uint8_t i = 0; i < 3; ++i) {
+    for (uint8_t j = 0; j < 3; ++j) {
+      FP[i][j] = F[i][0] * e.P[0][j] + F[i][1] * e.P[1][j] + F[i][2] * e.P[2][j];
+    }
+  }
+  const float q = t.q_jerk;
+  const float Q[3][3] = {{q * dt3 * dt2 / 20.0f, q * dt2 * dt2 / 8.0f, q * dt3 / 6.0f},
+                         {q * dt2 * dt2 / 8.0f,  q * dt3 / 3.0f,       q * dt2 / 2.0f},
+                         {q * dt3 / 6.0f,        q * dt2 / 2.0f,       q * dt}};
+  for (uint8_t i = 0; i < 3; ++i) {
+    for (uint8_t j = i; j < 3; ++j) {
+      float v = FP[i][0] * F[j][0] + FP[i][1] * F[j][1] + FP[i][2] * F[j][2] + Q[i][j];
+      e.P[i][j] = v;
+      e.P[j][i] = v;
+    }
+  }
+}
+
+// 标量量测更新：观测第 idx 个状态（0=角度，1=速度），返回新息
+static float jointEstimatorUpdate(JointStateEstimator &e, uint8_t idx, float z, float r) {
+  const float S = e.P[idx][idx] + r;
+  if (!(S > 0.0f)) return 0.0f;
+  float K[3];
+  float Prow[3];
+  for (uint8_t i = 0; i < 3; ++i) {
+    K[i] = e.P[i][idx] / S;
+    Prow[i] = e.P[idx][i];
+  }
+  const float y = z - e.x[idx];
+  for (uint8_t i = 0; i < 3; ++i) {
+    e.x[i] += K[i] * y;
+  }
+  for (uint8_t i = 0; i < 3; ++i) {
+    for (uint8_t j = i; j < 3; ++j) {
+      float v = e.P[i][j] - K[i] * Prow[j];
+      e.P[i][j] = v;
+      e.P[j][i] = v;
+    }
+  }
+  return y;
+}
+
+// 送入一个角度样本（sampleUs 为接收打点）；jointSpeedDps 非空时同时融合电机速度
+// 返回 false 表示同一样本重复送入（dt = 0），状态未变
+bool jointEstimatorStep(JointStateEstimator &e, const JointEstimatorTuning &t, float deg, uint32_t sampleUs,
+                        const float *jointSpeedDps) {
+  if (!e.initialized) {
+    jointEstimatorReset(e, t, deg, sampleUs);
+    if (jointSpeedDps != nullptr && t.useMotorSpeed) {
+      e.x[1] = *jointSpeedDps;
+      e.P[1][1] = t.r_vel;
+    }
+    return true;
+  }
+  const int32_t dt_us = static_cast<int32_t>(sampleUs - e.lastUs);
+  if (dt_us == 0) return false;
+  if (dt_us < 0 || static_cast<uint32_t>(dt_us) > kEstMaxGapUs) {
+    e.resets++;
+    jointEstimatorReset(e, t, deg, sampleUs);
+    return true;
+  }
+  jointEstimatorPredict(e, t, dt_us * 1e-6f);
+  e.innov = jointEstimatorUpdate(e, 0, deg, t.r_angle);
+  if (jointSpeedDps != nullptr && t.useMotorSpeed) {
+    jointEstimatorUpdate(e, 1, *jointSpeedDps, t.r_vel);
+    e.speedFused++;
+  }
+  e.lastUs = sampleUs;
+  return true;
+}
+
+// 由最近一次样本时刻外推 hUs 微秒（只读，不改变估计器状态）；时延补偿用
+void jointEstimatorExtrapolate(const JointStateEstimator &e, uint32_t hUs, float &deg, float &vel) {
+  const float h = hUs * 1e-6f;
+  deg = e.x[0] + e.x[1] * h + 0.5f * e.x[2] * h * h;
+  vel = e.x[1] + e.x[2] * h;
+}
+
+// 稳态带宽估计（Hz），仅用于调参显示
+float jointEstimatorBandwidthHz(const JointEstimatorTuning &t) {
+  if (!(t.r_angle > 0.0f) || !(t.q_jerk > 0.0f)) return 0.0f;
+  return powf(t.q_jerk / t.r_angle, 1.0f / 6.0f) / (2.0f * static_cast<float>(M_PI));
+}
+
 // ============================================================================
 // 髋关节信号预处理（用于步态相位识别）
 // ============================================================================
 
-// 髋关节信号预处理状态
+// 髋关节信号预处理状态（由 hipEst 估计器输出填充，字段名保持不变供相位检测/遥测使用）
 struct HipSignalProcessor {
-  float hip_f;          // 滤波后的髋角（度）
-  float hip_f_prev;      // 上次滤波后的髋角（用于计算速度）
-  float hip_vel;         // 髋角速度（度/秒）
-  float hip_vel_f;       // 滤波后的髋角速度（度/秒）
-  uint32_t lastUpdateMs; // 上次更新时间（毫秒）
+  float hip_f;          // 估计髋角（度）
+  float hip_raw_prev;   // 上次原始髋角（用于差分速度诊断）
+  float hip_vel;        // 原始差分髋角速度（度/秒，仅诊断）
+  float hip_vel_f;      // 估计髋角速度（度/秒）
+  float hip_acc;        // 估计髋角加速度（度/秒²）
+  uint32_t lastUpdateUs; // 上次样本时间（微秒，样本接收打点）
   bool initialized;      // 是否已初始化
 };
 
-HipSignalProcessor hipProcessor = {0.0f, 0.0f, 0.0f, 0.0f, 0, false};
-
-// 滤波参数（根据《调整开发计划V1.md》）
-const float HIP_FILTER_ALPHA = 0.2f;   // 髋角滤波系数（α = 0.15~0.25，取0.2）
-const float HIP_VEL_FILTER_BETA = 0.2f; // 速度滤波系数（β = 0.2）
+HipSignalProcessor hipProcessor = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0, false};
 
 // ============================================================================
 // 步态检测算法参数（V2：基于零点的绝对+趋势判定）
@@ -387,72 +1640,42 @@ const float HIP_VEL_FILTER_BETA = 0.2f; // 速度滤波系数（β = 0.2）
 //    - 如果起步辅助太迟，调小 V_up（目前 10.0f，之前是 20.0f）
 
 // 更新髋关节信号预处理
-// 输入：hip_raw（原始髋角，度）
-// 输出：更新hipProcessor中的滤波值和速度
-void updateHipSignalProcessor(float hip_raw) {
-  uint32_t now = millis();
-  
-  // 初始化
-  if (!hipProcessor.initialized) {
-    hipProcessor.hip_f = hip_raw;
-    hipProcessor.hip_f_prev = hip_raw;
-    hipProcessor.hip_vel = 0.0f;
-    hipProcessor.hip_vel_f = 0.0f;
-    hipProcessor.lastUpdateMs = now;
-    hipProcessor.initialized = true;
-    return;
-  }
-  
-  // 计算时间差（秒）
-  float dt = (now - hipProcessor.lastUpdateMs) / 1000.0f;
-  
-  // 如果时间差太大（>500ms）或无效，说明数据不连续，重新初始化
-  // 注意：放宽限制，因为CAN响应时间可能不稳定
-  if (dt > 0.5f || dt <= 0.0f) {
-    hipProcessor.hip_f = hip_raw;
-    hipProcessor.hip_f_prev = hip_raw;
+// 输入：hip_raw（原始髋角，度）、sampleUs（样本接收时间，微秒）、
+//       speedDps（同一应答的关节速度，deg/s；无则 nullptr）
+// 输出：更新hipProcessor中的估计角度、速度和加速度
+void updateHipSignalProcessor(float hip_raw, uint32_t sampleUs, const float *speedDps) {
+  const bool wasInit = hipEst.initialized;
+  const uint32_t prevUs = hipEst.lastUs;
+  if (!jointEstimatorStep(hipEst, hipEstTuning, hip_raw, sampleUs, speedDps)) {
+    return;  // 同一样本重复送入
+  }
+
+  // 原始差分速度仅作诊断对照（status 中显示），不参与相位判定
+  const uint32_t dt_us = sampleUs - prevUs;
+  if (wasInit && hipEst.lastUs == sampleUs && dt_us > 0 && dt_us <= kEstMaxGapUs) {
+    hipProcessor.hip_vel = (hip_raw - hipProcessor.hip_raw_prev) / (dt_us * 1e-6f);
+  } else {
     hipProcessor.hip_vel = 0.0f;
-    hipProcessor.hip_vel_f = 0.0f;
-    hipProcessor.lastUpdateMs = now;
-    return;
-  }
-  
-  // 如果时间差太小（<1ms），跳过本次更新，避免除零或计算不稳定
-  if (dt < 0.001f) {
-    return;
   }
-  
-  // 1. 髋角低通滤波（EMA）
-  // hip_f = hip_f + α * (hip_raw - hip_f)
-  hipProcessor.hip_f = hipProcessor.hip_f + HIP_FILTER_ALPHA * (hip_raw - hipProcessor.hip_f);
-  
-  // 2. 髋角速度计算（差分）
-  // hip_vel = (hip_f - hip_f_prev) / dt
-  // 注意：使用滤波后的角度变化来计算速度
-  float angle_diff = hipProcessor.hip_f - hipProcessor.hip_f_prev;
-  hipProcessor.hip_vel = angle_diff / dt;
-  
-  // 3. 髋角速度再滤波（EMA）
-  // hip_vel_f = hip_vel_f + β * (hip_vel - hip_vel_f)
-  hipProcessor.hip_vel_f = hipProcessor.hip_vel_f + HIP_VEL_FILTER_BETA * (hipProcessor.hip_vel - hipProcessor.hip_vel_f);
-  
-  // 更新状态
-  hipProcessor.hip_f_prev = hipProcessor.hip_f;
-  hipProcessor.lastUpdateMs = now;
+  hipProcessor.hip_raw_prev = hip_raw;
+
+  hipProcessor.hip_f = hipEst.x[0];
+  hipProcessor.hip_vel_f = hipEst.x[1];
+  hipProcessor.hip_acc = hipEst.x[2];
+  hipProcessor.lastUpdateUs = sampleUs;
+  hipProcessor.initialized = true;
 }
 
 // ============================================================================
 // 自适应阈值计算（用于步态相位识别）
 // ============================================================================
 
-// 滑动窗口大小：2秒 @ 100Hz = 200个数据点
-#define HIP_WINDOW_SIZE 200
+// 滑动窗口大小：4秒 @ 100Hz = 400个数据点（约 3~4 个步态周期；更新为 O(1)，加长窗口不增加 RX 处理耗时）
+#define HIP_WINDOW_SIZE 400
 
 // 自适应阈值状态
 struct AdaptiveThreshold {
-  float window[HIP_WINDOW_SIZE];  // 滑动窗口（存储滤波后的髋角）
-  uint16_t windowIndex;            // 当前窗口索引（循环缓冲区）
-  uint16_t windowCount;            // 窗口中的数据数量（初始填充时使用）
+  SlidingWindowStats<HIP_WINDOW_SIZE> window;  // 滑动窗口（滤波后的髋角）
   bool initialized;                // 是否已初始化
   
   float hip_mean;                  // 髋角均值（度）
@@ -467,7 +1690,7 @@ struct AdaptiveThreshold {
 };
 
 AdaptiveThreshold adaptiveThreshold = {
-  {0}, 0, 0, false,
+  {}, false,
   0.0f, 0.0f,
   0.0f, 0.0f, 20.0f, -20.0f,
   0
@@ -500,16 +1723,13 @@ const uint32_t T_HOLD_MS = 80;
 // 输入：hip_f（滤波后的髋角，度）
 // 输出：更新adaptiveThreshold中的均值和阈值
 void updateAdaptiveThreshold(float hip_f) {
+  PROF_ZONE(ZONE_ADAPTIVE_THRESHOLD);
   uint32_t now = millis();
   
   // 初始化
   if (!adaptiveThreshold.initialized) {
     // 填充窗口初始值
-    for (uint16_t i = 0; i < HIP_WINDOW_SIZE; i++) {
-      adaptiveThreshold.window[i] = hip_f;
-    }
-    adaptiveThreshold.windowIndex = 0;
-    adaptiveThreshold.windowCount = HIP_WINDOW_SIZE;
+    adaptiveThreshold.window.fill(hip_f);
     adaptiveThreshold.hip_mean = hip_f;
     adaptiveThreshold.hip_amp = 0.0f;
     adaptiveThreshold.A_up = 0.0f;
@@ -519,34 +1739,10 @@ void updateAdaptiveThreshold(float hip_f) {
     return;
   }
   
-  // 将新数据加入滑动窗口（覆盖最旧的数据）
-  adaptiveThreshold.window[adaptiveThreshold.windowIndex] = hip_f;
-  adaptiveThreshold.windowIndex = (adaptiveThreshold.windowIndex + 1) % HIP_WINDOW_SIZE;
-  
-  // 如果窗口还未填满，增加计数
-  if (adaptiveThreshold.windowCount < HIP_WINDOW_SIZE) {
-    adaptiveThreshold.windowCount++;
-  }
-  
-  // 计算均值
-  float sum = 0.0f;
-  for (uint16_t i = 0; i < adaptiveThreshold.windowCount; i++) {
-    sum += adaptiveThreshold.window[i];
-  }
-  adaptiveThreshold.hip_mean = sum / adaptiveThreshold.windowCount;
-  
-  // 计算幅度（max - min）
-  float min_val = adaptiveThreshold.window[0];
-  float max_val = adaptiveThreshold.window[0];
-  for (uint16_t i = 1; i < adaptiveThreshold.windowCount; i++) {
-    if (adaptiveThreshold.window[i] < min_val) {
-      min_val = adaptiveThreshold.window[i];
-    }
-    if (adaptiveThreshold.window[i] > max_val) {
-      max_val = adaptiveThreshold.window[i];
-    }
-  }
-  adaptiveThreshold.hip_amp = max_val - min_val;
+  // 将新数据加入滑动窗口（覆盖最旧的数据）；均值与幅度（max - min）均为 O(1) 增量更新
+  adaptiveThreshold.window.push(hip_f);
+  adaptiveThreshold.hip_mean = adaptiveThreshold.window.mean();
+  adaptiveThreshold.hip_amp = adaptiveThreshold.window.range();
   
   // ========== 增加幅值下限保护 ==========
   // 使用有效幅度：max(detector.hip_amp, 15.0f)
@@ -582,9 +1778,9 @@ void updateAdaptiveThreshold(float hip_f) {
 struct GaitPhaseDetector {
   GaitPhase currentPhase;         // 当前相位
   uint32_t phaseStartMs;          // 当前相位开始时间（毫秒）
-  uint32_t conditionHoldMs;       // 条件持续满足的时间（毫秒）
+  uint32_t conditionHoldUs;       // 条件持续满足的时间（微秒）
   bool initialized;               // 是否已初始化
-  uint32_t lastUpdateMs;          // 上次更新时间
+  uint32_t lastUpdateUs;          // 上次更新时间（微秒，髋样本接收打点）
   float hip_max;                  // 当前SWING周期内探测到的最大髋关节角度（峰值）
   float hip_min;                  // 当前STANCE阶段内的髋关节最小角度（谷值）
   float hip_max_last;             // 上一SWING周期的最大髋角（用于进度映射幅值）
@@ -596,9 +1792,9 @@ GaitPhaseDetector gaitPhaseDetector = {
 };
 
 // 更新步态相位识别
-// 输入：使用hipProcessor和adaptiveThreshold中的数据
+// 输入：使用hipProcessor和adaptiveThreshold中的数据；sampleUs 为髋样本接收时间（防抖按 µs 累计）
 // 输出：更新gaitPhaseDetector中的相位状态
-void updateGaitPhaseDetector() {
+void updateGaitPhaseDetector(uint32_t sampleUs) {
   // 检查前置条件：信号处理和阈值计算必须已初始化
   if (!hipProcessor.initialized || !adaptiveThreshold.initialized) {
     return;
@@ -610,8 +1806,8 @@ void updateGaitPhaseDetector() {
   if (!gaitPhaseDetector.initialized) {
     gaitPhaseDetector.currentPhase = PHASE_STANCE;
     gaitPhaseDetector.phaseStartMs = now;
-    gaitPhaseDetector.conditionHoldMs = 0;
-    gaitPhaseDetector.lastUpdateMs = now;
+    gaitPhaseDetector.conditionHoldUs = 0;
+    gaitPhaseDetector.lastUpdateUs = sampleUs;
     // 初始化谷值与峰值
     float hip_f_init = hipProcessor.hip_f;
     gaitPhaseDetector.hip_min = hip_f_init;
@@ -622,9 +1818,9 @@ void updateGaitPhaseDetector() {
   }
   
   // 计算时间差
-  uint32_t dt_ms = now - gaitPhaseDetector.lastUpdateMs;
-  if (dt_ms == 0) {
-    return;  // 避免除零
+  uint32_t dt_us = sampleUs - gaitPhaseDetector.lastUpdateUs;
+  if (dt_us == 0) {
+    return;  // 同一样本重复送入
   }
   
   // 获取当前信号值
@@ -659,34 +1855,34 @@ void updateGaitPhaseDetector() {
   if (gaitPhaseDetector.currentPhase == PHASE_STANCE) {
     // 当前是支撑相，检查是否满足进入摆动相的条件
     if (swingConditionMet) {
-      gaitPhaseDetector.conditionHoldMs += dt_ms;
+      gaitPhaseDetector.conditionHoldUs += dt_us;
     } else {
       // 条件不满足，重置计时器
-      gaitPhaseDetector.conditionHoldMs = 0;
+      gaitPhaseDetector.conditionHoldUs = 0;
     }
     
     // 如果条件持续满足超过防抖时间，切换到摆动相
-    if (gaitPhaseDetector.conditionHoldMs >= T_HOLD_MS) {
+    if (gaitPhaseDetector.conditionHoldUs >= T_HOLD_MS * 1000u) {
       gaitPhaseDetector.currentPhase = PHASE_SWING;
       gaitPhaseDetector.phaseStartMs = now;
-      gaitPhaseDetector.conditionHoldMs = 0;  // 重置计时器
+      gaitPhaseDetector.conditionHoldUs = 0;  // 重置计时器
       // 进入SWING：以当前hf作为本周期的起始峰值
       gaitPhaseDetector.hip_max = hip_f;
     }
   } else {
     // 当前是摆动相，检查是否满足进入支撑相的条件
     if (stanceConditionMet) {
-      gaitPhaseDetector.conditionHoldMs += dt_ms;
+      gaitPhaseDetector.conditionHoldUs += dt_us;
     } else {
       // 条件不满足，重置计时器
-      gaitPhaseDetector.conditionHoldMs = 0;
+      gaitPhaseDetector.conditionHoldUs = 0;
     }
     
     // 如果条件持续满足超过防抖时间，切换到支撑相
-    if (gaitPhaseDetector.conditionHoldMs >= T_HOLD_MS) {
+    if (gaitPhaseDetector.conditionHoldUs >= T_HOLD_MS * 1000u) {
       gaitPhaseDetector.currentPhase = PHASE_STANCE;
       gaitPhaseDetector.phaseStartMs = now;
-      gaitPhaseDetector.conditionHoldMs = 0;  // 重置计时器
+      gaitPhaseDetector.conditionHoldUs = 0;  // 重置计时器
       // 退出SWING：记录本周期峰值供后续进度映射使用，并用当前hf初始化下一周期的谷值
       gaitPhaseDetector.hip_max_last = gaitPhaseDetector.hip_max;
       gaitPhaseDetector.hip_min = hip_f;
@@ -709,7 +1905,7 @@ void updateGaitPhaseDetector() {
   //   lastDebugMs = now;
   // }
   
-  gaitPhaseDetector.lastUpdateMs = now;
+  gaitPhaseDetector.lastUpdateUs = sampleUs;
 }
 
 // 获取当前步态相位（供其他模块调用）
@@ -762,6 +1958,21 @@ SwingProgress swingProgress = {
   PHASE_STANCE
 };
 
+// 空间偏移映射进度：
+//   s = (hf - hip_min) / max(hip_max_last - hip_min, 15.0)
+// 这样0点永远对齐“起摆物理起点”（STANCE阶段的谷值），幅值使用上一周期的峰-谷差
+// 输入任意髋角（实测或时延补偿外推值），不修改状态
+float swingProgressAtHip(float hip_f) {
+  float hip_min = gaitPhaseDetector.hip_min;  // 当前STANCE阶段谷值
+  float hip_max_last = gaitPhaseDetector.hip_max_last;  // 上一SWING周期峰值
+
+  float amp = hip_max_last - hip_min;
+  if (amp < 15.0f) amp = 15.0f;  // 幅值下限15度，避免分母过小
+
+  float s = (hip_f - hip_min) / amp;
+  return constrain(s, 0.0f, 1.0f);
+}
+
 // 更新摆动相进度计算
 // 输入：使用gaitPhaseDetector中的相位信息
 // 输出：更新swingProgress中的进度值
@@ -790,18 +2001,7 @@ void updateSwingProgress() {
     uint32_t swingDurationMs = getCurrentPhaseDurationMs();
     swingProgress.t_swing = swingDurationMs / 1000.0f;  // 转换为秒
     
-    // 空间偏移映射进度：
-    //   s = (hf - hip_min) / max(hip_max_last - hip_min, 15.0)
-    // 这样0点永远对齐“起摆物理起点”（STANCE阶段的谷值），幅值使用上一周期的峰-谷差
-    float hip_f = hipProcessor.hip_f;           // hf
-    float hip_min = gaitPhaseDetector.hip_min;  // 当前STANCE阶段谷值
-    float hip_max_last = gaitPhaseDetector.hip_max_last;  // 上一SWING周期峰值
-
-    float amp = hip_max_last - hip_min;
-    if (amp < 15.0f) amp = 15.0f;  // 幅值下限15度，避免分母过小
-
-    float s = (hip_f - hip_min) / amp;
-    swingProgress.swing_progress = constrain(s, 0.0f, 1.0f);
+    swingProgress.swing_progress = swingProgressAtHip(hipProcessor.hip_f);
   } else {
     // 当前是支撑相，进度为0
     swingProgress.t_swing = 0.0f;
@@ -1196,6 +2396,40 @@ bool isPhase4Degraded() {
   return phase4Det.initialized ? phase4Det.degraded : false;
 }
 
+// ---- 推进期预测门控（仅供助力律）----
+// 4 相检测本身按当前时刻运行（遥测、FwLog、相位曲线均不受时延补偿影响）；
+// 助力律另按预计出力时刻的支撑进度评估 P2→P3 边界（同样 PHASE4_DEBOUNCE_MS 防抖），
+// 使 push-off 起始落在设定的支撑进度上。leadMs = 0 时与 PHASE4_PUSH_OFF 判定完全一致。
+struct PushOffGate {
+  uint32_t holdMs;   // 预测支撑进度 ≥ P2P3 的持续时间
+  uint32_t lastMs;
+  bool predicted;    // 预计出力时刻已处于推进期
+};
+
+PushOffGate pushOffGate = {0, 0, false};
+
+void updatePushOffGate(float stancePctAct, uint32_t leadMs, uint32_t nowMs) {
+  const uint32_t dt_ms = nowMs - pushOffGate.lastMs;
+  pushOffGate.lastMs = nowMs;
+  const GaitPhase4 ph4 = getCurrentGaitPhase4();
+  if (leadMs == 0 || ph4 != PHASE4_MID_STANCE || isPhase4Degraded()) {
+    pushOffGate.holdMs = 0;
+    pushOffGate.predicted = (ph4 == PHASE4_PUSH_OFF);
+    return;
+  }
+  if (stancePctAct >= PHASE4_P2P3_STANCE_PCT) {
+    pushOffGate.holdMs += dt_ms;
+  } else {
+    pushOffGate.holdMs = 0;
+  }
+  pushOffGate.predicted = pushOffGate.holdMs >= PHASE4_DEBOUNCE_MS;
+}
+
+// 助力律用：预计出力时刻是否处于推进期（P3）
+bool isPushOffPhaseAct() {
+  return pushOffGate.predicted;
+}
+
 // ============================================================================
 // 踝背屈辅助策略（B人群核心）
 // ============================================================================
@@ -1555,6 +2789,7 @@ void resetComplianceFault() {
 // CAN ID 定义（根据协议文档）
 // ============================================================================
 #define CAN_CMD_BASE_ID       0x140  // 控制指令基地址（0x140 + ID）
+#define CAN_BROADCAST_TORQUE_ID 0x280 // 多电机转矩广播（ID 1~4 各占 2 字节 iq，各电机按 0x140+ID 回 0xA1 格式应答）
 
 // ============================================================================
 // 命令字节定义（根据协议文档 V2.35）
@@ -1592,16 +2827,9 @@ void resetComplianceFault() {
 // 对于踝关节：逻辑角（解剖角） -> 协议单位（考虑零点偏移和方向系数）
 // 方向系数统一处理：逻辑角 * dir * unitsPerDeg -> 协议单位
 int32_t logicalAngleToUnits(const MotorConfig &m, float logicalDeg) {
-  int64_t offset;
-  if (m.id == 1) {
-    // 髋关节：逻辑角 + 参考偏移 -> 协议单位
-    offset = hip_reference_offset;
-  } else if (m.id == 2) {
-    // 踝关节：逻辑角（解剖角） + 零点偏移 -> 协议单位
-    offset = ankle_zero_calibrated ? ankle_zero_offset : 0;
-  } else {
-    offset = 0;
-  }
+  // 髋：参考偏移；踝：已标定时的零点偏移（由注册表记录给出）
+  const MotorRecord *rec = motorRecord(m.id);
+  int64_t offset = rec ? motorCalibOffset(*rec) : 0;
   
   // 逻辑角转换为协议单位：units = logicalDeg * dir * unitsPerDeg + offset
   // 方向系数 dir 统一处理角度方向
@@ -1614,93 +2842,1018 @@ int32_t logicalAngleToUnits(const MotorConfig &m, float logicalDeg) {
   return static_cast<int32_t>(units);
 }
 
-// [兼容性] 角度（deg）转换为协议单位（int32）- 保留用于向后兼容
-// 注意：新代码应使用logicalAngleToUnits()，此函数假设输入为逻辑角
-int32_t angleDegToUnits(const MotorConfig &m, float deg) {
-  return logicalAngleToUnits(m, deg);
+// [兼容性] 角度（deg）转换为协议单位（int32）- 保留用于向后兼容
+// 注意：新代码应使用logicalAngleToUnits()，此函数假设输入为逻辑角
+int32_t angleDegToUnits(const MotorConfig &m, float deg) {
+  return logicalAngleToUnits(m, deg);
+}
+
+// 协议单位转换为角度（deg）
+// 方向系数统一处理：协议单位 / unitsPerDeg * dir -> 逻辑角
+float unitsToAngleDeg(const MotorConfig &m, int64_t units) {
+  // 协议单位转换为逻辑角：logicalDeg = (units / unitsPerDeg) * dir
+  // 方向系数 dir 统一处理角度方向
+  return static_cast<float>(units) * m.dir / m.unitsPerDeg;
+}
+
+// 关节速度（deg/s）转换为电机轴速度（dps）
+// 根据减速比：关节速度 * 减速比 = 电机轴速度
+// 髋关节减速比 1:36，踝关节减速比 1:10
+uint16_t jointSpeedToMotorSpeed(const MotorConfig &m, float jointSpeedDps) {
+  // 减速比 = unitsPerDeg / 100（因为1关节度 = unitsPerDeg协议单位，而1协议单位 = 0.01电机轴度）
+  // 所以减速比 = unitsPerDeg / 100
+  float reductionRatio = m.unitsPerDeg / 100.0f;
+  float motorSpeedDps = jointSpeedDps * reductionRatio;
+  
+  // 转换为uint16_t，并限制在合理范围内
+  if (motorSpeedDps < 0.0f) motorSpeedDps = 0.0f;
+  if (motorSpeedDps > 10000.0f) motorSpeedDps = 10000.0f;  // 上限保护
+  
+  return static_cast<uint16_t>(motorSpeedDps);
+}
+
+// 电机轴速度（0x9C/0xA1 应答 speed 字段，dps）转换为逻辑关节速度（deg/s）
+// 与 unitsToAngleDeg 一致：电机轴 1° = 100 协议单位，再除以 unitsPerDeg 并乘方向系数
+float motorSpeedToJointDps(const MotorConfig &m, int16_t motorDps) {
+  return static_cast<float>(motorDps) * 100.0f * m.dir / m.unitsPerDeg;
+}
+
+// 与当前角度样本同一应答（或紧邻）的电机速度；0x92 应答不带速度，此时返回 false
+bool jointSpeedSample(const MotorConfig &m, const MotorStatus &s, float &jointDps) {
+  const uint32_t kPairUs = 2000;
+  if (s.speedSampleUs == 0 || (uint32_t)(s.sampleUs - s.speedSampleUs) > kPairUs) return false;
+  jointDps = motorSpeedToJointDps(m, s.speed);
+  return true;
+}
+
+// ============================================================================
+// CAN 通信函数（根据协议文档实现）
+// ============================================================================
+
+// ============================================================================
+// CAN 总线占用统计（按 ID / 命令字节计帧，按位填充后的真实位数估算 1Mbps 占用率）
+// ============================================================================
+// TX 在 CanTx 真正写入 FlexCAN 时计数（loop 上下文），RX 在 CanRx 中断回调中计数。
+// 计数器只增不清，窗口统计用“本窗口累计 - 上窗口快照”，避免 ISR / loop 之间的清零竞争。
+// 硬件滤波拒收的外部帧不可见；需要统计全总线负载时保留 CanRx 的 catch-all 邮箱。
+namespace BusStat {
+
+static constexpr uint32_t kBitRate = 1000000;      // 1 Mbps：1 bit = 1 µs
+static constexpr uint32_t kWindowMs = 1000;        // 利用率统计窗口
+// 按 ID 分桶：0~32 = 0x140+ID 电机帧，其后为广播 / 板级 / 其他
+static constexpr uint8_t kIdxBroadcast = 33;
+static constexpr uint8_t kIdxBoard = 34;
+static constexpr uint8_t kIdxOther = 35;
+static constexpr uint8_t kNumIdBuckets = 36;
+
+struct Counters {
+  volatile uint32_t frames;
+  volatile uint32_t bits;
+  volatile uint32_t byId[kNumIdBuckets];
+  volatile uint32_t byCmd[256];
+};
+
+static Counters g_tx = {};
+static Counters g_rx = {};
+
+// 突发深度：同一 1ms 时隙内总线上出现的帧数（TX+RX），窗口内取峰值
+static volatile uint32_t g_burstSlotMs = 0;
+static volatile uint16_t g_burstCount = 0;
+static volatile uint16_t g_burstPeakWindow = 0;
+
+// 窗口快照
+struct WindowResult {
+  float utilPct;
+  float txFps;
+  float rxFps;
+  uint16_t burstPeak;
+  uint16_t txQueueHighWater;
+};
+static WindowResult g_last = {};
+static uint32_t g_winStartMs = 0;
+static uint32_t g_winTxBits = 0;
+static uint32_t g_winRxBits = 0;
+static uint32_t g_winTxFrames = 0;
+static uint32_t g_winRxFrames = 0;
+static float g_peakUtilPct = 0.0f;
+
+static uint8_t idBucket(uint32_t id) {
+  if (id > CAN_CMD_BASE_ID && id <= CAN_CMD_BASE_ID + 32) {
+    return static_cast<uint8_t>(id - CAN_CMD_BASE_ID);
+  }
+  if (id == CAN_BROADCAST_TORQUE_ID) {
+    return kIdxBroadcast;
+  }
+  if (id == BOARD_CMD_ID) {
+    return kIdxBoard;
+  }
+  return kIdxOther;
+}
+
+// 帧在线上的位数（含位填充）：SOF..CRC 段按 CRC-15 + 填充规则逐位模拟，再加 CRC 界定/ACK/EOF/帧间隔 13 位
+uint16_t frameBits(const CAN_message_t &msg) {
+  uint8_t bits[1 + 32 + 6 + 64 + 15];
+  uint8_t n = 0;
+  uint8_t len = msg.len > 8 ? 8 : msg.len;
+  bits[n++] = 0;  // SOF
+  if (msg.flags.extended) {
+    for (int i = 28; i >= 18; --i) bits[n++] = (msg.id >> i) & 1u;  // 基本 ID
+    bits[n++] = 1;  // SRR
+    bits[n++] = 1;  // IDE
+    for (int i = 17; i >= 0; --i) bits[n++] = (msg.id >> i) & 1u;   // 扩展 ID
+    bits[n++] = msg.flags.remote ? 1 : 0;  // RTR
+    bits[n++] = 0;  // r1
+    bits[n++] = 0;  // r0
+  } else {
+    for (int i = 10; i >= 0; --i) bits[n++] = (msg.id >> i) & 1u;
+    bits[n++] = msg.flags.remote ? 1 : 0;  // RTR
+    bits[n++] = 0;  // IDE
+    bits[n++] = 0;  // r0
+  }
+  for (int i = 3; i >= 0; --i) bits[n++] = (len >> i) & 1u;  // DLC
+  if (!msg.flags.remote) {
+    for (uint8_t b = 0; b < len; ++b) {
+      for (int i = 7; i >= 0; --i) bits[n++] = (msg.buf[b] >> i) & 1u;
+    }
+  }
+  // CRC-15（多项式 0x4599）
+  uint16_t crc = 0;
+  for (uint8_t i = 0; i < n; ++i) {
+    uint8_t nxt = bits[i] ^ ((crc >> 14) & 1u);
+    crc = (crc << 1) & 0x7FFF;
+    if (nxt) {
+      crc ^= 0x4599;
+    }
+  }
+  for (int i = 14; i >= 0; --i) bits[n++] = (crc >> i) & 1u;
+  // 位填充：连续 5 个相同位后插入 1 个反相位（填充位参与后续计数）
+  uint8_t stuff = 0;
+  uint8_t run = 1;
+  uint8_t last = bits[0];
+  for (uint8_t i = 1; i < n; ++i) {
+    if (bits[i] == last) {
+      if (++run == 5) {
+        stuff++;
+        last = !last;
+        run = 1;
+      }
+    } else {
+      last = bits[i];
+      run = 1;
+    }
+  }
+  return static_cast<uint16_t>(n + stuff + 13);
+}
+
+static void noteBurst() {
+  uint32_t ms = millis();
+  if (ms != g_burstSlotMs) {
+    g_burstSlotMs = ms;
+    g_burstCount = 0;
+  }
+  uint16_t c = ++g_burstCount;
+  if (c > g_burstPeakWindow) {
+    g_burstPeakWindow = c;
+  }
+}
+
+static void count(Counters &c, const CAN_message_t &msg) {
+  c.frames++;
+  c.bits += frameBits(msg);
+  c.byId[idBucket(msg.id)]++;
+  if (msg.len > 0) {
+    c.byCmd[msg.buf[0]]++;
+  }
+}
+
+// loop 上下文：已写入 FlexCAN 的帧
+void onTx(const CAN_message_t &msg) {
+  count(g_tx, msg);
+  noInterrupts();
+  noteBurst();
+  interrupts();
+}
+
+// CAN RX 中断上下文
+void onRx(const CAN_message_t &msg) {
+  count(g_rx, msg);
+  noteBurst();
+}
+
+// loop 中调用：窗口到期时结算利用率（TX 队列高水位由 CanTx 提供，见 tick 调用处）
+void tick(uint32_t nowMs, uint16_t txQueueHighWater) {
+  uint32_t elapsed = nowMs - g_winStartMs;
+  if (elapsed < kWindowMs) {
+    return;
+  }
+  uint32_t txBits = g_tx.bits, rxBits = g_rx.bits;
+  uint32_t txFrames = g_tx.frames, rxFrames = g_rx.frames;
+  float windowBits = static_cast<float>(elapsed) * (kBitRate / 1000u);
+  g_last.utilPct = 100.0f * static_cast<float>((txBits - g_winTxBits) + (rxBits - g_winRxBits)) / windowBits;
+  g_last.txFps = 1000.0f * static_cast<float>(txFrames - g_winTxFrames) / elapsed;
+  g_last.rxFps = 1000.0f * static_cast<float>(rxFrames - g_winRxFrames) / elapsed;
+  noInterrupts();
+  g_last.burstPeak = g_burstPeakWindow;
+  g_burstPeakWindow = 0;
+  interrupts();
+  g_last.txQueueHighWater = txQueueHighWater;
+  if (g_last.utilPct > g_peakUtilPct) {
+    g_peakUtilPct = g_last.utilPct;
+  }
+  g_winTxBits = txBits;
+  g_winRxBits = rxBits;
+  g_winTxFrames = txFrames;
+  g_winRxFrames = rxFrames;
+  g_winStartMs = nowMs;
+}
+
+float utilizationPct() {
+  return g_last.utilPct;
+}
+
+static const char *bucketName(uint8_t idx, char *buf, size_t len) {
+  if (idx == kIdxBroadcast) return "0x280 bcast";
+  if (idx == kIdxBoard) return "0x200 board";
+  if (idx == kIdxOther) return "other";
+  snprintf(buf, len, "0x%03X", static_cast<unsigned>(CAN_CMD_BASE_ID + idx));
+  return buf;
+}
+
+void printReport(Print &out) {
+  out.printf("=== CAN bus (1 Mbps, window %lu ms) ===\n", static_cast<unsigned long>(kWindowMs));
+  out.printf("util=%.1f%% (peak %.1f%%) tx=%.1f fps rx=%.1f fps burst_peak=%u frames/ms tx_queue_hw=%u\n",
+             g_last.utilPct, g_peakUtilPct, g_last.txFps, g_last.rxFps,
+             static_cast<unsigned>(g_last.burstPeak), static_cast<unsigned>(g_last.txQueueHighWater));
+  out.printf("total: tx=%lu frames / %lu bits, rx=%lu frames / %lu bits\n",
+             static_cast<unsigned long>(g_tx.frames), static_cast<unsigned long>(g_tx.bits),
+             static_cast<unsigned long>(g_rx.frames), static_cast<unsigned long>(g_rx.bits));
+  out.println("by ID (tx / rx):");
+  char name[12];
+  for (uint8_t i = 0; i < kNumIdBuckets; ++i) {
+    if (g_tx.byId[i] == 0 && g_rx.byId[i] == 0) {
+      continue;
+    }
+    out.printf("  %-12s %10lu / %lu\n", bucketName(i, name, sizeof(name)),
+               static_cast<unsigned long>(g_tx.byId[i]), static_cast<unsigned long>(g_rx.byId[i]));
+  }
+  out.println("by cmd byte (tx / rx):");
+  for (uint16_t c = 0; c < 256; ++c) {
+    if (g_tx.byCmd[c] == 0 && g_rx.byCmd[c] == 0) {
+      continue;
+    }
+    out.printf("  0x%02X %10lu / %lu\n", static_cast<unsigned>(c),
+               static_cast<unsigned long>(g_tx.byCmd[c]), static_cast<unsigned long>(g_rx.byCmd[c]));
+  }
+}
+
+// 清零峰值（累计计数保留）
+void resetPeaks() {
+  g_peakUtilPct = 0.0f;
+}
+
+}  // namespace BusStat
+
+// ============================================================================
+// 请求/应答往返时延（RTT）统计：按电机 × 命令的对数分桶直方图
+// ============================================================================
+// 帧真正写入 FlexCAN 时记 TX 时间（CanTx），应答在 handleCanMessage 中按 CanRx 中断时间戳配对。
+// 每个（电机, 命令）同一时刻只跟踪 1 个未决请求：
+//   - 超时：超过 kTimeoutUs 仍无应答；
+//   - 被覆盖：应答未到前又发了同一请求（上一个视为丢失）；
+//   - 迟到/无主：到达时已无未决请求（超时后才到，或非本机发起）。
+// 桶：4 以下逐 µs，其上每个 2 的幂区间再分 4 档（≈19% 分辨率），上限约 131ms。
+namespace Rtt {
+
+static constexpr uint8_t kMaxMotorId = 8;          // 覆盖双侧 + 膝关节等扩展（注册表本身支持 32）；LatComp 共用
+static_assert(kMaxMotorId <= MOTOR_REGISTRY_MAX_ID, "Rtt motor range exceeds the registry");
+static constexpr uint8_t kNumCmds = 4;
+static constexpr uint8_t kCmdBytes[kNumCmds] = {CMD_READ_MULTI_ANGLE, CMD_READ_STATUS1, CMD_READ_STATUS2, CMD_TORQUE_CTRL};
+static constexpr uint8_t kNumBuckets = 64;
+static constexpr uint32_t kTimeoutUs = 20000;
+
+struct Stat {
+  uint32_t buckets[kNumBuckets];
+  uint32_t count;
+  uint32_t minUs;
+  uint32_t maxUs;
+  uint32_t timeouts;
+  uint32_t superseded;
+  uint32_t unmatched;
+  uint32_t pendingTxUs;
+  bool pending;
+};
+
+static Stat g_stat[kMaxMotorId + 1][kNumCmds];
+
+static int8_t cmdSlot(uint8_t cmd) {
+  for (uint8_t i = 0; i < kNumCmds; ++i) {
+    if (kCmdBytes[i] == cmd) {
+      return static_cast<int8_t>(i);
+    }
+  }
+  return -1;
+}
+
+static Stat *statFor(uint8_t motorId, uint8_t cmd) {
+  int8_t slot = cmdSlot(cmd);
+  if (motorId == 0 || motorId > kMaxMotorId || slot < 0) {
+    return nullptr;
+  }
+  return &g_stat[motorId][slot];
+}
+
+static uint8_t bucketOf(uint32_t us) {
+  if (us < 4) {
+    return static_cast<uint8_t>(us);
+  }
+  uint8_t msb = static_cast<uint8_t>(31 - __builtin_clz(us));
+  uint32_t idx = (msb - 1u) * 4u + ((us >> (msb - 2)) & 3u);
+  return static_cast<uint8_t>(idx < kNumBuckets ? idx : kNumBuckets - 1);
+}
+
+static uint32_t bucketLowUs(uint8_t idx) {
+  if (idx < 4) {
+    return idx;
+  }
+  uint8_t msb = idx / 4 + 1;
+  return (4u + (idx & 3u)) << (msb - 2);
+}
+
+// 帧已写入 FlexCAN（loop 上下文）
+void onTx(uint8_t motorId, uint8_t cmd, uint32_t txUs) {
+  Stat *st = statFor(motorId, cmd);
+  if (st == nullptr) {
+    return;
+  }
+  if (st->pending) {
+    st->superseded++;
+  }
+  st->pending = true;
+  st->pendingTxUs = txUs;
+}
+
+// 应答已分发（loop 上下文，rxUs 为 CanRx 中断时间戳）
+void onRx(uint8_t motorId, uint8_t cmd, uint32_t rxUs) {
+  Stat *st = statFor(motorId, cmd);
+  if (st == nullptr) {
+    return;
+  }
+  if (!st->pending) {
+    st->unmatched++;
+    return;
+  }
+  st->pending = false;
+  uint32_t us = rxUs - st->pendingTxUs;
+  if (us > 0x80000000u) {
+    us = 0;  // 应答中断时间戳早于 TX 记录（同一微秒内），按 0 计
+  }
+  st->buckets[bucketOf(us)]++;
+  if (st->count == 0 || us < st->minUs) st->minUs = us;
+  if (us > st->maxUs) st->maxUs = us;
+  st->count++;
+}
+
+// loop 中调用：未决请求超时判定
+void tick(uint32_t nowUs) {
+  for (uint8_t id = 1; id <= kMaxMotorId; ++id) {
+    for (uint8_t c = 0; c < kNumCmds; ++c) {
+      Stat &st = g_stat[id][c];
+      if (st.pending && (uint32_t)(nowUs - st.pendingTxUs) > kTimeoutUs) {
+        st.pending = false;
+        st.timeouts++;
+      }
+    }
+  }
+}
+
+// 百分位（取所在桶上界，并夹在 [min, max] 内）
+uint32_t percentileUs(const Stat &st, float p) {
+  if (st.count == 0) {
+    return 0;
+  }
+  uint32_t target = static_cast<uint32_t>(p * st.count);
+  if (target >= st.count) target = st.count - 1;
+  uint32_t cum = 0;
+  for (uint8_t i = 0; i < kNumBuckets; ++i) {
+    cum += st.buckets[i];
+    if (cum > target) {
+      uint32_t hi = (i + 1 < kNumBuckets) ? bucketLowUs(i + 1) - 1 : st.maxUs;
+      if (hi > st.maxUs) hi = st.maxUs;
+      if (hi < st.minUs) hi = st.minUs;
+      return hi;
+    }
+  }
+  return st.maxUs;
+}
+
+// 累计应答数 / 丢失数（超时 + 被覆盖），供轮询调度按窗口求差
+void totals(uint8_t motorId, uint8_t cmd, uint32_t &replies, uint32_t &lost) {
+  const Stat *st = statFor(motorId, cmd);
+  replies = st ? st->count : 0;
+  lost = st ? st->timeouts + st->superseded : 0;
+}
+
+// 查询最近统计（供调度器等使用）；无样本返回 false
+bool summary(uint8_t motorId, uint8_t cmd, uint32_t &p50Us, uint32_t &p99Us) {
+  const Stat *st = statFor(motorId, cmd);
+  if (st == nullptr || st->count == 0) {
+    return false;
+  }
+  p50Us = percentileUs(*st, 0.50f);
+  p99Us = percentileUs(*st, 0.99f);
+  return true;
+}
+
+void printReport(Print &out, bool withHistogram) {
+  out.println("=== CAN request/response RTT (us, wire TX -> RX ISR) ===");
+  for (uint8_t id = 1; id <= kMaxMotorId; ++id) {
+    for (uint8_t c = 0; c < kNumCmds; ++c) {
+      const Stat &st = g_stat[id][c];
+      if (st.count == 0 && st.timeouts == 0 && st.superseded == 0 && st.unmatched == 0) {
+        continue;
+      }
+      out.printf("ID%u 0x%02X: n=%lu min=%lu p50=%lu p99=%lu max=%lu timeout=%lu lost=%lu late=%lu\n",
+                 static_cast<unsigned>(id), static_cast<unsigned>(kCmdBytes[c]),
+                 static_cast<unsigned long>(st.count), static_cast<unsigned long>(st.minUs),
+                 static_cast<unsigned long>(percentileUs(st, 0.50f)),
+                 static_cast<unsigned long>(percentileUs(st, 0.99f)),
+                 static_cast<unsigned long>(st.maxUs), static_cast<unsigned long>(st.timeouts),
+                 static_cast<unsigned long>(st.timeouts + st.superseded),
+                 static_cast<unsigned long>(st.unmatched));
+      if (withHistogram) {
+        for (uint8_t i = 0; i < kNumBuckets; ++i) {
+          if (st.buckets[i] != 0) {
+            out.printf("    [%lu, %lu) %lu\n", static_cast<unsigned long>(bucketLowUs(i)),
+                       static_cast<unsigned long>(i + 1 < kNumBuckets ? bucketLowUs(i + 1) : 0xFFFFFFFFu),
+                       static_cast<unsigned long>(st.buckets[i]));
+          }
+        }
+      }
+    }
+  }
+}
+
+void reset() {
+  memset(g_stat, 0, sizeof(g_stat));
+}
+
+}  // namespace Rtt
+
+// ============================================================================
+// 传输时延补偿：测量「角度样本 → 转矩帧写入 FlexCAN」各路径时延，把关节状态外推到预计出力时刻
+// ============================================================================
+// 时延链：0x92/0xA1 应答 RX 打点（sampleUs）→ 估计/相位 → 控制帧（frameUs）→ A1 单发或 0x280 广播写入
+// FlexCAN（txUs，可能在 CanTx 队列中等保护窗）→ 驱动器收到并建立电流。
+// - 控制帧登记本帧所用样本时间（noteFrame），转矩帧真正写出时配对（onTorqueTx），按电机 × 路径
+//   统计 frame→TX 与 sample→TX（EMA + 最大值）
+// - 外推量 lead = (frameUs - 样本时间) + 该关节最近所走路径的 frame→TX EMA + 驱动端固定时延 driverUs，
+//   上限 maxLeadUs；lat off 时 lead = 0（控制律直接使用测量值，与补偿前一致）
+namespace LatComp {
+
+enum Path : uint8_t { PATH_SINGLE = 0, PATH_BCAST, PATH_COUNT };
+static const char *const kPathNames[PATH_COUNT] = {"single", "bcast"};
+
+static constexpr uint8_t kMaxMotorId = Rtt::kMaxMotorId;  // 与 RTT 统计共用逐电机上限
+static constexpr float kEmaAlpha = 1.0f / 16.0f;
+static constexpr uint32_t kPendingMaxUs = 50000;   // 登记后超过此时长才写出的转矩帧不参与统计（手动测试帧等）
+
+struct PathStat {
+  float frameToTxUs;     // 控制帧 → 写出（EMA）
+  float sampleToTxUs;    // 样本 RX → 写出（EMA）
+  uint32_t maxSampleToTxUs;
+  uint32_t count;
+};
+
+struct Joint {
+  PathStat path[PATH_COUNT];
+  Path lastPath;
+  bool pending;
+  uint32_t pendingSampleUs;
+  uint32_t pendingFrameUs;
+  uint32_t lastLeadUs;   // 最近一次给出的外推量
+};
+
+static Joint g_joint[kMaxMotorId + 1];
+static bool g_enabled = true;
+static uint32_t g_driverUs = 1000;   // A1 帧传输 + 驱动电流环建立（经验值，可用 lat drv 调整）
+static uint32_t g_maxLeadUs = 40000;
+
+static Joint *jointFor(uint8_t motorId) {
+  return (motorId == 0 || motorId > kMaxMotorId) ? nullptr : &g_joint[motorId];
+}
+
+// 控制帧登记本帧所用样本（同一关节未写出的旧登记被覆盖，例如单发降频时）
+void noteFrame(uint8_t motorId, uint32_t sampleUs, uint32_t frameUs) {
+  Joint *j = jointFor(motorId);
+  if (j == nullptr) {
+    return;
+  }
+  j->pending = true;
+  j->pendingSampleUs = sampleUs;
+  j->pendingFrameUs = frameUs;
+}
+
+// 转矩帧已写入 FlexCAN（CanTx 内调用，loop 上下文）
+void onTorqueTx(uint8_t motorId, uint32_t txUs, Path path) {
+  Joint *j = jointFor(motorId);
+  if (j == nullptr || !j->pending) {
+    return;
+  }
+  j->pending = false;
+  const uint32_t frameToTx = txUs - j->pendingFrameUs;
+  if (frameToTx > kPendingMaxUs) {
+    return;
+  }
+  const uint32_t sampleToTx = txUs - j->pendingSampleUs;
+  PathStat &ps = j->path[path];
+  if (ps.count == 0) {
+    ps.frameToTxUs = static_cast<float>(frameToTx);
+    ps.sampleToTxUs = static_cast<float>(sampleToTx);
+  } else {
+    ps.frameToTxUs += kEmaAlpha * (static_cast<float>(frameToTx) - ps.frameToTxUs);
+    ps.sampleToTxUs += kEmaAlpha * (static_cast<float>(sampleToTx) - ps.sampleToTxUs);
+  }
+  if (sampleToTx > ps.maxSampleToTxUs) ps.maxSampleToTxUs = sampleToTx;
+  ps.count++;
+  j->lastPath = path;
+}
+
+// 样本时间 sampleUs 到预计出力时刻的外推量（µs）；关闭时为 0
+uint32_t leadUs(uint8_t motorId, uint32_t sampleUs, uint32_t frameUs) {
+  Joint *j = jointFor(motorId);
+  if (!g_enabled || j == nullptr) {
+    return 0;
+  }
+  uint32_t lead = frameUs - sampleUs;
+  if (lead > g_maxLeadUs) {
+    lead = g_maxLeadUs;  // 样本过旧（或时间戳晚于帧开始）：按上限处理
+  }
+  const PathStat &ps = j->path[j->lastPath];
+  if (ps.count > 0) {
+    lead += static_cast<uint32_t>(ps.frameToTxUs);
+  }
+  lead += g_driverUs;
+  if (lead > g_maxLeadUs) lead = g_maxLeadUs;
+  j->lastLeadUs = lead;
+  return lead;
+}
+
+bool enabled() { return g_enabled; }
+void setEnabled(bool on) { g_enabled = on; }
+void setDriverUs(uint32_t us) { g_driverUs = us; }
+void setMaxLeadUs(uint32_t us) { g_maxLeadUs = us; }
+
+void reset() {
+  memset(g_joint, 0, sizeof(g_joint));
+}
+
+void printStatus(Print &out) {
+  out.printf("latcomp %s driver=%luus max=%luus\n", g_enabled ? "ON" : "OFF",
+             static_cast<unsigned long>(g_driverUs), static_cast<unsigned long>(g_maxLeadUs));
+  for (uint8_t id = 1; id <= kMaxMotorId; ++id) {
+    const Joint &j = g_joint[id];
+    const MotorConfig *cfg = motorRegistry[id].config;
+    bool any = false;
+    for (uint8_t p = 0; p < PATH_COUNT; ++p) {
+      any = any || j.path[p].count > 0;
+    }
+    if (cfg == nullptr && !any) {
+      continue;
+    }
+    out.printf("  %s(id%u): lead=%luus via %s\n", cfg ? cfg->name : "?", id,
+               static_cast<unsigned long>(j.lastLeadUs), kPathNames[j.lastPath]);
+    for (uint8_t p = 0; p < PATH_COUNT; ++p) {
+      const PathStat &ps = j.path[p];
+      if (ps.count == 0) {
+        continue;
+      }
+      out.printf("    %-6s n=%lu frame->tx %.0fus sample->tx %.0fus (max %lu)\n", kPathNames[p],
+                 static_cast<unsigned long>(ps.count), ps.frameToTxUs, ps.sampleToTxUs,
+                 static_cast<unsigned long>(ps.maxSampleToTxUs));
+    }
+  }
+}
+
+}  // namespace LatComp
+
+// ============================================================================
+// CAN 发送调度（每电机 ID 一条按优先级出队的待发队列，按 0.25ms 保护窗时隙释放）
+// ============================================================================
+// 协议要求同一控制器 ID 的相邻帧间隔 > 0.25ms。原实现在 sendCanCommand 内
+// delayMicroseconds 忙等，连续两帧发往同一电机时整个 loop（含 RX drain）被卡住。
+// 现改为：调用方只入队并立即返回；service() 在 loop / 统一周期中被频繁调用，
+// 对保护窗已到期的电机释放一帧。不在定时器 ISR 中释放，保持“ISR 不碰 CAN”的约定。
+//
+// 优先级（数值越小越先发）：
+//   SAFETY  0x80 关闭 / 0x81 停止 —— 永不排在查询之后；入队时撤销该电机未发的全部非查询帧
+//           （转矩/位置/0x88 运行/0x9B 清错/诊断写入，含广播），停止之前入队的帧不会在其后发出
+//   CONTROL 0xA1 转矩 / 0xA3 0xA4 位置 / 0x88 运行 / 0x9B 清错 —— 同电机同命令未发帧由新帧原位替换
+//   QUERY   0x92 / 0x9A / 0x9C / 0x9D —— 同电机同命令已在队列中则合并（丢弃新帧）
+//   DIAG    其余
+// 队列满时：新帧优先级高于队中最低优先级帧 → 挤掉最低级中最旧的一帧；否则丢弃新帧。均记入 FwLog。
+//
+// 硬件邮箱：FlexCAN_T4 的 write(msg) 在 TX 邮箱全忙时把帧放进软件 TX 环（严格 FIFO），
+// 拥塞时停止帧/最新 iq 会排在旧查询之后，上面的优先级失效。因此只用 write(mb, msg) 写空闲邮箱，
+// 全忙时帧留在本模块队列，下次 service() 再试；第一个 TX 邮箱保留给 SAFETY 帧。
+namespace CanTx {
+
+static constexpr uint32_t kGuardUs = 350;     // 同一控制器帧间隔（协议 250µs，沿用原 350µs 裕量）
+static constexpr uint8_t kMaxMotorId = 32;    // 协议 ID 范围 1~32
+static constexpr uint8_t kQueueDepth = 8;     // 每电机待发深度（正常每周期 ≤3 帧）
+
+enum Prio : uint8_t { PRIO_SAFETY = 0, PRIO_CONTROL = 1, PRIO_QUERY = 2, PRIO_DIAG = 3, PRIO_COUNT = 4 };
+
+static Prio prioOf(uint8_t cmd) {
+  switch (cmd) {
+    case CMD_MOTOR_CLOSE:
+    case CMD_MOTOR_STOP:
+      return PRIO_SAFETY;
+    case CMD_TORQUE_CTRL:
+    case CMD_POSITION_CTRL1:
+    case CMD_POSITION_CTRL2:
+    case CMD_MOTOR_RUN:
+    case CMD_CLEAR_ERROR:
+      return PRIO_CONTROL;
+    case CMD_READ_MULTI_ANGLE:
+    case CMD_READ_STATUS1:
+    case CMD_READ_STATUS2:
+    case CMD_READ_STATUS3:
+      return PRIO_QUERY;
+    default:
+      return PRIO_DIAG;
+  }
+}
+
+// 停止/关闭入队时撤销的帧：查询以外的一切（出力、运行、清错、诊断写入），
+// 否则停止之前排队的 0x88 等会在 SAFETY 帧之后发出，急停后把电机重新使能
+static bool cancelledByStop(Prio prio) {
+  return prio == PRIO_CONTROL || prio == PRIO_DIAG;
+}
+
+struct Slot {
+  CAN_message_t msg;
+  uint32_t seq;        // 入队序号（同优先级内先进先出）
+  Prio prio;
+  bool used;
+};
+
+struct MotorQueue {
+  Slot slots[kQueueDepth];
+  uint8_t count;       // 待发帧数
+  uint32_t lastTxUs;   // 上次真正写入 FlexCAN 的时间
+  bool everSent;       // 是否发过帧（lastTxUs 有效）
+};
+
+static MotorQueue g_q[kMaxMotorId + 1];
+static uint16_t g_pendingTotal = 0;    // 全部队列待发总数
+static uint16_t g_pendingHighWater = 0;
+static uint32_t g_seq = 0;
+static uint32_t g_dropped[PRIO_COUNT] = {};    // 队列满被丢弃/挤出
+static uint32_t g_coalesced[PRIO_COUNT] = {};  // 被同类新帧替换或合并
+static uint32_t g_cancelled = 0;               // 停止命令撤销的非查询帧
+static uint8_t g_mbTxFirst = 0;                // TX 邮箱 [first, end)，first 保留给 SAFETY（CanRx::begin 设置）
+static uint8_t g_mbTxEnd = 0;
+static uint32_t g_mbBusy = 0;                  // 可用邮箱全忙、帧留队重试的次数
+
+// 由 CanRx::begin 在分配完 RX 邮箱后调用；此前所有帧留在队列中
+void setTxMailboxes(uint8_t first, uint8_t end) {
+  g_mbTxFirst = first;
+  g_mbTxEnd = end;
+}
+
+// 写入一个空闲硬件 TX 邮箱（邮箱仍在发送时 write(mb, msg) 返回 0）；全忙返回 false
+static bool writeMailbox(const CAN_message_t& msg, Prio prio) {
+  uint8_t mb = (prio == PRIO_SAFETY) ? g_mbTxFirst : static_cast<uint8_t>(g_mbTxFirst + 1);
+  for (; mb < g_mbTxEnd; ++mb) {
+    if (can1.write(static_cast<FLEXCAN_MAILBOX>(mb), msg)) {
+      return true;
+    }
+  }
+  g_mbBusy++;
+  return false;
+}
+
+static bool guardExpired(const MotorQueue& q, uint32_t nowUs) {
+  return !q.everSent || (uint32_t)(nowUs - q.lastTxUs) >= kGuardUs;
+}
+
+// 真正写入 FlexCAN 硬件邮箱；邮箱全忙返回 false（帧由调用方留在队列中，保护窗不受影响）
+static bool writeNow(uint8_t motorId, MotorQueue& q, const CAN_message_t& msg, Prio prio, uint32_t nowUs) {
+  if (!writeMailbox(msg, prio)) {
+    return false;
+  }
+  q.lastTxUs = nowUs;
+  q.everSent = true;
+  BusStat::onTx(msg);
+  Rtt::onTx(motorId, msg.buf[0], nowUs);
+  if (msg.buf[0] == CMD_TORQUE_CTRL) {
+    LatComp::onTorqueTx(motorId, nowUs, LatComp::PATH_SINGLE);
+  }
+  return true;
+}
+
+static void removeSlot(MotorQueue& q, uint8_t i) {
+  q.slots[i].used = false;
+  q.count--;
+  g_pendingTotal--;
+}
+
+// 队中优先级最高（同级最旧）的槽位；maxPrio 限定只看不低于该级的帧；无则 -1
+static int8_t bestSlot(const MotorQueue& q, Prio maxPrio) {
+  int8_t best = -1;
+  for (uint8_t i = 0; i < kQueueDepth; ++i) {
+    const Slot& sl = q.slots[i];
+    if (!sl.used || sl.prio > maxPrio) {
+      continue;
+    }
+    if (best < 0 || sl.prio < q.slots[best].prio ||
+        (sl.prio == q.slots[best].prio && (int32_t)(sl.seq - q.slots[best].seq) < 0)) {
+      best = static_cast<int8_t>(i);
+    }
+  }
+  return best;
+}
+
+// 队中优先级最低（同级最旧）的槽位
+static int8_t worstSlot(const MotorQueue& q) {
+  int8_t worst = -1;
+  for (uint8_t i = 0; i < kQueueDepth; ++i) {
+    const Slot& sl = q.slots[i];
+    if (!sl.used) {
+      continue;
+    }
+    if (worst < 0 || sl.prio > q.slots[worst].prio ||
+        (sl.prio == q.slots[worst].prio && (int32_t)(sl.seq - q.slots[worst].seq) < 0)) {
+      worst = static_cast<int8_t>(i);
+    }
+  }
+  return worst;
+}
+
+// 多电机广播帧（0x280）：一帧同时发往 ID 1~4，须等所覆盖电机的保护窗全部到期。
+// 只保留最新一帧（转矩指令新值覆盖旧值），由 service() 在 SAFETY 帧之后、单电机队列之前释放。
+static constexpr uint8_t kBroadcastMaxId = 4;
+static_assert(kBroadcastMaxId <= LatComp::kMaxMotorId, "LatComp must cover every broadcast motor");
+static CAN_message_t g_bcastFrame;
+static uint8_t g_bcastMask = 0;        // bit(id-1) = 该帧覆盖电机 id
+static bool g_bcastPending = false;
+static uint32_t g_bcastReplaced = 0;   // 未发出即被新帧覆盖的次数
+
+static bool broadcastCovers(uint8_t motorId) {
+  return g_bcastPending && motorId >= 1 && motorId <= kBroadcastMaxId &&
+         (g_bcastMask & (1u << (motorId - 1)));
+}
+
+static bool broadcastGuardsExpired(uint8_t mask, uint32_t nowUs) {
+  for (uint8_t id = 1; id <= kBroadcastMaxId; ++id) {
+    if ((mask & (1u << (id - 1))) && !guardExpired(g_q[id], nowUs)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// 邮箱全忙返回 false（调用方保留待发广播）
+static bool writeBroadcastNow(const CAN_message_t& msg, uint8_t mask, uint32_t nowUs) {
+  if (!writeMailbox(msg, PRIO_CONTROL)) {
+    return false;
+  }
+  BusStat::onTx(msg);
+  for (uint8_t id = 1; id <= kBroadcastMaxId; ++id) {
+    if (mask & (1u << (id - 1))) {
+      g_q[id].lastTxUs = nowUs;
+      g_q[id].everSent = true;
+      Rtt::onTx(id, CMD_TORQUE_CTRL, nowUs);
+      LatComp::onTorqueTx(id, nowUs, LatComp::PATH_BCAST);
+    }
+  }
+  return true;
+}
+
+// 广播帧入队；mask 为所覆盖电机位图（bit0 = ID 1）
+// 所覆盖电机队中未发的单电机 A1 比本帧旧，一并撤销，避免旧 iq 在新 iq 之后发出
+bool enqueueBroadcast(const CAN_message_t& msg, uint8_t mask) {
+  for (uint8_t id = 1; id <= kBroadcastMaxId; ++id) {
+    if (!(mask & (1u << (id - 1)))) {
+      continue;
+    }
+    MotorQueue& q = g_q[id];
+    for (uint8_t i = 0; i < kQueueDepth; ++i) {
+      if (q.slots[i].used && q.slots[i].msg.buf[0] == CMD_TORQUE_CTRL) {
+        removeSlot(q, i);
+        g_coalesced[PRIO_CONTROL]++;
+      }
+    }
+  }
+  uint32_t nowUs = micros();
+  if (!g_bcastPending && broadcastGuardsExpired(mask, nowUs) && writeBroadcastNow(msg, mask, nowUs)) {
+    return true;
+  }
+  if (g_bcastPending) {
+    g_bcastReplaced++;
+  }
+  g_bcastFrame = msg;
+  g_bcastMask = mask;
+  g_bcastPending = true;
+  return true;
+}
+
+uint32_t broadcastReplacedCount() {
+  return g_bcastReplaced;
+}
+
+// 入队；保护窗空闲、队中没有同级或更高优先级帧且有空闲邮箱时直接写出（与原同步路径时延一致）
+// 返回 false：电机 ID 越界或被丢弃（队列满且优先级不够）；合并到已有帧视为成功
+bool enqueue(uint8_t motorId, const CAN_message_t& msg) {
+  if (motorId == 0 || motorId > kMaxMotorId) {
+    return false;
+  }
+  MotorQueue& q = g_q[motorId];
+  const uint8_t cmd = msg.buf[0];
+  const Prio prio = prioOf(cmd);
+
+  if (prio == PRIO_SAFETY) {
+    // 停止/关闭：撤销该电机所有未发的非查询帧，广播帧覆盖该电机时整帧撤销
+    for (uint8_t i = 0; i < kQueueDepth; ++i) {
+      if (q.slots[i].used && cancelledByStop(q.slots[i].prio)) {
+        removeSlot(q, i);
+        g_cancelled++;
+      }
+    }
+    if (broadcastCovers(motorId)) {
+      g_bcastPending = false;
+      g_cancelled++;
+    }
+  } else if (cmd == CMD_TORQUE_CTRL && broadcastCovers(motorId)) {
+    // 单发 A1 比待发广播新：撤销广播（其余电机下一周期由新广播补上）
+    g_bcastPending = false;
+    g_coalesced[PRIO_CONTROL]++;
+  }
+
+  // 同电机同命令：出力类原位替换为新值，查询类合并
+  if (prio == PRIO_CONTROL || prio == PRIO_QUERY) {
+    for (uint8_t i = 0; i < kQueueDepth; ++i) {
+      Slot& sl = q.slots[i];
+      if (sl.used && sl.msg.buf[0] == cmd) {
+        if (prio == PRIO_CONTROL) {
+          sl.msg = msg;
+        }
+        g_coalesced[prio]++;
+        return true;
+      }
+    }
+  }
+
+  uint32_t nowUs = micros();
+  if (guardExpired(q, nowUs) && bestSlot(q, prio) < 0 && writeNow(motorId, q, msg, prio, nowUs)) {
+    return true;
+  }
+
+  if (q.count >= kQueueDepth) {
+    int8_t w = worstSlot(q);
+    if (w < 0 || q.slots[w].prio <= prio) {
+      g_dropped[prio]++;
+      FwLog::appendCanTxFail(motorId, cmd);
+      return false;
+    }
+    g_dropped[q.slots[w].prio]++;
+    FwLog::appendCanTxFail(motorId, q.slots[w].msg.buf[0]);
+    removeSlot(q, static_cast<uint8_t>(w));
+  }
+  for (uint8_t i = 0; i < kQueueDepth; ++i) {
+    Slot& sl = q.slots[i];
+    if (!sl.used) {
+      sl.msg = msg;
+      sl.seq = g_seq++;
+      sl.prio = prio;
+      sl.used = true;
+      break;
+    }
+  }
+  q.count++;
+  g_pendingTotal++;
+  if (g_pendingTotal > g_pendingHighWater) {
+    g_pendingHighWater = g_pendingTotal;
+  }
+  return true;
+}
+
+// 释放保护窗已到期电机的最高优先级帧（每电机每次最多 1 帧）；maxPrio 限定本轮可发的最低优先级
+static void serviceQueues(Prio maxPrio) {
+  for (uint8_t id = 1; id <= kMaxMotorId; ++id) {
+    MotorQueue& q = g_q[id];
+    if (q.count == 0) {
+      continue;
+    }
+    uint32_t nowUs = micros();
+    if (!guardExpired(q, nowUs)) {
+      continue;
+    }
+    int8_t i = bestSlot(q, maxPrio);
+    if (i < 0) {
+      continue;
+    }
+    if (!writeNow(id, q, q.slots[i].msg, q.slots[i].prio, nowUs)) {
+      return;  // 邮箱全忙：留队，下次 service() 再试
+    }
+    removeSlot(q, static_cast<uint8_t>(i));
+  }
+}
+
+// 释放顺序：SAFETY 帧 → 广播转矩 → 其余按优先级
+void service() {
+  PROF_ZONE(ZONE_CAN_TX_SERVICE);
+  if (g_pendingTotal > 0) {
+    serviceQueues(PRIO_SAFETY);
+  }
+  if (g_bcastPending) {
+    uint32_t nowUs = micros();
+    if (broadcastGuardsExpired(g_bcastMask, nowUs) && writeBroadcastNow(g_bcastFrame, g_bcastMask, nowUs)) {
+      g_bcastPending = false;
+    }
+  }
+  if (g_pendingTotal > 0) {
+    serviceQueues(PRIO_DIAG);
+  }
+}
+
+uint16_t pendingTotal() {
+  return g_pendingTotal;
 }
 
-// 协议单位转换为角度（deg）
-// 方向系数统一处理：协议单位 / unitsPerDeg * dir -> 逻辑角
-float unitsToAngleDeg(const MotorConfig &m, int64_t units) {
-  // 协议单位转换为逻辑角：logicalDeg = (units / unitsPerDeg) * dir
-  // 方向系数 dir 统一处理角度方向
-  return static_cast<float>(units) * m.dir / m.unitsPerDeg;
+uint32_t droppedTotal() {
+  uint32_t n = 0;
+  for (uint8_t p = 0; p < PRIO_COUNT; ++p) {
+    n += g_dropped[p];
+  }
+  return n;
 }
 
-// 关节速度（deg/s）转换为电机轴速度（dps）
-// 根据减速比：关节速度 * 减速比 = 电机轴速度
-// 髋关节减速比 1:36，踝关节减速比 1:10
-uint16_t jointSpeedToMotorSpeed(const MotorConfig &m, float jointSpeedDps) {
-  // 减速比 = unitsPerDeg / 100（因为1关节度 = unitsPerDeg协议单位，而1协议单位 = 0.01电机轴度）
-  // 所以减速比 = unitsPerDeg / 100
-  float reductionRatio = m.unitsPerDeg / 100.0f;
-  float motorSpeedDps = jointSpeedDps * reductionRatio;
-  
-  // 转换为uint16_t，并限制在合理范围内
-  if (motorSpeedDps < 0.0f) motorSpeedDps = 0.0f;
-  if (motorSpeedDps > 10000.0f) motorSpeedDps = 10000.0f;  // 上限保护
-  
-  return static_cast<uint16_t>(motorSpeedDps);
+uint16_t pendingHighWater() {
+  return g_pendingHighWater;
 }
 
-// ============================================================================
-// CAN 通信函数（根据协议文档实现）
-// ============================================================================
+void printStatus(Print &out) {
+  static const char *const kNames[PRIO_COUNT] = {"safety", "control", "query", "diag"};
+  out.printf("CAN TX queue: pending=%u high_water=%u bcast_pending=%d bcast_replaced=%lu cancelled_by_stop=%lu\n",
+             static_cast<unsigned>(g_pendingTotal), static_cast<unsigned>(g_pendingHighWater),
+             g_bcastPending ? 1 : 0, static_cast<unsigned long>(g_bcastReplaced),
+             static_cast<unsigned long>(g_cancelled));
+  out.printf("  TX mailboxes MB%u (safety) + MB%u..MB%u, all-busy retries=%lu\n",
+             static_cast<unsigned>(g_mbTxFirst), static_cast<unsigned>(g_mbTxFirst + 1),
+             static_cast<unsigned>(g_mbTxEnd - 1), static_cast<unsigned long>(g_mbBusy));
+  for (uint8_t p = 0; p < PRIO_COUNT; ++p) {
+    out.printf("  %-8s dropped=%lu coalesced=%lu\n", kNames[p],
+               static_cast<unsigned long>(g_dropped[p]), static_cast<unsigned long>(g_coalesced[p]));
+  }
+}
+
+// 阻塞等待期间持续释放待发帧（命令处理中等待应答时使用，替代裸 delay）
+void serviceFor(uint32_t ms) {
+  uint32_t t0 = millis();
+  do {
+    service();
+  } while (millis() - t0 < ms);
+}
+
+}  // namespace CanTx
 
 // 发送 CAN 命令帧（通用函数）
 // 协议格式：DATA[0] = 命令字节，DATA[1-7] = 命令数据（小端序）
 // printDebug: 是否打印TX调试信息（查询类命令通常设为false）
+// 返回：true=已写出或已进入该电机的待发队列，false=队列满/写失败
 bool sendCanCommand(uint8_t motorId, uint8_t cmd, const uint8_t *data = nullptr, uint8_t dataLen = 0, bool printDebug = false) {
   CAN_message_t msg;
   msg.id = CAN_CMD_BASE_ID + motorId;  // 0x140 + 电机ID
   msg.len = 8;
   msg.flags.extended = 0;  // 标准帧
-  
+
   // 清空缓冲区
   memset(msg.buf, 0, 8);
-  
+
   // 字节0：命令字节
   msg.buf[0] = cmd;
-  // CAN总线通信保护：同一个控制器ID发送间隔需大于0.25ms
 
-  // 静态变量用于记录每个motorId上次发送时间
-  static uint32_t lastSendUs[256] = {0}; // 用于微秒级别限制
-
-  uint8_t id = CAN_CMD_BASE_ID + motorId; // 即msg.id，CAN总线控制器ID
-
-  uint32_t nowUs = micros();
-  uint32_t intervalUs = nowUs - lastSendUs[id];
-
-  // 仅对同一控制器做保护（不同控制器不检查）
-  if (lastSendUs[id] != 0 && intervalUs < 350) {
-    // 若距离上次发给同一控制器不到0.25ms（250us），则等待直到足够
-    delayMicroseconds(350 - intervalUs);
-    nowUs = micros();
-  }
-  lastSendUs[id] = nowUs;
-  
   // 字节1-7：命令数据（如果有）
   if (data != nullptr && dataLen > 0) {
     uint8_t copyLen = (dataLen > 7) ? 7 : dataLen;
     memcpy(&msg.buf[1], data, copyLen);
   }
-  
-  // 尝试发送 CAN 消息，如果发送队列满则返回 false
-  if (can1.write(msg)) {
+
+  // CAN总线通信保护（同一控制器 ID 间隔 > 0.25ms）由 CanTx 调度器负责，这里不再忙等
+  if (CanTx::enqueue(motorId, msg)) {
     if (printDebug && !inIsrContext) {
-      Serial.printf("[TX] Motor %d, CMD=0x%02X, ID=0x%03X, Data: ", motorId, cmd, msg.id);
+      Print &usb = HostOut::replyWriter(HostOut::PORT_USB);
+      usb.printf("[TX] Motor %d, CMD=0x%02X, ID=0x%03X, Data: ", motorId, cmd, msg.id);
       for (int i = 0; i < 8; i++) {
-        Serial.printf("%02X ", msg.buf[i]);
+        usb.printf("%02X ", msg.buf[i]);
       }
-      Serial.println();
+      usb.println();
     }
     return true;
-  } else {
-    // 发送失败（通常是发送队列满）：记入环形日志，不在热路径上做串口格式化输出
-    FwLog::appendCanTxFail(motorId, cmd);
-    return false;
   }
+  // 失败已由 CanTx 记入环形日志，不在热路径上做串口格式化输出
+  return false;
 }
 
 // 发送转矩闭环控制命令（CMD_TORQUE_CTRL，协议 0xA1）
@@ -1717,16 +3870,36 @@ bool sendTorqueCommand(const MotorConfig &motor, int16_t iqControl) {
   return sendCanCommand(motor.id, CMD_TORQUE_CTRL, data, 7, false);
 }
 
+// 多电机转矩广播（CAN_BROADCAST_TORQUE_ID = 0x280）
+// 协议：DATA[2*(id-1)] / DATA[2*(id-1)+1] = 电机 id 的 iqControl（int16_t，小端），id = 1~4；
+// 未列出的电机槽位为 0。各电机分别以 0x140+ID、0xA1 应答格式回复（温度/iq/速度/编码器）。
+bool sendBroadcastTorqueCommand(const MotorConfig *const motors[], const int16_t iqControl[], uint8_t count) {
+  CAN_message_t msg;
+  msg.id = CAN_BROADCAST_TORQUE_ID;
+  msg.len = 8;
+  msg.flags.extended = 0;
+  memset(msg.buf, 0, 8);
+
+  uint8_t mask = 0;
+  for (uint8_t i = 0; i < count; ++i) {
+    uint8_t id = motors[i]->id;
+    if (id < 1 || id > 4) {
+      return false;  // 广播帧只覆盖 ID 1~4
+    }
+    msg.buf[2 * (id - 1)]     = (uint8_t)(iqControl[i] & 0xFF);
+    msg.buf[2 * (id - 1) + 1] = (uint8_t)((iqControl[i] >> 8) & 0xFF);
+    mask |= (uint8_t)(1u << (id - 1));
+  }
+  return CanTx::enqueueBroadcast(msg, mask);
+}
+
 // 使能电机（电机运行命令 0x88）
 void enableMotor(const MotorConfig &motor) {
   if (sendCanCommand(motor.id, CMD_MOTOR_RUN)) {
     hostPrintf(">>> %s motor (ID=%d) ENABLED (CMD=0x88)\n", motor.name, motor.id);
-    if (motor.id == 1) {
-      hipStatus.enabled = true;
-      hipStatus.motorState = 0x00;  // 开启状态
-    } else if (motor.id == 2) {
-      ankleStatus.enabled = true;
-      ankleStatus.motorState = 0x00;  // 开启状态
+    if (MotorRecord *rec = motorRecord(motor.id)) {
+      rec->status->enabled = true;
+      rec->status->motorState = 0x00;  // 开启状态
     }
   }
 }
@@ -1735,12 +3908,9 @@ void enableMotor(const MotorConfig &motor) {
 void disableMotor(const MotorConfig &motor) {
   if (sendCanCommand(motor.id, CMD_MOTOR_CLOSE)) {
     hostPrintf(">>> %s motor (ID=%d) DISABLED (CMD=0x80)\n", motor.name, motor.id);
-    if (motor.id == 1) {
-      hipStatus.enabled = false;
-      hipStatus.motorState = 0x10;  // 关闭状态
-    } else if (motor.id == 2) {
-      ankleStatus.enabled = false;
-      ankleStatus.motorState = 0x10;  // 关闭状态
+    if (MotorRecord *rec = motorRecord(motor.id)) {
+      rec->status->enabled = false;
+      rec->status->motorState = 0x10;  // 关闭状态
     }
   }
 }
@@ -1772,14 +3942,11 @@ void sendPositionCommand(const MotorConfig &motor, float targetDeg) {
   int32_t targetUnits = logicalAngleToUnits(motor, targetDeg);
   
   // 获取当前角度（用于调试）- 使用逻辑角接口
-  float currentDeg;
-  int64_t currentUnits;
-  if (motor.id == 1) {
-    currentDeg = getHipDeg();
-    currentUnits = getHipRawUnits();
-  } else {
-    currentDeg = getAnkleDeg();
-    currentUnits = getAnkleRawUnits();
+  float currentDeg = 0.0f;
+  int64_t currentUnits = 0;
+  if (const MotorRecord *rec = motorRecord(motor.id)) {
+    currentDeg = rec->status->*(rec->logicalDeg);
+    currentUnits = rec->status->raw_units;
   }
   float diffDeg = targetDeg - currentDeg;
   
@@ -1837,198 +4004,392 @@ bool sendPositionCommandWithSpeed(const MotorConfig &motor, float targetDeg, uin
   
 }
 
+// ============================================================================
+// CAN 中断接收：ISR 打时间戳入环形缓冲，loop / 统一周期中由 dispatch() 统一分发
+// ============================================================================
+// 单生产者（FlexCAN RX 中断）/ 单消费者（dispatch，仅在 loop 上下文调用）。
+// 不在 loop 中调用 can1.events()：FlexCAN_T4 此时直接在 ISR 中调用 onReceive 回调，
+// 回调只做拷贝 + micros() 打点，handleCanMessage 仍在 loop 上下文执行。
+// 所有收包路径（控制周期、az/hz/s 等命令）都经同一分发器，命令处理不再“抢走”控制周期的应答帧。
+void handleCanMessage(const CAN_message_t &msg);
+
+namespace CanRx {
+
+static constexpr uint16_t kRingCap = 128;  // 2 的幂；1Mbps 满载约 7.5 帧/ms，足够覆盖 10ms 以上的 loop 停顿
+static_assert((kRingCap & (kRingCap - 1)) == 0, "kRingCap must be a power of two");
+
+struct Frame {
+  CAN_message_t msg;
+  uint32_t rxUs;       // ISR 内 micros() 到达时间
+};
+
+static Frame g_ring[kRingCap];
+static volatile uint16_t g_head = 0;       // 仅 ISR 写
+static volatile uint16_t g_tail = 0;       // 仅 dispatch 写
+static volatile uint32_t g_overflow = 0;   // 环满丢帧计数
+static uint16_t g_highWater = 0;
+static uint32_t g_currentRxUs = 0;         // 正在分发帧的到达时间（供 handleCanMessage 使用）
+
+// ---- 硬件验收滤波：邮箱分配由电机表生成 ----
+// FlexCAN_T4 默认 16 个邮箱：MB0.. 每电机一个应答邮箱（0x140+ID 精确匹配），随后一个 BOARD_CMD_ID，
+// 可选一个 catch-all 邮箱（仅计数外部帧，不入环、不格式化），其余为 TX 邮箱。
+// 未开 catch-all 时外部帧在硬件层直接被拒，软件零开销（也就看不到计数）。
+static constexpr uint8_t kNumMailboxes = 16;
+static constexpr uint8_t kMinTxMailboxes = 4;
+static constexpr bool kCountForeignFrames = true;  // 共享总线排查时保留；追求最低 RX 开销可关
+// 每电机占一个应答邮箱，另留 BOARD_CMD_ID 与 catch-all 各一个：最多 10 台电机。
+// 注册表（MOTOR_REGISTRY_MAX_ID=32）允许登记更多，超出部分在 begin() 报错并记 FwLog，
+// 这些电机的应答会被硬件滤波拒掉 —— 加电机前先调整邮箱分配。
+static constexpr uint8_t kMaxRxMotors = kNumMailboxes - kMinTxMailboxes - 2;
+
+static uint32_t g_motorReplyIds[kMaxRxMotors];
+static uint8_t g_motorReplyCount = 0;
+static int8_t g_mbBoard = -1;
+static int8_t g_mbCatchAll = -1;
+static volatile uint32_t g_foreignFrames = 0;  // catch-all 邮箱收到的非本机帧
+static volatile uint32_t g_lastForeignId = 0;
+static uint32_t g_unhandledFrames = 0;          // 通过滤波但 handleCanMessage 未识别（如未知板级子命令）
+
+static bool isOwnId(uint32_t id) {
+  if (id == BOARD_CMD_ID) {
+    return true;
+  }
+  for (uint8_t i = 0; i < g_motorReplyCount; ++i) {
+    if (g_motorReplyIds[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void onReceiveIsr(const CAN_message_t &msg) {
+  BusStat::onRx(msg);  // 总线占用统计含外部帧（catch-all 可见部分）
+  // 专用邮箱忙时本机帧可能落入 catch-all：按 ID 复核后仍入环
+  if (msg.mb == g_mbCatchAll && !isOwnId(msg.id)) {
+    g_foreignFrames++;
+    g_lastForeignId = msg.id;
+    return;
+  }
+  uint16_t head = g_head;
+  if ((uint16_t)(head - g_tail) >= kRingCap) {
+    g_overflow++;
+    return;
+  }
+  Frame &f = g_ring[head & (kRingCap - 1)];
+  f.msg = msg;
+  f.rxUs = micros();
+  std::atomic_signal_fence(std::memory_order_release);
+  g_head = head + 1;
+}
+
+// 按电机表配置 RX 邮箱与验收滤波，并挂接中断接收（须在 can1.begin/setBaudRate 之后调用）
+void begin(const MotorConfig *const motors[], uint8_t count) {
+  if (count > kMaxRxMotors) {
+    hostPrintf("ERROR: CAN RX: %u motors registered but only %u reply mailboxes; motors after %s get no replies\n",
+               static_cast<unsigned>(count), static_cast<unsigned>(kMaxRxMotors), motors[kMaxRxMotors - 1]->name);
+    FwLog::append(FwLog::TAG_CAN_RX_CFG, count, kMaxRxMotors);
+    count = kMaxRxMotors;
+  }
+  g_motorReplyCount = count;
+  uint8_t mb = 0;
+  can1.setMaxMB(kNumMailboxes);
+  for (uint8_t i = 0; i < count; ++i) {
+    g_motorReplyIds[i] = CAN_CMD_BASE_ID + motors[i]->id;
+    can1.setMB(static_cast<FLEXCAN_MAILBOX>(mb++), RX, STD);
+  }
+  g_mbBoard = static_cast<int8_t>(mb);
+  can1.setMB(static_cast<FLEXCAN_MAILBOX>(mb++), RX, STD);
+  if (kCountForeignFrames) {
+    g_mbCatchAll = static_cast<int8_t>(mb);
+    can1.setMB(static_cast<FLEXCAN_MAILBOX>(mb++), RX, STD);
+  }
+  for (uint8_t tx = mb; tx < kNumMailboxes; ++tx) {
+    can1.setMB(static_cast<FLEXCAN_MAILBOX>(tx), TX);
+  }
+  CanTx::setTxMailboxes(mb, kNumMailboxes);
+
+  can1.setMBFilter(REJECT_ALL);
+  can1.onReceive(onReceiveIsr);
+  can1.enableMBInterrupts();
+  for (uint8_t i = 0; i < count; ++i) {
+    can1.setMBFilter(static_cast<FLEXCAN_MAILBOX>(i), g_motorReplyIds[i]);
+  }
+  can1.setMBFilter(static_cast<FLEXCAN_MAILBOX>(g_mbBoard), (uint32_t)BOARD_CMD_ID);
+  if (g_mbCatchAll >= 0) {
+    can1.setMBFilter(static_cast<FLEXCAN_MAILBOX>(g_mbCatchAll), ACCEPT_ALL);
+  }
+}
+
+void noteUnhandled() {
+  g_unhandledFrames++;
+}
+
+// 邮箱分配与滤波计数
+void printStatus(Print &out) {
+  out.println("CAN RX mailboxes (others REJECT_ALL):");
+  for (uint8_t i = 0; i < g_motorReplyCount; ++i) {
+    out.printf("  MB%u <- 0x%03lX (motor reply)\n", static_cast<unsigned>(i), static_cast<unsigned long>(g_motorReplyIds[i]));
+  }
+  out.printf("  MB%d <- 0x%03X (board cmd)\n", g_mbBoard, static_cast<unsigned>(BOARD_CMD_ID));
+  if (g_mbCatchAll >= 0) {
+    out.printf("  MB%d <- ACCEPT_ALL (count only)\n", g_mbCatchAll);
+  }
+  out.printf("foreign=%lu (last id 0x%03lX) unhandled=%lu ring_ovf=%lu ring_hw=%u\n",
+             static_cast<unsigned long>(g_foreignFrames), static_cast<unsigned long>(g_lastForeignId),
+             static_cast<unsigned long>(g_unhandledFrames),
+             static_cast<unsigned long>(g_overflow), static_cast<unsigned>(g_highWater));
+}
+
+// 分发至多 maxFrames 帧；返回实际分发数
+uint16_t dispatch(uint16_t maxFrames = kRingCap) {
+  uint16_t n = 0;
+  while (n < maxFrames) {
+    uint16_t tail = g_tail;
+    uint16_t depth = (uint16_t)(g_head - tail);
+    if (depth == 0) {
+      break;
+    }
+    if (depth > g_highWater) {
+      g_highWater = depth;
+    }
+    std::atomic_signal_fence(std::memory_order_acquire);
+    const Frame &f = g_ring[tail & (kRingCap - 1)];
+    g_currentRxUs = f.rxUs;
+    handleCanMessage(f.msg);
+    g_tail = tail + 1;
+    n++;
+  }
+  return n;
+}
+
+// handleCanMessage 内调用：当前帧的 ISR 到达时间（µs）
+uint32_t currentRxUs() {
+  return g_currentRxUs;
+}
+
+uint32_t overflowCount() {
+  return g_overflow;
+}
+
+uint16_t highWater() {
+  return g_highWater;
+}
+
+}  // namespace CanRx
+
 // ============================================================================
 // CAN 反馈帧处理（根据协议文档实现）
 // ============================================================================
 
-// 处理接收到的 CAN 反馈帧
-// 反馈帧使用相同的 CAN ID（0x140 + ID）
-void handleCanMessage(const CAN_message_t &msg) {
-  // 判断是否为控制指令的回复帧（ID = 0x140 + 电机ID）
-  if (msg.id >= CAN_CMD_BASE_ID && msg.id < CAN_CMD_BASE_ID + 33) {
-    uint8_t motorId = msg.id - CAN_CMD_BASE_ID;
-    MotorStatus *status = nullptr;
-    const MotorConfig *motor = nullptr;
-    
-    if (motorId == 1) {
-      status = &hipStatus;
-      motor = &hipMotor;
-    } else if (motorId == 2) {
-      status = &ankleStatus;
-      motor = &ankleMotor;
+// 关节角样本统一入口：0x92 多圈角应答与编码器展开（0xA1/0x9C）共用
+// angle 为电机多圈角（协议单位 0.01°/LSB）；更新原始角/逻辑角/兼容字段，并调用关节专属处理
+void applyJointAngleUnits(MotorRecord &rec, int64_t angle) {
+  MotorStatus *status = rec.status;
+  // ========== 角度接口层：更新原始角和逻辑角 ==========
+  // 1. 更新原始角（驱动层）
+  status->raw_units = angle;
+  status->raw_deg_motor = static_cast<float>(angle) / 100.0f;  // 协议单位转电机端角度（0.01°/LSB）
+  
+  // 2. 更新逻辑角（上层接口）
+  // 髋：hip_deg = (raw_units - hip_reference_offset) / unitsPerDeg
+  // 踝：已标定时 ankle_deg = (raw_units - ankle_zero_offset) / unitsPerDeg（0 = 90°中立位，背屈为正）；
+  //     未标定时使用原始角度（但这不是真正的解剖角）
+  status->*(rec.logicalDeg) = unitsToAngleDeg(*rec.config, angle - motorCalibOffset(rec));
+  status->*(rec.unusedDeg) = 0.0f;  // 本关节不使用的逻辑角字段
+  
+  // ========== 兼容性字段（向后兼容） ==========
+  status->multiTurnAngle = status->raw_units;
+  status->angleDeg = status->*(rec.logicalDeg);
+  
+  status->lastUpdateMs = millis();
+  status->sampleUs = CanRx::currentRxUs() ? CanRx::currentRxUs() : micros();
+
+  // 角度 RX 打点计数（用于验证 50Hz 采集：串口 ≤10Hz 打印换算频率）
+  if (rec.angleRxCounter != nullptr) {
+    (*rec.angleRxCounter)++;
+  }
+
+  if (rec.onAngleSample != nullptr) {
+    rec.onAngleSample(*status);
+  }
+}
+
+// 髋关节角度样本：更新信号预处理、自适应阈值、步态相位识别和摆动进度
+static void hipAngleSampleHook(MotorStatus &status) {
+  float speedDps = 0.0f;
+  const bool hasSpeed = jointSpeedSample(hipMotor, status, speedDps);
+  updateHipSignalProcessor(status.hip_deg, status.sampleUs, hasSpeed ? &speedDps : nullptr);
+  // 使用滤波后的髋角更新自适应阈值
+  if (hipProcessor.initialized) {
+    updateAdaptiveThreshold(hipProcessor.hip_f);
+    // 更新步态相位识别
+    updateGaitPhaseDetector(status.sampleUs);
+    // 更新摆动相进度计算
+    updateSwingProgress();
+    // 更新踝背屈辅助策略（需要髋关节相位和进度信息）
+    if (ankleStatus.lastUpdateMs > 0 && 
+        (millis() - ankleStatus.lastUpdateMs) < 200) {  // 确保踝关节数据是新鲜的
+      GaitPhase currentPhase = getCurrentGaitPhase();
+      float swing_progress = getSwingProgress();
+      updateAnkleAssistStrategy(getAnkleDeg(), currentPhase, swing_progress);
+      
+      // // 更新顺从控制状态机（需要参考角度、电流、温度、通讯状态）
+      // float theta_ref = getAnkleReferenceAngle();
+      // bool commOk = (millis() - ankleStatus.lastUpdateMs) < COMM_TIMEOUT_MS;
+      // updateComplianceController(getAnkleDeg(), theta_ref, ankleStatus.iq, 
+      //                            ankleStatus.temperature, commOk);
     }
-    
-    if (status != nullptr && motor != nullptr) {
-      uint8_t cmd = msg.buf[0];
+  }
+}
+
+// ---- 电机应答解析表：按命令字节（DATA[0]）索引 ----
+typedef void (*MotorReplyHandler)(MotorRecord &rec, const CAN_message_t &msg);
+static MotorReplyHandler motorReplyHandlers[256] = {};
+
+// 读取多圈角度回复（0x92）
+static void onMultiAngleReply(MotorRecord &rec, const CAN_message_t &msg) {
+  // 多圈角度为 int64_t，单位 0.01°/LSB，小端序
+  // DATA[1-7] = 多圈角度（7字节，int64的低7字节）
+  // 注意：int64_t 是 8 字节，但回复只有 7 字节数据，需要符号扩展最高字节
+  int64_t angle = 0;
+  angle |= ((int64_t)msg.buf[1]);
+  angle |= ((int64_t)msg.buf[2]) << 8;
+  angle |= ((int64_t)msg.buf[3]) << 16;
+  angle |= ((int64_t)msg.buf[4]) << 24;
+  angle |= ((int64_t)msg.buf[5]) << 32;
+  angle |= ((int64_t)msg.buf[6]) << 40;
+  // 符号扩展：如果第7字节（msg.buf[6]）的最高位是1，说明是负数
+  if (msg.buf[6] & 0x80) {
+    // 负数，符号扩展到最高字节
+    angle |= ((int64_t)0xFF) << 48;
+    angle |= ((int64_t)0xFF) << 56;
+  }
+  
+  // 先用 0x92 锚定编码器展开跟踪，再按统一入口更新角度
+  encoderTrackerAnchor(*rec.encTrack, *rec.config, angle, CanRx::currentRxUs());
+  applyJointAngleUnits(rec, angle);
+}
+
+// 读取电机状态1回复（0x9A）
+static void onStatus1Reply(MotorRecord &rec, const CAN_message_t &msg) {
+  MotorStatus *status = rec.status;
+  int8_t temperature = (int8_t)msg.buf[1];
+  uint16_t voltage = msg.buf[2] | (msg.buf[3] << 8);
+  uint16_t current = msg.buf[4] | (msg.buf[5] << 8);
+  uint8_t motorState = msg.buf[6];
+  uint8_t errorState = msg.buf[7];
+  (void)voltage;
+  (void)current;
+  
+  status->temperature = temperature;
+  status->motorState = motorState;
+  status->errorState = errorState;
+  status->enabled = (motorState == 0x00);
+  
+  // if (!inIsrContext) {
+  //   Serial.printf("[RX] %s: temp=%d℃, voltage=%.2fV, current=%.2fA, state=0x%02X, error=0x%02X, ID=0x%03X\n",
+  //                 rec.config->name, temperature, voltage * 0.01f, current * 0.01f, 
+  //                 motorState, errorState, msg.id);
+  // }
+
+  // ====================================================================
+  // 严重错误检测（Emergency Stop）
+  // ====================================================================
+  // 如果电机报告错误（errorState != 0），立即停止所有控制!
+  if (errorState != 0) {
+    if (!isSystemError) {
+      isSystemError = true;
+      errorMotorId = rec.config->id;
+      errorCode = errorState;
+      FwLog::append(FwLog::TAG_ESTOP, rec.config->id, errorState);
       
-      // 根据命令字节解析不同的回复帧
-      if (cmd == CMD_READ_MULTI_ANGLE) {
-        // 读取多圈角度回复（0x92）
-        // 多圈角度为 int64_t，单位 0.01°/LSB，小端序
-        // DATA[1-7] = 多圈角度（7字节，int64的低7字节）
-        // 注意：int64_t 是 8 字节，但回复只有 7 字节数据，需要符号扩展最高字节
-        int64_t angle = 0;
-        angle |= ((int64_t)msg.buf[1]);
-        angle |= ((int64_t)msg.buf[2]) << 8;
-        angle |= ((int64_t)msg.buf[3]) << 16;
-        angle |= ((int64_t)msg.buf[4]) << 24;
-        angle |= ((int64_t)msg.buf[5]) << 32;
-        angle |= ((int64_t)msg.buf[6]) << 40;
-        // 符号扩展：如果第7字节（msg.buf[6]）的最高位是1，说明是负数
-        if (msg.buf[6] & 0x80) {
-          // 负数，符号扩展到最高字节
-          angle |= ((int64_t)0xFF) << 48;
-          angle |= ((int64_t)0xFF) << 56;
-        }
-        
-        // ========== 角度接口层：更新原始角和逻辑角 ==========
-        // 1. 更新原始角（驱动层）
-        status->raw_units = angle;
-        status->raw_deg_motor = static_cast<float>(angle) / 100.0f;  // 协议单位转电机端角度（0.01°/LSB）
-        
-        // 2. 更新逻辑角（上层接口）
-        if (motor->id == 1) {
-          // 髋关节：计算髋逻辑角
-          // hip_deg = (raw_units - hip_reference_offset) / unitsPerDeg
-          int64_t offsetAngle = angle - hip_reference_offset;
-          status->hip_deg = unitsToAngleDeg(*motor, offsetAngle);
-          status->ankle_deg = 0.0f;  // 髋关节不使用此字段
-        } else if (motor->id == 2) {
-          // 踝关节：计算踝解剖角
-          if (ankle_zero_calibrated) {
-            // 已标定：ankle_deg = (raw_units - ankle_zero_offset) / unitsPerDeg
-            // 0 = 90°中立位，背屈为正
-            int64_t offsetAngle = angle - ankle_zero_offset;
-            status->ankle_deg = unitsToAngleDeg(*motor, offsetAngle);
-          } else {
-            // 未标定：使用原始角度（但这不是真正的解剖角）
-            status->ankle_deg = unitsToAngleDeg(*motor, angle);
-          }
-          status->hip_deg = 0.0f;  // 踝关节不使用此字段
-        }
-        
-        // ========== 兼容性字段（向后兼容） ==========
-        status->multiTurnAngle = status->raw_units;
-        if (motor->id == 1) {
-          status->angleDeg = status->hip_deg;
-        } else {
-          status->angleDeg = status->ankle_deg;
-        }
-        
-        status->lastUpdateMs = millis();
+      // 紧急停止控制循环
+      controlLoop.controlEnabled = false;
+      // 紧急停止传感器轮询
+      sensorPolling.enabled = false;
+      
+      // 下发停止命令（尝试停止电机）
+      // 注意：在ISR中发送CAN可能会有风险，但为了安全必须尝试
+      // sendCanCommand(motor->id, CMD_MOTOR_STOP); 
+      // 更好的做法是依赖全局标志让主循环停止，或者电机内部保护
+    }
+  }
+}
 
-        // 角度 RX 打点计数（用于验证 50Hz 采集：串口 ≤10Hz 打印换算频率）
-        if (motor->id == 1) {
-          s_angleDiagRxHipCnt++;
-        } else if (motor->id == 2) {
-          s_angleDiagRxAnkCnt++;
-        }
-        
-        // 对于髋关节，更新信号预处理、自适应阈值、步态相位识别和摆动进度
-        if (motor->id == 1) {
-          updateHipSignalProcessor(status->hip_deg);
-          // 使用滤波后的髋角更新自适应阈值
-          if (hipProcessor.initialized) {
-            updateAdaptiveThreshold(hipProcessor.hip_f);
-            // 更新步态相位识别
-            updateGaitPhaseDetector();
-            // 更新摆动相进度计算
-            updateSwingProgress();
-            // 更新踝背屈辅助策略（需要髋关节相位和进度信息）
-            if (ankleStatus.lastUpdateMs > 0 && 
-                (millis() - ankleStatus.lastUpdateMs) < 200) {  // 确保踝关节数据是新鲜的
-              GaitPhase currentPhase = getCurrentGaitPhase();
-              float swing_progress = getSwingProgress();
-              updateAnkleAssistStrategy(getAnkleDeg(), currentPhase, swing_progress);
-              
-              // // 更新顺从控制状态机（需要参考角度、电流、温度、通讯状态）
-              // float theta_ref = getAnkleReferenceAngle();
-              // bool commOk = (millis() - ankleStatus.lastUpdateMs) < COMM_TIMEOUT_MS;
-              // updateComplianceController(getAnkleDeg(), theta_ref, ankleStatus.iq, 
-              //                            ankleStatus.temperature, commOk);
-            }
-          }
-        }
-        
-        // 简化输出：只显示角度数据
-        // if (motor->id == 1) {
-        //   Serial.printf("Hip: %.2f deg\n", status->angleDeg);
-        // } else {
-        //   if (ankle_zero_calibrated) {
-        //     Serial.printf("Ankle: %.2f deg (calibrated, offset=%lld)\n", 
-        //                  status->angleDeg, static_cast<long long>(ankle_zero_offset));
-        //   } else {
-        //     Serial.printf("Ankle: %.2f deg (raw, NOT calibrated!)\n", status->angleDeg);
-        //   }
-        // }
-      }
-      else if (cmd == CMD_READ_STATUS1) {
-        // 读取电机状态1回复（0x9A）
-        int8_t temperature = (int8_t)msg.buf[1];
-        uint16_t voltage = msg.buf[2] | (msg.buf[3] << 8);
-        uint16_t current = msg.buf[4] | (msg.buf[5] << 8);
-        uint8_t motorState = msg.buf[6];
-        uint8_t errorState = msg.buf[7];
-        
-        status->temperature = temperature;
-        status->motorState = motorState;
-        status->errorState = errorState;
-        status->enabled = (motorState == 0x00);
-        
-        // if (!inIsrContext) {
-        //   Serial.printf("[RX] %s: temp=%d℃, voltage=%.2fV, current=%.2fA, state=0x%02X, error=0x%02X, ID=0x%03X\n",
-        //                 motor->name, temperature, voltage * 0.01f, current * 0.01f, 
-        //                 motorState, errorState, msg.id);
-        // }
-
-        // ====================================================================
-        // 严重错误检测（Emergency Stop）
-        // ====================================================================
-        // 如果电机报告错误（errorState != 0），立即停止所有控制!
-        if (errorState != 0) {
-          if (!isSystemError) {
-            isSystemError = true;
-            errorMotorId = motor->id;
-            errorCode = errorState;
-            
-            // 紧急停止控制循环
-            controlLoop.controlEnabled = false;
-            // 紧急停止传感器轮询
-            sensorPolling.enabled = false;
-            
-            // 下发停止命令（尝试停止电机）
-            // 注意：在ISR中发送CAN可能会有风险，但为了安全必须尝试
-            // sendCanCommand(motor->id, CMD_MOTOR_STOP); 
-            // 更好的做法是依赖全局标志让主循环停止，或者电机内部保护
-          }
-        }
-      }
-      //else if (cmd == CMD_READ_STATUS2 || cmd == CMD_POSITION_CTRL1 || cmd == CMD_POSITION_CTRL2) {
-      else if (cmd == CMD_READ_STATUS2) {
-        // 读取电机状态2回复（0x9C）或位置控制回复（0xA3/0xA4）
-        // 格式相同：温度、电流/功率、速度、编码器位置
-        int8_t temperature = (int8_t)msg.buf[1];
-        int16_t iq = msg.buf[2] | (msg.buf[3] << 8);
-        int16_t speed = msg.buf[4] | (msg.buf[5] << 8);
-        uint16_t encoder = msg.buf[6] | (msg.buf[7] << 8);
-        
-        status->temperature = temperature;
-        status->speed = speed;
-        status->iq = iq;  // 保存q轴电流（mA）
-        status->lastUpdateMs = millis();
-        
-        // Serial.printf("[RX] %s: temp=%d℃, iq=%d, speed=%d dps, encoder=%u, ID=0x%03X, CMD=0x%02X\n",
-        //               motor->name, temperature, iq, speed, encoder, msg.id, cmd);
-      }
-      // else {
-      //   // 其他回复帧
-      //   Serial.printf("[RX] %s: ID=0x%03X, CMD=0x%02X, Data: ",
-      //                 motor->name, msg.id, cmd);
-      //   for (int i = 0; i < msg.len; i++) {
-      //     Serial.printf("%02X ", msg.buf[i]);
-      //   }
-      //   Serial.println();
-      // }
+// 读取电机状态2回复（0x9C）或转矩闭环回复（0xA1，单发或 0x280 广播均以此格式回复）
+// 格式相同：温度、电流/功率、速度、编码器位置
+// （0xA3/0xA4 位置控制回复格式也相同，目前不登记）
+static void onStatus2Reply(MotorRecord &rec, const CAN_message_t &msg) {
+  MotorStatus *status = rec.status;
+  int8_t temperature = (int8_t)msg.buf[1];
+  int16_t iq = msg.buf[2] | (msg.buf[3] << 8);
+  int16_t speed = msg.buf[4] | (msg.buf[5] << 8);
+  uint16_t encoder = msg.buf[6] | (msg.buf[7] << 8);
+  
+  status->temperature = temperature;
+  status->speed = speed;
+  status->speedSampleUs = CanRx::currentRxUs() ? CanRx::currentRxUs() : micros();
+  status->iq = iq;  // 保存q轴电流（mA）
+
+  // 编码器样本送入展开跟踪；已由 0x92 锚定时即为一次关节角采样（ctrlon 时每帧转矩应答都是样本）
+  int64_t trackedUnits = 0;
+  if (encoderTrackerSample(*rec.encTrack, *rec.config, encoder, speed, CanRx::currentRxUs(), trackedUnits)) {
+    applyJointAngleUnits(rec, trackedUnits);
+  } else if (msg.buf[0] == CMD_READ_STATUS2) {
+    status->lastUpdateMs = millis();
+  }
+  
+  // Serial.printf("[RX] %s: temp=%d℃, iq=%d, speed=%d dps, encoder=%u, ID=0x%03X, CMD=0x%02X\n",
+  //               rec.config->name, temperature, iq, speed, encoder, msg.id, msg.buf[0]);
+}
+
+// 登记本机电机与应答解析表（setup 中、CAN 初始化之前调用）
+void initMotorRegistry() {
+  MotorRecord hip = {};
+  hip.config = &hipMotor;
+  hip.status = &hipStatus;
+  hip.encTrack = &hipEncTrack;
+  hip.calibOffset = &hip_reference_offset;
+  hip.calibValid = nullptr;                 // 髋参考偏移始终参与换算（默认 0）
+  hip.logicalDeg = &MotorStatus::hip_deg;
+  hip.unusedDeg = &MotorStatus::ankle_deg;
+  hip.angleRxCounter = &s_angleDiagRxHipCnt;
+  hip.onAngleSample = hipAngleSampleHook;
+  registerMotor(hip);
+
+  MotorRecord ankle = {};
+  ankle.config = &ankleMotor;
+  ankle.status = &ankleStatus;
+  ankle.encTrack = &ankleEncTrack;
+  ankle.calibOffset = &ankle_zero_offset;
+  ankle.calibValid = &ankle_zero_calibrated;
+  ankle.logicalDeg = &MotorStatus::ankle_deg;
+  ankle.unusedDeg = &MotorStatus::hip_deg;
+  ankle.angleRxCounter = &s_angleDiagRxAnkCnt;
+  ankle.onAngleSample = nullptr;
+  registerMotor(ankle);
+
+  motorReplyHandlers[CMD_READ_MULTI_ANGLE] = onMultiAngleReply;
+  motorReplyHandlers[CMD_READ_STATUS1] = onStatus1Reply;
+  motorReplyHandlers[CMD_READ_STATUS2] = onStatus2Reply;
+  motorReplyHandlers[CMD_TORQUE_CTRL] = onStatus2Reply;
+}
+
+// 处理接收到的 CAN 反馈帧
+// 反馈帧使用相同的 CAN ID（0x140 + ID）
+void handleCanMessage(const CAN_message_t &msg) {
+  PROF_ZONE(ZONE_HANDLE_CAN);
+  // 判断是否为控制指令的回复帧（ID = 0x140 + 电机ID）：注册表 + 命令字节两级查表
+  if (msg.id > CAN_CMD_BASE_ID && msg.id <= CAN_CMD_BASE_ID + MOTOR_REGISTRY_MAX_ID) {
+    uint8_t motorId = static_cast<uint8_t>(msg.id - CAN_CMD_BASE_ID);
+    Rtt::onRx(motorId, msg.buf[0], CanRx::currentRxUs());
+    MotorRecord *rec = motorRecord(motorId);
+    MotorReplyHandler handler = motorReplyHandlers[msg.buf[0]];
+    if (rec != nullptr && handler != nullptr) {
+      handler(*rec, msg);
+    } else {
+      // 未登记的电机或未解析的应答（如 0xA3/0xA4/0x88）：只计数
+      CanRx::noteUnhandled();
     }
   } else {
     // 板级自定义命令（来自主控的控制指令），ID=BOARD_CMD_ID
@@ -2050,7 +4411,9 @@ void handleCanMessage(const CAN_message_t &msg) {
         ack.buf[0] = BOARD_CMD_ENABLE_HIP_TORQUE;
         ack.buf[1] = (uint8_t)(hipIqTarget & 0xFF);
         ack.buf[2] = (uint8_t)((hipIqTarget >> 8) & 0xFF);
-        can1.write(ack);
+        if (can1.write(ack)) {
+          BusStat::onTx(ack);
+        }
         return;
       } else if (bcmd == BOARD_CMD_DISABLE_HIP_TORQUE) {
         hipTorqueMode = false;
@@ -2063,22 +4426,19 @@ void handleCanMessage(const CAN_message_t &msg) {
         ack.flags.extended = 0;
         memset(ack.buf, 0, 8);
         ack.buf[0] = BOARD_CMD_DISABLE_HIP_TORQUE;
-        can1.write(ack);
+        if (can1.write(ack)) {
+          BusStat::onTx(ack);
+        }
         return;
       }
     }
 
-    // 其他未知帧，原样打印
-    if (!inIsrContext) {
-      telemetryPrintf("[RX] Unknown ID=0x%03X, DLC=%u, Data: ", msg.id, msg.len);
-      for (int i = 0; i < msg.len; i++) {
-        telemetryPrintf("%02X ", msg.buf[i]);
-      }
-      telemetryPrintf("\n");
-    }
+    // 其他未识别帧：只计数（外部 ID 已由硬件滤波拦截），不在热路径上格式化打印；canrx 查看
+    CanRx::noteUnhandled();
   }
 }
 
+
 // ============================================================================
 // 摆动功能：基于当前角度，左右摆动给定角度
 // ============================================================================
@@ -2098,26 +4458,20 @@ SwingState hipSwing = {false, 0.0f, 0.0f, 0.0f, true, 0, 50, &hipMotor};  // 50m
 SwingState ankleSwing = {false, 0.0f, 0.0f, 0.0f, true, 0, 50, &ankleMotor};  // 50ms间隔，更平滑
 
 void startSwing(SwingState &swing, const MotorConfig &motor, float amplitudeDeg) {
-  MotorStatus *status = (motor.id == 1) ? &hipStatus : &ankleStatus;
+  const MotorRecord *rec = motorRecord(motor.id);
+  if (rec == nullptr) {
+    return;
+  }
   // 查询关节电机角度为最新状态
   requestMotorAngle(motor);
   // INSERT_YOUR_CODE
-  delay(1000);
-  {
-    CAN_message_t inMsg;
-    while (can1.read(inMsg)) {
-      handleCanMessage(inMsg);
-    }
-  }
+  CanTx::serviceFor(1000);
+  CanRx::dispatch();
 
   
   swing.motor = &motor;
   // 以当前逻辑角为中心
-  if (motor.id == 1) {
-    swing.centerAngle = getHipDeg();
-  } else {
-    swing.centerAngle = getAnkleDeg();
-  }
+  swing.centerAngle = rec->status->*(rec->logicalDeg);
   swing.amplitude = amplitudeDeg;
   swing.currentAngle = swing.centerAngle;
   swing.direction = true;  // 先向右
@@ -2306,7 +4660,7 @@ void stopReceivingGaitData() {
 }
 
 // 处理接收到的步态数据（在串口命令处理中调用）
-void processReceivedGaitData(const String &line) {
+void processReceivedGaitData(const char *line) {
   if (!gaitDataReceive.receiving) return;
   
   // 检查超时
@@ -2637,15 +4991,12 @@ void startGaitPlayback(float frequencyHz, float maxSpeedDps) {
   // 读取当前角度作为摆动中心
   requestMotorAngle(hipMotor);
   requestMotorAngle(ankleMotor);
-  delay(100);  // 等待CAN回复
+  CanTx::serviceFor(100);  // 等待CAN回复
   
   // 处理CAN消息，更新角度
-  CAN_message_t inMsg;
   uint32_t startWait = millis();
   while (millis() - startWait < 200) {
-    if (can1.read(inMsg)) {
-      handleCanMessage(inMsg);
-    }
+    CanRx::dispatch();
   }
   
   // 保存当前位置作为摆动中心（使用逻辑角）
@@ -2740,19 +5091,295 @@ void updateGaitPlayback() {
 // SensorPollingTimer sensorPolling = {false, 0, 20};
 
 
-// 电机角度：50Hz/轴（每 10ms 只发一轴查询，两轴交替）；STATUS：略降频以减少与角度抢占同一节点
-static constexpr uint32_t ANGLE_HALF_PERIOD_US = 10000;   // 10ms → 每轴 20ms 周期 = 50Hz
-// 每圈最多 1 次角度 TX：避免同周期连发多帧至同一节点；节拍正常时与 100Hz 对齐即可满 50Hz/轴
-static constexpr uint8_t MAX_ANGLE_SENDS_PER_UNIFIED = 1;
-static constexpr uint32_t STATUS_POLL_INTERVAL_MS = 130;           // 仅采集/gc、未跑闭环助力时
-static constexpr uint32_t STATUS_POLL_INTERVAL_MS_CTRL_ON = 800;    // ctrlon 时拉长 STATUS，把带宽留给角度应答
+// 电机角度：初始 50Hz/轴（两轴错开半个周期，每 10ms 只发一轴查询）；STATUS：略降频以减少与角度抢占同一节点
+// 以下为自适应轮询（PollSched）的初值与上下限，运行时周期由实测丢包/TX 失败/总线占用闭环调整
+static constexpr uint32_t ANGLE_HALF_PERIOD_US = 10000;   // 10ms → 每轴 20ms 周期 = 50Hz（初值）
+static constexpr uint32_t ANGLE_PERIOD_FLOOR_US = 10000;  // 每轴最快 100Hz（与统一周期节拍一致）
+static constexpr uint32_t ANGLE_PERIOD_CEIL_US = 100000;  // 每轴最慢 10Hz
+static constexpr uint32_t STATUS_POLL_INTERVAL_MS = 130;           // 仅采集/gc、未跑闭环助力时（初值，亦为下限）
+static constexpr uint32_t STATUS_POLL_INTERVAL_MS_CTRL_ON = 800;    // ctrlon 时拉长 STATUS，把带宽留给角度应答（初值）
+static constexpr uint32_t STATUS_POLL_FLOOR_MS_CTRL_ON = 400;       // ctrlon 时 STATUS 最快间隔
+static constexpr uint32_t STATUS_POLL_CEIL_MS = 3000;               // STATUS 最慢间隔
 // ctrlon 时 A1 转矩降频：1=每周期(~100Hz)，2≈50Hz，3≈33Hz（减轻过载时优先加大此值）
 static constexpr uint8_t TORQUE_TX_CTRL_ON_DIVISOR = 2;
+// ctrlon 且编码器展开跟踪已锚定、转矩应答持续到达时，0x92 仅作低频锚点（每轴周期）
+static constexpr uint32_t ANGLE_ANCHOR_PERIOD_MS = 250;
+// 最近编码器样本超过此时长视为转矩应答中断，恢复全速 0x92
+static constexpr uint32_t ENC_TRACK_FRESH_US = 30000;
 // 踝 0x92 之后至少间隔再发踝 STATUS（同一电机 ID；协议 350µs，此处加大裕量利于稳定 50Hz RX）
 static constexpr uint32_t ANKLE_GAP_AFTER_ANGLE_QUERY_US = 1800;
 // 诊断窗口加长，Hz 数字更稳；仍 ≤5Hz 串口（200ms 一行）
 static constexpr uint32_t ANGLE_DIAG_SERIAL_INTERVAL_MS = 200;
 
+// ============================================================================
+// 自适应轮询调度：每窗口按实测应答丢失、TX 失败、总线占用调整每轴角度周期与 STATUS 间隔
+// ============================================================================
+// 拥塞（TX 失败增加 / 占用率高 / 任一类查询丢包高）：STATUS 先成倍退让，已到上限后角度周期再 ×1.25；
+// 健康（无 TX 失败、占用率低、丢包低）：角度周期先逐步缩短直至下限，之后 STATUS 才逐步恢复。
+// 丢包来自 Rtt（超时 + 被覆盖），TX 失败来自 FwLog，占用率来自 BusStat。
+//
+// 相位锁定模式（poll lock on）：角度查询不再走独立时钟，而是对齐控制帧——
+// 每轴每 k 帧（k = 周期/帧周期，取整）选一个目标帧，在其节拍前 lead 时刻发出 0x92，
+// lead = 该轴 0x92 实测 RTT p99 + 裕量，使应答恰好在目标帧 RX 槽之前到达。
+// 两轴目标帧错开 k/2 帧。每帧估计槽记录两轴样本龄（帧开始时刻 − 样本接收时刻）。
+namespace PollSched {
+
+static constexpr uint32_t kWindowMs = 500;
+static constexpr float kLossHighPct = 5.0f;
+static constexpr float kLossLowPct = 1.0f;
+static constexpr float kUtilHighPct = 70.0f;
+static constexpr float kUtilLowPct = 50.0f;
+static constexpr uint32_t kAngleStepUs = 1000;   // 健康时每窗口缩短的角度周期
+static constexpr uint32_t kLeadMarginUs = 300;   // 相位锁定：RTT p99 之外的裕量
+static constexpr uint32_t kLeadDefaultUs = 1500; // 尚无 RTT 样本时的 lead
+static constexpr uint32_t kLeadMinUs = 300;
+static constexpr uint32_t kLeadMaxUs = 8000;
+
+struct Axis {
+  const MotorConfig *motor;
+  uint32_t periodUs;     // 当前角度查询周期
+  uint32_t nextUs;       // 下次到期时间
+  uint32_t lastReplies;  // Rtt 累计快照
+  uint32_t lastLost;
+  float lossPct;         // 上一窗口丢包率
+  uint32_t alignTick;    // 相位锁定：下一个目标帧的节拍序号
+  uint32_t alignMissed;  // 相位锁定：目标帧开始前未能发出查询的次数
+  uint32_t ageUs;        // 最近一帧估计槽看到的样本龄
+  uint32_t ageMaxUs;     // 窗口内样本龄最大值
+  uint64_t ageSumUs;     // 窗口内样本龄累计（求均值）
+  uint32_t ageCount;
+  float ageMeanUs;       // 上一窗口样本龄均值
+  uint32_t ageMaxLastUs; // 上一窗口样本龄最大值
+};
+
+static Axis g_axes[2] = {
+  {&ankleMotor, 2 * ANGLE_HALF_PERIOD_US, 0, 0, 0, 0.0f, 0, 0, 0, 0, 0, 0, 0.0f, 0},
+  {&hipMotor,   2 * ANGLE_HALF_PERIOD_US, 0, 0, 0, 0.0f, 0, 0, 0, 0, 0, 0, 0.0f, 0},
+};
+static uint32_t g_statusIntervalMs = STATUS_POLL_INTERVAL_MS;
+static uint32_t g_statusLastReplies = 0;
+static uint32_t g_statusLastLost = 0;
+static float g_statusLossPct = 0.0f;
+static uint32_t g_lastTxFail = 0;
+static uint32_t g_lastWindowMs = 0;
+static uint32_t g_txFailWindow = 0;
+static bool g_auto = true;
+static bool g_phaseLock = false;
+
+static uint32_t statusFloorMs() {
+  return controlLoop.controlEnabled ? STATUS_POLL_FLOOR_MS_CTRL_ON : STATUS_POLL_INTERVAL_MS;
+}
+
+// 相位锁定下每轴隔几帧查询一次（由自适应周期折算，至少每帧一次）
+uint32_t framesPerQuery(const Axis &ax) {
+  const uint32_t p = CycleExec::periodUs();
+  uint32_t k = (ax.periodUs + p / 2) / p;
+  return k ? k : 1u;
+}
+
+// 相位锁定目标帧从下一帧起算，两轴错开半个查询周期（按第二轴当前自适应周期折算帧数）
+static void restartAlignment() {
+  uint32_t tick = 0, tickUs = 0;
+  CycleExec::tickSnapshot(tick, tickUs);
+  g_axes[0].alignTick = tick + 1;
+  g_axes[1].alignTick = tick + 1 + framesPerQuery(g_axes[1]) / 2;
+}
+
+// 丢包统计重新取 Rtt 累计快照（轮询重启、Rtt::reset() 后调用），下一窗口只计新增计数
+void resync() {
+  g_statusLastReplies = 0;
+  g_statusLastLost = 0;
+  for (Axis &ax : g_axes) {
+    ax.lossPct = 0.0f;
+    Rtt::totals(ax.motor->id, CMD_READ_MULTI_ANGLE, ax.lastReplies, ax.lastLost);
+    uint32_t r = 0, l = 0;
+    Rtt::totals(ax.motor->id, CMD_READ_STATUS1, r, l);
+    g_statusLastReplies += r;
+    g_statusLastLost += l;
+    Rtt::totals(ax.motor->id, CMD_READ_STATUS2, r, l);
+    g_statusLastReplies += r;
+    g_statusLastLost += l;
+  }
+  g_statusLossPct = 0.0f;
+}
+
+// 轮询（重新）启动：周期回到初值，两轴错开半个周期；丢包统计重新取快照，避免停轮询期间的计数落进第一个窗口
+void restart(uint32_t usNow, uint32_t msNow) {
+  for (Axis &ax : g_axes) {
+    ax.periodUs = 2 * ANGLE_HALF_PERIOD_US;
+  }
+  resync();
+  g_axes[0].nextUs = usNow;
+  g_axes[1].nextUs = usNow + ANGLE_HALF_PERIOD_US;
+  restartAlignment();
+  g_statusIntervalMs = controlLoop.controlEnabled ? STATUS_POLL_INTERVAL_MS_CTRL_ON : STATUS_POLL_INTERVAL_MS;
+  g_lastTxFail = FwLog::canTxFailTotal();
+  g_lastWindowMs = msNow;
+}
+
+static float windowLossPct(uint32_t replies, uint32_t lost, uint32_t &lastReplies, uint32_t &lastLost) {
+  if (replies < lastReplies || lost < lastLost) {
+    lastReplies = 0;  // 累计值回退（Rtt 被清零）：按新窗口从 0 计
+    lastLost = 0;
+  }
+  uint32_t dr = replies - lastReplies;
+  uint32_t dl = lost - lastLost;
+  lastReplies = replies;
+  lastLost = lost;
+  return (dr + dl) ? 100.0f * dl / (dr + dl) : 0.0f;
+}
+
+// 统一周期中调用：窗口到期时闭环调整
+void update(uint32_t msNow) {
+  if (msNow - g_lastWindowMs < kWindowMs) {
+    return;
+  }
+  g_lastWindowMs = msNow;
+
+  for (Axis &ax : g_axes) {
+    uint32_t replies = 0, lost = 0;
+    Rtt::totals(ax.motor->id, CMD_READ_MULTI_ANGLE, replies, lost);
+    ax.lossPct = windowLossPct(replies, lost, ax.lastReplies, ax.lastLost);
+    ax.ageMeanUs = ax.ageCount ? static_cast<float>(ax.ageSumUs) / ax.ageCount : 0.0f;
+    ax.ageMaxLastUs = ax.ageMaxUs;
+    ax.ageSumUs = 0;
+    ax.ageCount = 0;
+    ax.ageMaxUs = 0;
+  }
+  uint32_t sr = 0, sl = 0;
+  for (const Axis &ax : g_axes) {
+    uint32_t r = 0, l = 0;
+    Rtt::totals(ax.motor->id, CMD_READ_STATUS1, r, l);
+    sr += r; sl += l;
+    Rtt::totals(ax.motor->id, CMD_READ_STATUS2, r, l);
+    sr += r; sl += l;
+  }
+  g_statusLossPct = windowLossPct(sr, sl, g_statusLastReplies, g_statusLastLost);
+  uint32_t txFail = FwLog::canTxFailTotal();
+  g_txFailWindow = txFail - g_lastTxFail;
+  g_lastTxFail = txFail;
+  const float util = BusStat::utilizationPct();
+
+  if (!g_auto) {
+    return;
+  }
+
+  const bool busCongested = (g_txFailWindow > 0) || (util > kUtilHighPct);
+  bool axisLossy = g_statusLossPct > kLossHighPct;
+  bool allClean = (g_statusLossPct < kLossLowPct);
+  for (const Axis &ax : g_axes) {
+    axisLossy = axisLossy || (ax.lossPct > kLossHighPct);
+    allClean = allClean && (ax.lossPct < kLossLowPct);
+  }
+
+  if (busCongested || axisLossy) {
+    // STATUS 优先退让
+    if (g_statusIntervalMs < STATUS_POLL_CEIL_MS) {
+      g_statusIntervalMs = constrain(g_statusIntervalMs * 2, statusFloorMs(), STATUS_POLL_CEIL_MS);
+      return;
+    }
+    for (Axis &ax : g_axes) {
+      if (busCongested || ax.lossPct > kLossHighPct) {
+        ax.periodUs = constrain(ax.periodUs * 5 / 4, ANGLE_PERIOD_FLOOR_US, ANGLE_PERIOD_CEIL_US);
+      }
+    }
+    return;
+  }
+
+  if (allClean && util < kUtilLowPct) {
+    // 角度优先爬升，全部到下限后再恢复 STATUS
+    bool anglesAtFloor = true;
+    for (Axis &ax : g_axes) {
+      if (ax.periodUs > ANGLE_PERIOD_FLOOR_US) {
+        ax.periodUs = constrain(ax.periodUs - kAngleStepUs, ANGLE_PERIOD_FLOOR_US, ANGLE_PERIOD_CEIL_US);
+        anglesAtFloor = false;
+      }
+    }
+    if (anglesAtFloor && g_statusIntervalMs > statusFloorMs()) {
+      g_statusIntervalMs = constrain(g_statusIntervalMs * 3 / 4, statusFloorMs(), STATUS_POLL_CEIL_MS);
+    }
+  }
+  if (g_statusIntervalMs < statusFloorMs()) {
+    g_statusIntervalMs = statusFloorMs();  // ctrlon 后下限抬高
+  }
+}
+
+uint32_t statusIntervalMs() {
+  return g_statusIntervalMs;
+}
+
+void setAuto(bool on) {
+  g_auto = on;
+}
+
+bool phaseLocked() {
+  return g_phaseLock;
+}
+
+void setPhaseLock(bool on) {
+  if (on && !g_phaseLock) {
+    restartAlignment();
+  }
+  g_phaseLock = on;
+}
+
+// 查询提前量：0x92 RTT p99 + 裕量
+uint32_t leadUs(const Axis &ax) {
+  uint32_t p50 = 0, p99 = 0;
+  if (!Rtt::summary(ax.motor->id, CMD_READ_MULTI_ANGLE, p50, p99)) {
+    return kLeadDefaultUs;
+  }
+  return constrain(p99 + kLeadMarginUs, kLeadMinUs, kLeadMaxUs);
+}
+
+// 估计槽每帧调用：记录样本龄（sampleUs==0 表示尚无样本）
+void noteSampleAge(const MotorConfig &motor, uint32_t frameUs, uint32_t sampleUs) {
+  for (Axis &ax : g_axes) {
+    if (ax.motor != &motor) {
+      continue;
+    }
+    ax.ageUs = sampleUs ? (frameUs - sampleUs) : 0u;
+    if (sampleUs == 0) {
+      return;
+    }
+    ax.ageSumUs += ax.ageUs;
+    ax.ageCount++;
+    if (ax.ageUs > ax.ageMaxUs) {
+      ax.ageMaxUs = ax.ageUs;
+    }
+  }
+}
+
+// 最近一帧样本龄（µs），供遥测
+uint32_t sampleAgeUs(const MotorConfig &motor) {
+  for (const Axis &ax : g_axes) {
+    if (ax.motor == &motor) {
+      return ax.ageUs;
+    }
+  }
+  return 0;
+}
+
+void printStatus(Print &out) {
+  out.printf("Poll scheduler: auto=%s lock=%s window=%lu ms util=%.1f%% tx_fail(win)=%lu\n",
+             g_auto ? "ON" : "OFF", g_phaseLock ? "ON" : "OFF", static_cast<unsigned long>(kWindowMs),
+             BusStat::utilizationPct(), static_cast<unsigned long>(g_txFailWindow));
+  for (const Axis &ax : g_axes) {
+    out.printf("  %s angle: period=%lu us (%.1f Hz) loss=%.1f%% [floor %lu, ceil %lu]\n",
+               ax.motor->name, static_cast<unsigned long>(ax.periodUs), 1e6f / ax.periodUs, ax.lossPct,
+               static_cast<unsigned long>(ANGLE_PERIOD_FLOOR_US), static_cast<unsigned long>(ANGLE_PERIOD_CEIL_US));
+    out.printf("    sample age: last=%lu us mean=%.0f us max=%lu us | lock: every %lu frame(s) lead=%lu us missed=%lu\n",
+               static_cast<unsigned long>(ax.ageUs), ax.ageMeanUs, static_cast<unsigned long>(ax.ageMaxLastUs),
+               static_cast<unsigned long>(framesPerQuery(ax)), static_cast<unsigned long>(leadUs(ax)),
+               static_cast<unsigned long>(ax.alignMissed));
+  }
+  out.printf("  STATUS: interval=%lu ms loss=%.1f%% [floor %lu, ceil %lu]\n",
+             static_cast<unsigned long>(g_statusIntervalMs), g_statusLossPct,
+             static_cast<unsigned long>(statusFloorMs()), static_cast<unsigned long>(STATUS_POLL_CEIL_MS));
+}
+
+}  // namespace PollSched
+
 // 启动传感器轮询（在ctrlon开启时调用）
 void startSensorPolling(uint32_t intervalMs = 20) {
   sensorPolling.enabled = true;
@@ -2760,11 +5387,11 @@ void startSensorPolling(uint32_t intervalMs = 20) {
   uint32_t t = millis();
   sensorPolling.lastStatusPollMs = t - STATUS_POLL_INTERVAL_MS;
   uint32_t us = micros();
-  s_angleNextHalfPeriodUs = us;
-  s_anglePollAnkleNext = true;
+  PollSched::restart(us, t);
   s_statusBurstPhase = 0;
   s_usLastAnkleAngleQueryTx = 0;
-  hostPrintf(">>> Sensor polling STARTED (angle 50 Hz/axis staggered, status ~7.7 Hz, gc/json param=%lu ms)\n",
+  hostPrintf(">>> Sensor polling STARTED (angle 50 Hz/axis staggered, status every %lu ms, adaptive, gc/json param=%lu ms)\n",
+                static_cast<unsigned long>(PollSched::statusIntervalMs()),
                 static_cast<unsigned long>(intervalMs));
 }
 
@@ -2774,13 +5401,68 @@ void stopSensorPolling() {
   hostPrintln(">>> Sensor polling STOPPED");
 }
 
-// 方案二：传感器查询由 runUnifiedCanCycle100Hz 统一调度（角度交错 + STATUS 分拍，减轻 TX 队列丢失）
-static bool ankleReadyForStatusTraffic(uint32_t usNow) {
-  // 从未发过踝角查询时允许 STATUS（避免初值阻塞）
-  if (s_usLastAnkleAngleQueryTx == 0) {
-    return true;
+// 方案二：传感器查询由 runUnifiedCanCycle100Hz 统一调度（角度交错 + STATUS 分拍，减轻 TX 队列丢失）
+static bool ankleReadyForStatusTraffic(uint32_t usNow) {
+  // 从未发过踝角查询时允许 STATUS（避免初值阻塞）
+  if (s_usLastAnkleAngleQueryTx == 0) {
+    return true;
+  }
+  return (usNow - s_usLastAnkleAngleQueryTx) >= ANKLE_GAP_AFTER_ANGLE_QUERY_US;
+}
+
+// 编码器跟踪是否可替代 0x92：仅 ctrlon（转矩帧持续下发）且已锚定、样本新鲜时
+static bool encoderTrackLive(const EncoderTracker &t, uint32_t usNow) {
+  return controlLoop.controlEnabled && t.anchored &&
+         (uint32_t)(usNow - t.lastSampleUs) < ENC_TRACK_FRESH_US;
+}
+
+// 单轴角度查询时隙：编码器跟踪在线时只按锚点周期发 0x92
+static void sendAxisAngleQuery(PollSched::Axis &ax, uint32_t now, uint32_t us) {
+  const bool doAnkle = (ax.motor == &ankleMotor);
+  EncoderTracker &track = doAnkle ? ankleEncTrack : hipEncTrack;
+  if (encoderTrackLive(track, us) && (now - track.lastAnchorTxMs) < ANGLE_ANCHOR_PERIOD_MS) {
+    // 角度由转矩应答编码器提供，本时隙不发 0x92，把带宽留给转矩/STATUS
+    return;
+  }
+  track.lastAnchorTxMs = now;
+  bool ok = requestMotorAngle(*ax.motor);
+  if (doAnkle && ok) {
+    s_usLastAnkleAngleQueryTx = micros();
+  }
+  if (doAnkle) {
+    s_angleTxAnkWindowCnt++;
+  } else {
+    s_angleTxHipWindowCnt++;
+  }
+  if (!ok) {
+    s_angleTxFailWindowCnt++;
+  }
+}
+
+// 相位锁定角度查询（loop 中每圈调用，位于帧间）：到达“目标帧节拍 − lead”即发出
+static void sensorPollingAlignedTx() {
+  if (!sensorPolling.enabled || isSystemError || !PollSched::phaseLocked()) {
+    return;
+  }
+  uint32_t tick = 0, tickUs = 0;
+  CycleExec::tickSnapshot(tick, tickUs);
+  const uint32_t periodUs = CycleExec::periodUs();
+  for (PollSched::Axis &ax : PollSched::g_axes) {
+    const uint32_t k = PollSched::framesPerQuery(ax);
+    if ((int32_t)(ax.alignTick - tick) <= 0) {
+      // 目标帧已开始仍未发出（loop 卡顿）：顺延到下一个目标帧
+      uint32_t steps = (tick - ax.alignTick) / k + 1;
+      ax.alignTick += steps * k;
+      ax.alignMissed += steps;
+    }
+    const uint32_t sendAtUs = tickUs + (ax.alignTick - tick) * periodUs - PollSched::leadUs(ax);
+    const uint32_t us = micros();
+    if ((int32_t)(us - sendAtUs) < 0) {
+      continue;
+    }
+    sendAxisAngleQuery(ax, millis(), us);
+    ax.alignTick += k;
   }
-  return (usNow - s_usLastAnkleAngleQueryTx) >= ANKLE_GAP_AFTER_ANGLE_QUERY_US;
 }
 
 static void sensorPollingScheduledTx(uint32_t now) {
@@ -2788,37 +5470,30 @@ static void sensorPollingScheduledTx(uint32_t now) {
     return;
   }
 
-  for (uint8_t n = 0; n < MAX_ANGLE_SENDS_PER_UNIFIED; n++) {
+  PollSched::update(now);
+
+  // 每轴按各自的运行时周期查询；每圈每轴最多 1 帧（两轴是不同节点，不占同一保护窗）
+  // 相位锁定模式下角度查询改由 sensorPollingAlignedTx 在帧间发出
+  for (PollSched::Axis &ax : PollSched::g_axes) {
+    if (PollSched::phaseLocked()) {
+      break;
+    }
     uint32_t us = micros();
-    int32_t angleLateUs = (int32_t)(us - s_angleNextHalfPeriodUs);
+    int32_t angleLateUs = (int32_t)(us - ax.nextUs);
     if (angleLateUs < 0) {
-      break;
+      continue;
     }
     if ((uint32_t)angleLateUs > 50000) {
-      s_angleNextHalfPeriodUs = us + ANGLE_HALF_PERIOD_US;
-    } else {
-      s_angleNextHalfPeriodUs += ANGLE_HALF_PERIOD_US;
-    }
-    const bool doAnkle = s_anglePollAnkleNext;
-    bool ok = doAnkle ? requestMotorAngle(ankleMotor) : requestMotorAngle(hipMotor);
-    if (doAnkle && ok) {
-      s_usLastAnkleAngleQueryTx = micros();
-    }
-    if (doAnkle) {
-      s_angleTxAnkWindowCnt++;
+      ax.nextUs = us + ax.periodUs;
     } else {
-      s_angleTxHipWindowCnt++;
+      ax.nextUs += ax.periodUs;
     }
-    if (!ok) {
-      s_angleTxFailWindowCnt++;
-    }
-    s_anglePollAnkleNext = !s_anglePollAnkleNext;
+    sendAxisAngleQuery(ax, now, us);
   }
 
   const uint32_t usNow = micros();
 
-  const uint32_t statusGapMs =
-      controlLoop.controlEnabled ? STATUS_POLL_INTERVAL_MS_CTRL_ON : STATUS_POLL_INTERVAL_MS;
+  const uint32_t statusGapMs = PollSched::statusIntervalMs();
 
   if (s_statusBurstPhase == 0 &&
       (now - sensorPolling.lastStatusPollMs >= statusGapMs)) {
@@ -2876,12 +5551,15 @@ static void angleDiagPrintIfDue(uint32_t now) {
   uint32_t uc = s_unifiedExeWindowCnt;
   s_unifiedExeWindowCnt = 0;
   float scaleHz = 1000.0f / static_cast<float>(ANGLE_DIAG_SERIAL_INTERVAL_MS);
-  uint32_t pend = g_canCycleTicksPending;
-  Serial.printf("[ANGLE_RATE] hip_rx=%.1f ank_rx=%.1f tx_hip=%u tx_ank=%u fail=%u unif=%lu pend=%lu\n",
-                h * scaleHz, a * scaleHz,
-                static_cast<unsigned>(txh), static_cast<unsigned>(txa),
-                static_cast<unsigned>(f),
-                static_cast<unsigned long>(uc), static_cast<unsigned long>(pend));
+  uint32_t skip = CycleExec::skippedCount();
+  Print &usb = HostOut::replyWriter(HostOut::PORT_USB);
+  usb.printf("[ANGLE_RATE] hip_rx=%.1f ank_rx=%.1f tx_hip=%u tx_ank=%u fail=%u unif=%lu skip=%lu rx_ovf=%lu rx_hw=%u\n",
+             h * scaleHz, a * scaleHz,
+             static_cast<unsigned>(txh), static_cast<unsigned>(txa),
+             static_cast<unsigned>(f),
+             static_cast<unsigned long>(uc), static_cast<unsigned long>(skip),
+             static_cast<unsigned long>(CanRx::overflowCount()),
+             static_cast<unsigned>(CanRx::highWater()));
 }
 
 // 更新传感器轮询（在loop中调用）
@@ -3035,7 +5713,16 @@ void saveA1ParamsToEeprom() {
   }
 }
 
+static bool loadA1ParamsFromEepromImpl();
+
+// 加载结果记入事件日志
 bool loadA1ParamsFromEeprom() {
+  const bool ok = loadA1ParamsFromEepromImpl();
+  FwLog::append(FwLog::TAG_EEPROM_LOAD, ok ? 1 : 0);
+  return ok;
+}
+
+static bool loadA1ParamsFromEepromImpl() {
   A1ParamsPersist p;
   EEPROM.get(EEPROM_ADDR_A1_PARAMS, p);
 
@@ -3109,13 +5796,14 @@ int16_t hipAssistMaxIq = 0; // 0 表示使用 torqueParams.hipAssistMaxIq
 volatile int16_t ankle_cmd_amp = 0; // 踝 push-off / DF 强度
 volatile int16_t hip_cmd_amp   = 0; // 髋屈助力强度
 
-// 踝速度估计
+// 踝速度估计（ankleEst 估计器输出；vel 为原始差分，仅诊断）
 struct AnkleVelEstimator {
   bool initialized = false;
   float last_deg = 0.0f;
-  uint32_t last_ms = 0;
+  uint32_t last_us = 0;   // 上次样本接收时间（微秒）
   float vel = 0.0f;
-  float vel_f = 0.0f;   // EMA 滤波
+  float vel_f = 0.0f;   // 估计速度（deg/s）
+  float acc = 0.0f;     // 估计加速度（deg/s²）
 };
 AnkleVelEstimator ankleVel;
 
@@ -3137,6 +5825,7 @@ PushOffPulse pushOff;
 // 关节安全状态（斜率限制 + 冷却）
 struct JointSafetyState {
   int16_t iq_cmd_prev = 0;
+  float slew_carry = 0.0f;   // 高速模式下每步斜率不足 1 LSB 的余量（跨周期累积）
   bool compliant = false;
   bool in_cooldown = false;
   uint32_t cooldown_start_ms = 0;
@@ -3164,24 +5853,22 @@ AbnormalReason ankleAbn = ABN_NONE;
 // 辅助函数：速度估计 / STANCE 进度 / 安全管线 / IQ 计算
 // ============================================================================
 
-void updateAnkleVelEstimator(float ankle_deg, uint32_t nowMs) {
-  if (!ankleVel.initialized) {
-    ankleVel.initialized = true;
-    ankleVel.last_deg = ankle_deg;
-    ankleVel.last_ms = nowMs;
-    ankleVel.vel = 0.0f;
-    ankleVel.vel_f = 0.0f;
+// sampleUs 为踝角度样本的接收时间：控制帧快于角度采样时，无新样本则不更新（避免 0 速度与尖峰交替）
+void updateAnkleVelEstimator(float ankle_deg, uint32_t sampleUs) {
+  float speedDps = 0.0f;
+  const bool hasSpeed = jointSpeedSample(ankleMotor, ankleStatus, speedDps);
+  if (!jointEstimatorStep(ankleEst, ankleEstTuning, ankle_deg, sampleUs, hasSpeed ? &speedDps : nullptr)) {
     return;
   }
-  uint32_t dt_ms = nowMs - ankleVel.last_ms;
-  if (dt_ms == 0) return;
-  float dt = dt_ms / 1000.0f;
-  float vel = (ankle_deg - ankleVel.last_deg) / dt;
-  ankleVel.vel = vel;
-  const float beta = 0.2f; // 与 hip 速度滤波一致
-  ankleVel.vel_f = ankleVel.vel_f + beta * (vel - ankleVel.vel_f);
+  const uint32_t dt_us = sampleUs - ankleVel.last_us;
+  ankleVel.vel = (ankleVel.initialized && dt_us > 0 && dt_us <= kEstMaxGapUs)
+                     ? (ankle_deg - ankleVel.last_deg) / (dt_us * 1e-6f)
+                     : 0.0f;
+  ankleVel.initialized = true;
   ankleVel.last_deg = ankle_deg;
-  ankleVel.last_ms = nowMs;
+  ankleVel.last_us = sampleUs;
+  ankleVel.vel_f = ankleEst.x[1];
+  ankleVel.acc = ankleEst.x[2];
 }
 
 void updateStanceProgress(GaitPhase phase, uint32_t nowMs) {
@@ -3231,19 +5918,32 @@ int16_t applySafetyPipeline(JointSafetyState &st,
   if (iq_target > iq_pos_max) iq_target = iq_pos_max;
   if (iq_target < -iq_neg_max) iq_target = -iq_neg_max;
 
+  // diq_* 按 10ms 一步标定，按实际控制周期缩放；不足 1 LSB 的部分累积到下一周期
+  const float scale = CycleExec::slewScale();
   int16_t iq_prev = st.iq_cmd_prev;
   int16_t diff = iq_target - iq_prev;
-  if (diff > diq_up) diff = diq_up;
-  if (diff < -diq_dn) diff = -diq_dn;
+  const int16_t step_dn = static_cast<int16_t>(diq_dn * scale + st.slew_carry);
+  const int16_t step_up = static_cast<int16_t>(diq_up * scale + st.slew_carry);
+  if (diff > step_up) {
+    st.slew_carry = diq_up * scale + st.slew_carry - step_up;
+    diff = step_up;
+  } else if (diff < -step_dn) {
+    st.slew_carry = diq_dn * scale + st.slew_carry - step_dn;
+    diff = -step_dn;
+  } else {
+    st.slew_carry = 0.0f;
+  }
   int16_t iq_cmd = iq_prev + diff;
 
   // 软退出：把 iq 拉回 0，并进入冷却
   if (st.compliant) {
+    int16_t step_exit = static_cast<int16_t>(torqueParams.diq_dn_df * scale);
+    if (step_exit < 1) step_exit = 1;
     if (iq_cmd > 0) {
-      iq_cmd -= torqueParams.diq_dn_df;
+      iq_cmd -= step_exit;
       if (iq_cmd < 0) iq_cmd = 0;
     } else if (iq_cmd < 0) {
-      iq_cmd += torqueParams.diq_dn_df;
+      iq_cmd += step_exit;
       if (iq_cmd > 0) iq_cmd = 0;
     }
     if (iq_cmd == 0) {
@@ -3262,27 +5962,27 @@ void updateAnkleAbnormalDetector(int16_t iq_cmd,
                                  float ankle_deg,
                                  float ankle_deg_prev,
                                  float ankle_vel_f) {
-  static uint32_t rev_counter_ms = 0;
+  static uint32_t rev_counter_us = 0;
   static uint32_t no_move_start_ms = 0;
   static float last_deg_for_no_move = 0.0f;
 
   ankleAbn = ABN_NONE;
 
-  // D1: 速度反向（50ms 确认）
+  // D1: 速度反向（50ms 确认；按实际控制周期累计）
   if (abs(iq_cmd) > torqueParams.iq_small) {
     bool expect_df = iq_cmd < 0;
     if (expect_df && ankle_vel_f < -torqueParams.v_rev) {
-      rev_counter_ms += 10;
+      rev_counter_us += CycleExec::periodUs();
     } else if (!expect_df && ankle_vel_f > torqueParams.v_rev) {
-      rev_counter_ms += 10;
+      rev_counter_us += CycleExec::periodUs();
     } else {
-      rev_counter_ms = 0;
+      rev_counter_us = 0;
     }
-    if (rev_counter_ms >= 50) {
+    if (rev_counter_us >= 50000u) {
       ankleAbn = ABN_REV_DIR;
     }
   } else {
-    rev_counter_ms = 0;
+    rev_counter_us = 0;
   }
 
   // D2: 无响应卡滞（200ms 窗）
@@ -3323,18 +6023,18 @@ int16_t computeAnkleIqTarget(GaitPhase phase,
     return 0;
   }
 
-  // A1: Push-off（仅 STANCE；触发门控 = 4 相 PHASE4_PUSH_OFF，非退化）
+  // A1: Push-off（仅 STANCE；触发门控 = 预计出力时刻处于 4 相 PHASE4_PUSH_OFF，非退化）
   if (phase == PHASE_STANCE) {
     (void)stance_pct; // 产品逻辑不再使用 stance 进度窗
     const GaitPhase4 ph4 = getCurrentGaitPhase4();
     const bool pf_ok = !isPhase4Degraded();
-    const bool in_pushoff_phase = (ph4 == PHASE4_PUSH_OFF);
+    const bool in_pushoff_phase = isPushOffPhaseAct();
     const bool hip_ok = hip_deg <= torqueParams.hip_ext_th;
     const bool ankle_ok = ankle_deg >= torqueParams.ankle_df_th;
 
     if (pushOff.active) {
       const bool lift_off = (ph4 == PHASE4_SWING);  // 此处 phase 恒为 STANCE
-      const bool left_p3 = (ph4 != PHASE4_PUSH_OFF);
+      const bool left_p3 = !in_pushoff_phase;
       const bool angle_end = ankle_deg <= torqueParams.ankle_pf_target_deg;
       const bool timeout = (nowMs - pushOff.start_ms) >= torqueParams.pushoff_max_ms;
       if (lift_off || left_p3 || !pf_ok || angle_end || timeout) {
@@ -3414,136 +6114,868 @@ int16_t computeHipIqTarget(GaitPhase phase,
   if (winEnd <= 0.0f) {
     return 0;
   }
-  if (swing_pct < 0.0f || swing_pct > winEnd) {
-    return 0;
+  if (swing_pct < 0.0f || swing_pct > winEnd) {
+    return 0;
+  }
+
+  // 将全局摆动进度映射到 [0,1] 的局部归一化时间 u
+  // u = 0: 助力开始；u = 1: 助力结束
+  float u = swing_pct / winEnd;
+  if (u < 0.0f) u = 0.0f;
+  if (u > 1.0f) u = 1.0f;
+
+  // 使用半个正弦波作为平滑窗函数：
+  // window(u) = sin(pi * u), 在 u ∈ [0,1] 上从 0 平滑上升到 1 再平滑回到 0
+  const float PI_F = 3.1415926f;
+  float window = sinf(PI_F * u);
+  if (window < 0.0f) window = 0.0f;  // 理论上不会小于0，这里只是防御性处理
+
+  // 助力峰值：由控制杆 hip_cmd_amp 决定，并受 hipAssistMaxIq 限幅
+    // 全局可调节的最大助力强度（以 hipAssistMaxIq 为优先）
+    extern int16_t hipAssistMaxIq;
+    int16_t maxIq = (hipAssistMaxIq > 0) ? hipAssistMaxIq : torqueParams.hipAssistMaxIq;
+  if (maxIq <= 0) {
+    // 若未显式配置，则退回到原有的 iq_hip_flex_max
+    maxIq = torqueParams.iq_hip_flex_max;
+  }
+
+  int16_t amp = (int16_t)abs(hip_cmd_amp);
+  if (amp <= 0) {
+    amp = maxIq;
+  } else if (amp > maxIq) {
+    amp = maxIq;
+  }
+
+  // 髋屈为正方向，若实际机械安装相反，可将 sign 改为 -1
+  int16_t sign = 1;
+
+  // 根据窗函数缩放得到当前时刻的目标电流
+  float iq_f = (float)amp * window;
+  int16_t iq = (int16_t)iq_f;
+  return sign * iq;
+}
+
+struct AssistDebugSnapshot {
+  int phase = 0;
+  float swing_pct = 0.0f;
+  float stance_pct = 0.0f;
+  float ankle_deg = 0.0f;
+  float ankle_vel_f = 0.0f;
+  int16_t ankle_iq_target = 0;
+  int16_t ankle_iq_cmd = 0;
+  float hip_deg = 0.0f;
+  float hip_vel_f = 0.0f;
+  int16_t hip_iq_target = 0;
+  int16_t hip_iq_cmd = 0;
+  uint8_t pf = 0, df = 0, ul = 0;
+  uint8_t comp = 0, cool = 0, abn = 0;
+  // 4相快照
+  int     phase4 = 0;
+  float   phase4_progress = 0.0f;
+  float   phase4_output = 0.0f;
+  uint8_t phase4_degraded = 0;
+  uint32_t lastUpdateMs = 0;
+};
+
+AssistDebugSnapshot assistDbg;  // 控制循环内更新，sendGaitData/loop 中读取
+
+GaitDataCollection gaitCollection = {false, 0, 20}; // 默认20ms间隔（50Hz）
+
+// 发送步态数据到串口（固定 JSON schema，便于上位机稳定解析）
+// ============================================================================
+// 二进制遥测（COBS 分帧 + 版本/结构 ID + CRC16），替代 ~450 字节的 JSON 行
+// ============================================================================
+// 线上格式：0x00 | COBS( ver u8 | schema u8 | seq u16 | record... | crc16 u16 ) | 0x00
+//   - 多字节字段均为小端；crc16 = CRC-16/CCITT-FALSE（多项式 0x1021，初值 0xFFFF），覆盖 ver..record
+//   - 帧前后各一个 0x00：文本行中不会出现 0x00，上位机可在同一串口流中区分文本回显与二进制帧
+// 结构 2（通道帧）：t_ms u32 | 通道位图 (kChannelCount+7)/8 字节 | 按通道序号依次排列的已订阅通道值，
+// 通道表见 Telem::kChannels；上位机解码器：pc/telemetry_codec.py（通道顺序/类型/缩放须与此处保持一致）
+namespace BinTelem {
+
+static constexpr uint8_t kVersion = 1;
+static constexpr uint8_t kSchemaChannels = 2;
+static constexpr size_t kMaxRecord = 96;
+
+static bool g_enabled = false;
+static uint16_t g_seq = 0;
+static uint32_t g_framesSent = 0;
+
+uint16_t crc16(const uint8_t *data, size_t len) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < len; ++i) {
+    crc ^= static_cast<uint16_t>(data[i]) << 8;
+    for (uint8_t b = 0; b < 8; ++b) {
+      crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// COBS 编码；out 容量须 ≥ len + len/254 + 1；返回编码长度
+size_t cobsEncode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t codeIdx = 0;
+  size_t o = 1;
+  uint8_t code = 1;
+  for (size_t i = 0; i < len; ++i) {
+    if (in[i] == 0) {
+      out[codeIdx] = code;
+      codeIdx = o++;
+      code = 1;
+    } else {
+      out[o++] = in[i];
+      if (++code == 0xFF) {
+        out[codeIdx] = code;
+        codeIdx = o++;
+        code = 1;
+      }
+    }
+  }
+  out[codeIdx] = code;
+  return o;
+}
+
+static constexpr size_t kMaxRaw = 4 + kMaxRecord + 2;
+static constexpr size_t kMaxFrame = 2 + kMaxRaw + kMaxRaw / 254 + 1;
+
+// 组帧：0x00 | COBS(头 + 记录 + CRC) | 0x00；返回帧长（记录超长返回 0）
+static size_t buildFrame(uint8_t schema, const void *record, size_t len, uint8_t *frame) {
+  uint8_t raw[kMaxRaw];
+  if (len > kMaxRecord) {
+    return 0;
+  }
+  raw[0] = kVersion;
+  raw[1] = schema;
+  raw[2] = static_cast<uint8_t>(g_seq & 0xFF);
+  raw[3] = static_cast<uint8_t>(g_seq >> 8);
+  g_seq++;
+  memcpy(raw + 4, record, len);
+  uint16_t crc = crc16(raw, 4 + len);
+  raw[4 + len] = static_cast<uint8_t>(crc & 0xFF);
+  raw[5 + len] = static_cast<uint8_t>(crc >> 8);
+  frame[0] = 0x00;
+  size_t n = cobsEncode(raw, 6 + len, frame + 1);
+  frame[1 + n] = 0x00;
+  return n + 2;
+}
+
+// 组帧并经遥测通道发送一条记录
+void sendRecord(uint8_t schema, const void *record, size_t len) {
+  uint8_t frame[kMaxFrame];
+  size_t n = buildFrame(schema, record, len, frame);
+  if (n > 0) {
+    telemetryWrite(frame, n);
+    g_framesSent++;
+  }
+}
+
+// 组帧并写到指定端口（导出类命令，不走遥测环、不丢帧）
+void sendRecordTo(Print &out, uint8_t schema, const void *record, size_t len) {
+  uint8_t frame[kMaxFrame];
+  size_t n = buildFrame(schema, record, len, frame);
+  if (n > 0) {
+    out.write(frame, n);
+  }
+}
+
+bool enabled() {
+  return g_enabled;
+}
+
+void setEnabled(bool on) {
+  g_enabled = on;
+}
+
+uint32_t framesSent() {
+  return g_framesSent;
+}
+
+static inline int16_t q16(float v, float scale) {
+  float x = v * scale;
+  if (x > 32767.0f) return 32767;
+  if (x < -32768.0f) return -32768;
+  return static_cast<int16_t>(lroundf(x));
+}
+
+static inline uint16_t uq16(float v, float scale) {
+  float x = v * scale;
+  if (x > 65535.0f) return 65535;
+  if (x < 0.0f) return 0;
+  return static_cast<uint16_t>(lroundf(x));
+}
+
+}  // namespace BinTelem
+
+// ============================================================================
+// 遥测通道注册表：每个通道声明一次（名称、类型、数据源、缩放），上位机按位图订阅、按通道抽取
+// ============================================================================
+// sendGaitData 每次调用为一个遥测节拍；通道 i 在 (节拍 % decim[i]) == 0 时输出，"t" 始终输出。
+// JSON 与二进制两种格式都只序列化本节拍到期的已订阅通道。
+// 预设：all（调参，全部通道）、clinical（临床会话 8 通道，蓝牙开启时默认）。
+// 通道序号即位图位号与二进制帧中的排列顺序；追加通道只能加在表尾，并同步 pc/telemetry_codec.py。
+namespace Telem {
+
+enum ChType : uint8_t { CH_I16 = 0, CH_U16, CH_U8 };
+
+struct Channel {
+  const char *name;
+  ChType type;
+  float scale;         // 二进制定点缩放（值 × scale 后取整）
+  uint8_t decimals;    // JSON 小数位（0 = 整数）
+  float (*get)();
+};
+
+static const Channel kChannels[] = {
+    {"h", CH_I16, 100.0f, 2, [] { return getHipDeg(); }},
+    {"hf", CH_I16, 100.0f, 2, [] { return hipProcessor.initialized ? hipProcessor.hip_f : getHipDeg(); }},
+    {"hvf", CH_I16, 10.0f, 2, [] { return hipProcessor.initialized ? hipProcessor.hip_vel_f : 0.0f; }},
+    {"phase", CH_U8, 1.0f, 0, [] { return gaitPhaseDetector.initialized ? (float)gaitPhaseDetector.currentPhase : 0.0f; }},
+    {"s", CH_U16, 1000.0f, 3, [] { return swingProgress.initialized ? swingProgress.swing_progress : 0.0f; }},
+    {"a", CH_I16, 100.0f, 2, [] { return getAnkleDeg(); }},
+    {"ar", CH_I16, 100.0f, 2, [] { return ankleAssist.initialized ? getAnkleReferenceAngle() : getAnkleDeg(); }},
+    {"act", CH_U8, 1.0f, 0, [] { return controlLoop.anklePositionActive ? 1.0f : 0.0f; }},
+    {"hm", CH_I16, 100.0f, 2, [] { return gaitPhaseDetector.initialized ? gaitPhaseDetector.hip_max_last : 0.0f; }},
+    {"ph4", CH_U8, 1.0f, 0, [] { return phase4Det.initialized ? (float)getCurrentGaitPhase4() : 0.0f; }},
+    {"ph4v", CH_U8, 1.0f, 0, [] { return phase4Det.initialized ? (float)getCurrentGaitPhase4() * 10.0f : 0.0f; }},
+    {"ph4p", CH_U16, 1000.0f, 3, [] { return phase4Det.initialized ? getPhase4Progress() : 0.0f; }},
+    {"ph4o", CH_U16, 1000.0f, 3, [] { return phase4Det.initialized ? getPhase4ProfileOutput() : 0.0f; }},
+    {"ph4d", CH_U8, 1.0f, 0, [] { return (phase4Det.initialized && isPhase4Degraded()) ? 1.0f : 0.0f; }},
+    {"ph4tc", CH_U8, 1.0f, 0, [] { return phase4Det.initialized ? (float)phase4Det.transitionCount : 0.0f; }},
+    // 上位机现有 "ph" 曲线直接显示四相放大值（同 ph4v）
+    {"ph", CH_U8, 1.0f, 0, [] { return phase4Det.initialized ? (float)getCurrentGaitPhase4() * 10.0f : 0.0f; }},
+    {"st", CH_U16, 1000.0f, 3, [] { return assistDbg.stance_pct; }},
+    {"ank", CH_I16, 100.0f, 2, [] { return assistDbg.ankle_deg; }},
+    {"v", CH_I16, 10.0f, 2, [] { return assistDbg.ankle_vel_f; }},
+    {"hip", CH_I16, 100.0f, 2, [] { return assistDbg.hip_deg; }},
+    {"hipv", CH_I16, 10.0f, 2, [] { return assistDbg.hip_vel_f; }},
+    {"iqT_a", CH_I16, 1.0f, 0, [] { return (float)assistDbg.ankle_iq_target; }},
+    {"iqC_a", CH_I16, 1.0f, 0, [] { return (float)assistDbg.ankle_iq_cmd; }},
+    {"iqT_h", CH_I16, 1.0f, 0, [] { return (float)assistDbg.hip_iq_target; }},
+    {"iqC_h", CH_I16, 1.0f, 0, [] { return (float)assistDbg.hip_iq_cmd; }},
+    {"PF", CH_U8, 1.0f, 0, [] { return (float)assistDbg.pf; }},
+    {"DF", CH_U8, 1.0f, 0, [] { return (float)assistDbg.df; }},
+    {"UL", CH_U8, 1.0f, 0, [] { return (float)assistDbg.ul; }},
+    {"comp", CH_U8, 1.0f, 0, [] { return (float)assistDbg.comp; }},
+    {"cool", CH_U8, 1.0f, 0, [] { return (float)assistDbg.cool; }},
+    {"abn", CH_U8, 1.0f, 0, [] { return (float)assistDbg.abn; }},
+    {"bus", CH_U16, 10.0f, 1, [] { return BusStat::utilizationPct(); }},
+    {"age_h", CH_U16, 10.0f, 1, [] { return PollSched::sampleAgeUs(hipMotor) / 1000.0f; }},
+    {"age_a", CH_U16, 10.0f, 1, [] { return PollSched::sampleAgeUs(ankleMotor) / 1000.0f; }},
+};
+
+static constexpr uint8_t kChannelCount = sizeof(kChannels) / sizeof(kChannels[0]);
+static constexpr uint8_t kMaskBytes = (kChannelCount + 7) / 8;
+static_assert(kChannelCount <= 64, "subscription mask is 64 bits");
+
+static constexpr uint64_t kMaskAll = (kChannelCount == 64) ? ~0ull : ((1ull << kChannelCount) - 1);
+
+// 二进制记录最坏情况：全部通道订阅且按 2 字节计（CH_U8 实际 1 字节）
+static_assert(4 + kMaskBytes + 2 * kChannelCount <= BinTelem::kMaxRecord, "channel record exceeds kMaxRecord");
+
+static uint64_t g_subMask = kMaskAll;
+static bool g_userMask = false;   // 用户已用 tlm sub 指定订阅：bt on/off 不再改动
+static bool g_btPreset = false;   // 当前订阅为 bt on 自动套用的临床预设
+static uint8_t g_decim[kChannelCount];
+static uint32_t g_tick = 0;
+
+// 命令行已整体转小写，按名查找不区分大小写（iqT_a / PF 等混合大小写通道名；现有名称互不冲突）
+int8_t indexOf(const char *name) {
+  for (uint8_t i = 0; i < kChannelCount; ++i) {
+    if (strcasecmp(kChannels[i].name, name) == 0) {
+      return static_cast<int8_t>(i);
+    }
+  }
+  return -1;
+}
+
+// 临床会话：角度、四相、踝/髋指令电流（8 通道）
+uint64_t clinicalMask() {
+  static const char *const kNames[] = {"h", "a", "s", "ank", "ph", "ph4d", "iqC_a", "iqC_h"};
+  uint64_t m = 0;
+  for (const char *n : kNames) {
+    int8_t i = indexOf(n);
+    if (i >= 0) {
+      m |= 1ull << i;
+    }
+  }
+  return m;
+}
+
+// 用户订阅（tlm sub）
+void setMask(uint64_t m) {
+  g_subMask = m & kMaskAll;
+  g_userMask = true;
+  g_btPreset = false;
+}
+
+// 蓝牙开关：未自定义订阅时 bt on 套用临床预设，bt off 撤销该预设；用户订阅保持不变
+void onBluetooth(bool on) {
+  if (on && !g_userMask) {
+    g_subMask = clinicalMask();
+    g_btPreset = true;
+  } else if (!on && g_btPreset) {
+    g_subMask = kMaskAll;
+    g_btPreset = false;
+  }
+}
+
+uint64_t mask() {
+  return g_subMask;
+}
+
+bool setDecimation(uint8_t idx, uint8_t n) {
+  if (idx >= kChannelCount || n == 0) {
+    return false;
+  }
+  g_decim[idx] = n;
+  return true;
+}
+
+static uint8_t decimOf(uint8_t i) {
+  return g_decim[i] ? g_decim[i] : 1;
+}
+
+// 本节拍到期的已订阅通道位图
+static uint64_t dueMask(uint32_t tick) {
+  uint64_t due = 0;
+  for (uint8_t i = 0; i < kChannelCount; ++i) {
+    if ((g_subMask & (1ull << i)) && (tick % decimOf(i)) == 0) {
+      due |= 1ull << i;
+    }
+  }
+  return due;
+}
+
+static void sendBinary(uint32_t now, uint64_t due) {
+  uint8_t rec[BinTelem::kMaxRecord];
+  size_t n = 0;
+  memcpy(rec, &now, 4);
+  n += 4;
+  for (uint8_t b = 0; b < kMaskBytes; ++b) {
+    rec[n++] = static_cast<uint8_t>(due >> (8 * b));
+  }
+  for (uint8_t i = 0; i < kChannelCount; ++i) {
+    if (!(due & (1ull << i))) {
+      continue;
+    }
+    const Channel &ch = kChannels[i];
+    const float v = ch.get();
+    if (ch.type == CH_U8) {
+      float x = v * ch.scale;
+      rec[n++] = static_cast<uint8_t>(x < 0.0f ? 0 : (x > 255.0f ? 255 : lroundf(x)));
+    } else {
+      uint16_t w = (ch.type == CH_I16) ? static_cast<uint16_t>(BinTelem::q16(v, ch.scale))
+                                       : BinTelem::uq16(v, ch.scale);
+      rec[n++] = static_cast<uint8_t>(w & 0xFF);
+      rec[n++] = static_cast<uint8_t>(w >> 8);
+    }
+  }
+  BinTelem::sendRecord(BinTelem::kSchemaChannels, rec, n);
+}
+
+static const int8_t kLegacyVfIndex = indexOf("hvf");
+
+static void sendJson(uint32_t now, uint64_t due) {
+  char buf[640];
+  Fmt::Writer w(buf, sizeof(buf));
+  w.str("{\"t\":").u32(now);
+  for (uint8_t i = 0; i < kChannelCount; ++i) {
+    if (!(due & (1ull << i))) {
+      continue;
+    }
+    const Channel &ch = kChannels[i];
+    const float v = ch.get();
+    if (ch.decimals == 0) {
+      w.field(ch.name, static_cast<int32_t>(lroundf(v)));
+    } else {
+      w.field(ch.name, v, ch.decimals);
+      if (i == kLegacyVfIndex) {
+        w.field("vf", v, ch.decimals);  // 旧 JSON 键 vf（与 hvf 同值），保留给已有上位机脚本
+      }
+    }
+  }
+  w.str("}\n");
+  if (!w.truncated()) {
+    telemetryWrite(reinterpret_cast<const uint8_t *>(w.c_str()), w.length());
+  }
+}
+
+// 一个遥测节拍：输出到期的已订阅通道
+void emit(uint32_t now) {
+  const uint64_t due = dueMask(g_tick++);
+  if (BinTelem::enabled()) {
+    sendBinary(now, due);
+  } else {
+    sendJson(now, due);
+  }
+}
+
+void printList(Print &out) {
+  static const char *const kTypeNames[] = {"i16", "u16", "u8"};
+  out.printf("Telemetry channels (%u, mask=0x%08lx%08lx):\n", static_cast<unsigned>(kChannelCount),
+             static_cast<unsigned long>(g_subMask >> 32), static_cast<unsigned long>(g_subMask & 0xFFFFFFFFu));
+  for (uint8_t i = 0; i < kChannelCount; ++i) {
+    const Channel &ch = kChannels[i];
+    out.printf("  %2u %-6s %-3s x%-6g decim=%-3u %s\n", static_cast<unsigned>(i), ch.name, kTypeNames[ch.type],
+               static_cast<double>(ch.scale), static_cast<unsigned>(decimOf(i)),
+               (g_subMask & (1ull << i)) ? "SUB" : "-");
+  }
+}
+
+}  // namespace Telem
+
+// ============================================================================
+// 会话记录：每个控制帧一条快照，二进制写入板载 SD（SDIO），与串口链路无关
+// ============================================================================
+// 文件格式、双缓冲与分块写入见 session_rec_format.h（与主机端测试共用）；此处为采集与 SD 后端。
+// 控制帧末尾 capture() 只拷贝；后台槽位 SLOT_REC 每次至多写 1 块 512B 或 flush 一次，
+// SD 卡忙（内部编程/擦除）时跳过本次，不在 loop 中等待卡。
+// 上位机解析：pc/session_record.py（记录布局变更须同步修改）
+namespace SessionRec {
+
+// SD 后端：直接使用 SdFat 文件（SD.sdfs），以便预分配连续簇并查询卡忙状态
+class SdBackend : public Backend {
+ public:
+  bool begin() override {
+    if (!ready_) {
+      ready_ = SD.begin(BUILTIN_SDCARD);
+    }
+    return ready_;
+  }
+  bool exists(const char *name) override { return SD.exists(name); }
+  bool remove(const char *name) override { return SD.remove(name); }
+  bool open(uint8_t slot, const char *name, uint32_t preallocBytes) override {
+    FsFile &f = file_[slot];
+    f = SD.sdfs.open(name, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!f) {
+      return false;
+    }
+    // 预分配连续空间：写入期间不再分配簇/改 FAT；失败（卡剩余空间不足等）时退回普通追加写
+    if (!f.preAllocate(preallocBytes)) {
+      hostPrintf("[REC] Pre-allocation of %lu bytes failed for %s, writing without it\n",
+                 static_cast<unsigned long>(preallocBytes), name);
+    }
+    return true;
+  }
+  bool busy() override { return SD.sdfs.card()->isBusy(); }
+  bool write(uint8_t slot, const uint8_t *data, size_t len) override { return file_[slot].write(data, len) == len; }
+  void flush(uint8_t slot) override { file_[slot].flush(); }
+  void close(uint8_t slot) override {
+    FsFile &f = file_[slot];
+    if (f) {
+      f.truncate();  // 截掉预分配的未用部分
+      f.close();
+    }
+  }
+
+ private:
+  FsFile file_[kFileSlots];
+  bool ready_ = false;
+};
+
+static SdBackend g_sdBackend;
+static Writer g_writer;
+static Backend *g_backend = &g_sdBackend;  // 默认 SD；setBackend() 可替换（未录制时）
+static uint32_t g_serviceMaxUs = 0;
+static uint32_t g_spareRetryMs = 0;  // 备用文件补建失败后的下次重试时刻
+
+void setBackend(Backend *backend) {
+  if (!g_writer.active() && backend != nullptr) {
+    g_backend = backend;
+  }
+}
+
+bool active() {
+  return g_writer.active();
+}
+
+bool start() {
+  g_writer.setBackend(g_backend);
+  if (!g_writer.start(CycleExec::periodUs(), millis(), millis())) {
+    hostPrintf("[REC] %s\n", g_writer.lastError());
+    return false;
+  }
+  g_serviceMaxUs = 0;
+  g_spareRetryMs = millis();
+  return true;
+}
+
+void stop() {
+  g_writer.stop();
+}
+
+static void fillRecord(RecordV1 &r, uint32_t tick, uint32_t tickUs) {
+  auto motor = [tickUs](MotorRec &m, const MotorStatus &s) {
+    m.rawUnits = static_cast<int32_t>(s.raw_units);
+    m.speed = s.speed;
+    m.iq = s.iq;
+    const uint32_t age = tickUs - s.sampleUs;
+    m.ageUs = static_cast<uint16_t>(s.sampleUs == 0 || age > 0xFFFFu ? 0xFFFFu : age);
+    m.temperature = s.temperature;
+    m.motorState = s.motorState;
+    m.errorState = s.errorState;
+    m.enabled = s.enabled ? 1 : 0;
+  };
+  r.tickUs = tickUs;
+  r.tick = tick;
+  motor(r.hip, hipStatus);
+  motor(r.ankle, ankleStatus);
+  r.phase = static_cast<uint8_t>(assistDbg.phase);
+  r.phase4 = static_cast<uint8_t>(assistDbg.phase4);
+  r.abn = assistDbg.abn;
+  r.flags = static_cast<uint8_t>((assistDbg.pf ? 0x01 : 0) | (assistDbg.df ? 0x02 : 0) |
+                                 (assistDbg.ul ? 0x04 : 0) | (assistDbg.comp ? 0x08 : 0) |
+                                 (assistDbg.cool ? 0x10 : 0) | (assistDbg.phase4_degraded ? 0x20 : 0) |
+                                 (controlLoop.controlEnabled ? 0x40 : 0) | (ankleAssist.enabled ? 0x80 : 0));
+  r.swingPct = assistDbg.swing_pct;
+  r.stancePct = assistDbg.stance_pct;
+  r.ankleDeg = assistDbg.ankle_deg;
+  r.ankleVelF = assistDbg.ankle_vel_f;
+  r.hipDeg = assistDbg.hip_deg;
+  r.hipVelF = assistDbg.hip_vel_f;
+  r.ph4Progress = assistDbg.phase4_progress;
+  r.ph4Output = assistDbg.phase4_output;
+  r.ankleIqTarget = assistDbg.ankle_iq_target;
+  r.ankleIqCmd = assistDbg.ankle_iq_cmd;
+  r.hipIqTarget = assistDbg.hip_iq_target;
+  r.hipIqCmd = assistDbg.hip_iq_cmd;
+}
+
+// 控制帧末尾调用：只做内存拷贝
+void capture() {
+  if (!g_writer.active()) {
+    return;
+  }
+  uint32_t tick, tickUs;
+  CycleExec::tickSnapshot(tick, tickUs);
+  RecordV1 r;
+  fillRecord(r, tick, tickUs);
+  g_writer.capture(r);
+}
+
+bool pending() {
+  return g_writer.pending(millis()) || (g_writer.needsSpare() && !controlLoop.controlEnabled);
+}
+
+// 后台槽位：至多写 1 块、关闭 1 个旧文件或 flush 一次。
+// 换文件后用掉的备用文件只在控制循环关闭时补建（预分配要扫 FAT，可达数十 ms）
+void service() {
+  const uint32_t t0 = micros();
+  const Writer::ServiceResult res = g_writer.service(millis());
+  const uint32_t dt = micros() - t0;
+  if (res == Writer::SERVICE_WROTE || res == Writer::SERVICE_FLUSHED || res == Writer::SERVICE_CLOSED) {
+    if (dt > g_serviceMaxUs) {
+      g_serviceMaxUs = dt;
+    }
+  } else if (res == Writer::SERVICE_ERROR) {
+    hostPrintf("[REC] %s, recording stopped (file REC%05lu.BIN)\n", g_writer.lastError(),
+               static_cast<unsigned long>(g_writer.fileIndex()));
+  }
+  // 建失败（卡满等）时每秒最多重试一次，不让每个后台槽位都去扫 FAT
+  if (g_writer.needsSpare() && !controlLoop.controlEnabled &&
+      static_cast<int32_t>(millis() - g_spareRetryMs) >= 0) {
+    if (g_writer.prepareSpare()) {
+      hostPrintf("[REC] Spare file REC%05lu.BIN ready\n", static_cast<unsigned long>(g_writer.spareIndex()));
+    } else {
+      g_spareRetryMs = millis() + 1000;
+    }
+  }
+}
+
+void printStatus(Print &out) {
+  out.println("=== Session Recorder ===");
+  out.printf("State: %s  file=REC%05lu.BIN  files=%lu\n", g_writer.active() ? "RECORDING" : "IDLE",
+             static_cast<unsigned long>(g_writer.fileIndex()), static_cast<unsigned long>(g_writer.files()));
+  out.printf("Records: %lu  dropped=%lu  bytes=%lu  write_max=%lu us  busy_skips=%lu  errors=%lu\n",
+             static_cast<unsigned long>(g_writer.records()), static_cast<unsigned long>(g_writer.dropped()),
+             static_cast<unsigned long>(g_writer.fileBytes()), static_cast<unsigned long>(g_serviceMaxUs),
+             static_cast<unsigned long>(g_writer.busySkips()), static_cast<unsigned long>(g_writer.writeErrors()));
+  out.printf("Layout: %u B/record, %u records/block, %u blocks/buffer, prealloc %lu MB/file\n",
+             static_cast<unsigned>(sizeof(RecordV1)), static_cast<unsigned>(kRecordsPerBlock),
+             static_cast<unsigned>(kBlocksPerBuffer), static_cast<unsigned long>(kMaxFileBytes >> 20));
+  if (g_writer.active()) {
+    if (g_writer.spareReady()) {
+      out.printf("Spare: REC%05lu.BIN ready\n", static_cast<unsigned long>(g_writer.spareIndex()));
+    } else {
+      out.printf("Spare: none (created when control loop is off)  unpreallocated_blocks=%lu\n",
+                 static_cast<unsigned long>(g_writer.unpreallocatedBlocks()));
+    }
+  }
+}
+
+}  // namespace SessionRec
+
+// ============================================================================
+// 黑匣子：RAM 环形缓冲保存最近 kCapacity 帧的紧凑快照，故障时冻结，事后经 USB 二进制导出
+// ============================================================================
+// 触发：isSystemError（电机报错急停）、柔顺控制进入 FAULT_SAFE、踝异常检测触发软退出、bb freeze 手动。
+// 自动触发后再记录 kPostTriggerFrames 帧（故障后的响应）才冻结；手动冻结立即生效。
+// 冻结后不再覆盖，直到 bb arm 重新布防。100Hz 下约 10s，1kHz 下约 1s。
+// 角度取自电机最新反馈（控制关闭时同样有效）；速度/相位/iq 取自控制帧快照 assistDbg。
+// 导出：bb dump 经 USB 发送 BinTelem 帧：结构 3（元数据）+ 每帧一个结构 4（序号 + Snapshot），
+// 上位机：pc/blackbox_dump.py（解码见 telemetry_codec.py）
+namespace BlackBox {
+
+enum Reason : uint8_t { REASON_NONE = 0, REASON_SYSTEM_ERROR, REASON_FAULT_SAFE, REASON_ABNORMAL, REASON_MANUAL };
+
+static constexpr uint16_t kCapacity = 1024;
+static constexpr uint16_t kPostTriggerFrames = 100;
+static constexpr uint8_t kSchemaHeader = 3;
+static constexpr uint8_t kSchemaSample = 4;
+
+#pragma pack(push, 1)
+struct Snapshot {
+  uint32_t tickUs;
+  int16_t hipDeg;      // ×100
+  int16_t ankleDeg;    // ×100
+  int16_t hipVel;      // ×10
+  int16_t ankleVel;    // ×10
+  uint8_t phase;
+  uint8_t phase4;
+  uint8_t flags;       // 同 SessionRec::RecordV1::flags
+  uint8_t abn;
+  uint8_t compliance;  // ComplianceState
+  uint8_t hipErr;
+  uint8_t ankleErr;
+  int16_t ankleIqTarget;
+  int16_t ankleIqCmd;
+  int16_t hipIqTarget;
+  int16_t hipIqCmd;
+  uint16_t busPct;     // ×10
+  uint16_t txDropped;  // 以下为累计计数低 16 位
+  uint16_t txFail;
+  uint16_t rxOverflow;
+  uint16_t skipped;
+};
+
+struct DumpHeader {
+  uint8_t reason;
+  uint8_t errorMotorId;
+  uint8_t errorCode;
+  uint8_t frozen;
+  uint16_t count;
+  uint16_t triggerIndex;  // 触发帧在导出序列中的序号（无触发为 0xFFFF）
+  uint32_t triggerMs;
+  uint32_t periodUs;
+  uint16_t snapshotSize;
+};
+#pragma pack(pop)
+
+static Snapshot g_ring[kCapacity];
+static uint16_t g_head = 0;  // 下一写入位置
+static uint16_t g_count = 0;
+static Reason g_reason = REASON_NONE;
+static uint16_t g_postLeft = 0;
+static uint16_t g_triggerPos = 0;
+static uint32_t g_triggerMs = 0;
+static bool g_frozen = false;
+static bool g_prevCompliant = false;
+static bool g_prevFaultSafe = false;
+
+static const char *reasonName(Reason r) {
+  static const char *const kNames[] = {"none", "system_error", "fault_safe", "abnormal", "manual"};
+  return (r <= REASON_MANUAL) ? kNames[r] : "?";
+}
+
+bool frozen() {
+  return g_frozen;
+}
+
+static void announceFrozen() {
+  hostPrintf("[BLACKBOX] Frozen: reason=%s, %u frames (use 'bb dump' over USB, 'bb arm' to re-arm)\n",
+             reasonName(g_reason), static_cast<unsigned>(g_count));
+}
+
+// 记录触发点；自动触发再跑 kPostTriggerFrames 帧后冻结
+void trigger(Reason r) {
+  if (g_reason != REASON_NONE) {
+    return;
+  }
+  g_reason = r;
+  g_triggerMs = millis();
+  g_triggerPos = static_cast<uint16_t>((g_head + kCapacity - 1) % kCapacity);
+  g_postLeft = (r == REASON_MANUAL) ? 0 : kPostTriggerFrames;
+  FwLog::append(FwLog::TAG_BB_FREEZE, r);
+  if (g_postLeft == 0) {
+    g_frozen = true;
+    announceFrozen();
+  }
+}
+
+void arm() {
+  g_head = 0;
+  g_count = 0;
+  g_reason = REASON_NONE;
+  g_postLeft = 0;
+  g_frozen = false;
+}
+
+static void fill(Snapshot &s, uint32_t tickUs) {
+  s.tickUs = tickUs;
+  s.hipDeg = BinTelem::q16(getHipDeg(), 100.0f);
+  s.ankleDeg = BinTelem::q16(getAnkleDeg(), 100.0f);
+  s.hipVel = BinTelem::q16(assistDbg.hip_vel_f, 10.0f);
+  s.ankleVel = BinTelem::q16(assistDbg.ankle_vel_f, 10.0f);
+  s.phase = static_cast<uint8_t>(assistDbg.phase);
+  s.phase4 = static_cast<uint8_t>(assistDbg.phase4);
+  s.flags = static_cast<uint8_t>((assistDbg.pf ? 0x01 : 0) | (assistDbg.df ? 0x02 : 0) |
+                                 (assistDbg.ul ? 0x04 : 0) | (assistDbg.comp ? 0x08 : 0) |
+                                 (assistDbg.cool ? 0x10 : 0) | (assistDbg.phase4_degraded ? 0x20 : 0) |
+                                 (controlLoop.controlEnabled ? 0x40 : 0) | (ankleAssist.enabled ? 0x80 : 0));
+  s.abn = static_cast<uint8_t>(ankleAbn);
+  s.compliance = static_cast<uint8_t>(complianceCtrl.currentState);
+  s.hipErr = hipStatus.errorState;
+  s.ankleErr = ankleStatus.errorState;
+  s.ankleIqTarget = assistDbg.ankle_iq_target;
+  s.ankleIqCmd = assistDbg.ankle_iq_cmd;
+  s.hipIqTarget = assistDbg.hip_iq_target;
+  s.hipIqCmd = assistDbg.hip_iq_cmd;
+  s.busPct = BinTelem::uq16(BusStat::utilizationPct(), 10.0f);
+  s.txDropped = static_cast<uint16_t>(CanTx::droppedTotal());
+  s.txFail = static_cast<uint16_t>(FwLog::canTxFailTotal());
+  s.rxOverflow = static_cast<uint16_t>(CanRx::overflowCount());
+  s.skipped = static_cast<uint16_t>(CycleExec::skippedCount());
+}
+
+// 每个控制帧末尾调用（控制关闭/急停后同样记录）
+void capture() {
+  if (g_frozen) {
+    return;
+  }
+  uint32_t tick, tickUs;
+  CycleExec::tickSnapshot(tick, tickUs);
+  fill(g_ring[g_head], tickUs);
+  g_head = static_cast<uint16_t>((g_head + 1) % kCapacity);
+  if (g_count < kCapacity) {
+    g_count++;
+  }
+
+  if (g_reason == REASON_NONE) {
+    const bool faultSafe = (complianceCtrl.currentState == STATE_FAULT_SAFE);
+    if (isSystemError) {
+      trigger(REASON_SYSTEM_ERROR);
+    } else if (faultSafe && !g_prevFaultSafe) {
+      trigger(REASON_FAULT_SAFE);
+    } else if (ankleSafety.compliant && !g_prevCompliant) {
+      trigger(REASON_ABNORMAL);
+    }
+    g_prevFaultSafe = faultSafe;
+    g_prevCompliant = ankleSafety.compliant;
+  } else if (g_postLeft > 0 && --g_postLeft == 0) {
+    g_frozen = true;
+    announceFrozen();
   }
+}
 
-  // 将全局摆动进度映射到 [0,1] 的局部归一化时间 u
-  // u = 0: 助力开始；u = 1: 助力结束
-  float u = swing_pct / winEnd;
-  if (u < 0.0f) u = 0.0f;
-  if (u > 1.0f) u = 1.0f;
-
-  // 使用半个正弦波作为平滑窗函数：
-  // window(u) = sin(pi * u), 在 u ∈ [0,1] 上从 0 平滑上升到 1 再平滑回到 0
-  const float PI_F = 3.1415926f;
-  float window = sinf(PI_F * u);
-  if (window < 0.0f) window = 0.0f;  // 理论上不会小于0，这里只是防御性处理
+// 分段导出步骤：job.next = 序号，job.last = 帧数，job.arg = 环中起点
+static bool dumpStep(Print &out, HostOut::DumpJob &job) {
+  if (job.next >= job.last) {
+    return false;
+  }
+  const uint16_t i = static_cast<uint16_t>(job.next++);
+  uint8_t rec[2 + sizeof(Snapshot)];
+  rec[0] = static_cast<uint8_t>(i & 0xFF);
+  rec[1] = static_cast<uint8_t>(i >> 8);
+  memcpy(rec + 2, &g_ring[(job.arg + i) % kCapacity], sizeof(Snapshot));
+  BinTelem::sendRecordTo(out, kSchemaSample, rec, sizeof(rec));
+  return job.next < job.last;
+}
 
-  // 助力峰值：由控制杆 hip_cmd_amp 决定，并受 hipAssistMaxIq 限幅
-    // 全局可调节的最大助力强度（以 hipAssistMaxIq 为优先）
-    extern int16_t hipAssistMaxIq;
-    int16_t maxIq = (hipAssistMaxIq > 0) ? hipAssistMaxIq : torqueParams.hipAssistMaxIq;
-  if (maxIq <= 0) {
-    // 若未显式配置，则退回到原有的 iq_hip_flex_max
-    maxIq = torqueParams.iq_hip_flex_max;
+// 按时间顺序导出：元数据立即写出，样本帧由 HostOut 分段写出
+// （冻结前导出会混入导出期间的新帧，故建议先冻结）；端口已有导出在进行时返回 false
+bool dump(HostOut::PortId id) {
+  Print &out = HostOut::replyWriter(id);
+  const uint16_t first = static_cast<uint16_t>((g_head + kCapacity - g_count) % kCapacity);
+  DumpHeader hdr;
+  hdr.reason = g_reason;
+  hdr.errorMotorId = errorMotorId;
+  hdr.errorCode = errorCode;
+  hdr.frozen = g_frozen ? 1 : 0;
+  hdr.count = g_count;
+  hdr.triggerIndex = (g_reason == REASON_NONE)
+                         ? 0xFFFF
+                         : static_cast<uint16_t>((g_triggerPos + kCapacity - first) % kCapacity);
+  hdr.triggerMs = g_triggerMs;
+  hdr.periodUs = CycleExec::periodUs();
+  hdr.snapshotSize = sizeof(Snapshot);
+  if (!HostOut::startDump(id, dumpStep, 0, g_count, first)) {
+    return false;
   }
+  BinTelem::sendRecordTo(out, kSchemaHeader, &hdr, sizeof(hdr));
+  return true;
+}
 
-  int16_t amp = (int16_t)abs(hip_cmd_amp);
-  if (amp <= 0) {
-    amp = maxIq;
-  } else if (amp > maxIq) {
-    amp = maxIq;
+void printStatus(Print &out) {
+  out.println("=== Black Box ===");
+  out.printf("State: %s  frames=%u/%u  reason=%s", g_frozen ? "FROZEN" : (g_reason ? "TRIGGERED" : "ARMED"),
+             static_cast<unsigned>(g_count), static_cast<unsigned>(kCapacity), reasonName(g_reason));
+  if (g_reason != REASON_NONE) {
+    out.printf("  trigger_ms=%lu  post_left=%u", static_cast<unsigned long>(g_triggerMs),
+               static_cast<unsigned>(g_postLeft));
   }
+  out.printf("\nSnapshot: %u B, RAM %lu B\n", static_cast<unsigned>(sizeof(Snapshot)),
+             static_cast<unsigned long>(sizeof(g_ring)));
+}
 
-  // 髋屈为正方向，若实际机械安装相反，可将 sign 改为 -1
-  int16_t sign = 1;
+}  // namespace BlackBox
 
-  // 根据窗函数缩放得到当前时刻的目标电流
-  float iq_f = (float)amp * window;
-  int16_t iq = (int16_t)iq_f;
-  return sign * iq;
-}
+// 事件日志二进制导出：每条一个 BinTelem 结构 5 帧（seq u32 | us u32 | tag u8 | a u8 | b u16 | v i32）
+static constexpr uint8_t kSchemaFwLog = 5;
 
-struct AssistDebugSnapshot {
-  int phase = 0;
-  float swing_pct = 0.0f;
-  float stance_pct = 0.0f;
-  float ankle_deg = 0.0f;
-  float ankle_vel_f = 0.0f;
-  int16_t ankle_iq_target = 0;
-  int16_t ankle_iq_cmd = 0;
-  float hip_deg = 0.0f;
-  float hip_vel_f = 0.0f;
-  int16_t hip_iq_target = 0;
-  int16_t hip_iq_cmd = 0;
-  uint8_t pf = 0, df = 0, ul = 0;
-  uint8_t comp = 0, cool = 0, abn = 0;
-  // 4相快照
-  int     phase4 = 0;
-  float   phase4_progress = 0.0f;
-  float   phase4_output = 0.0f;
-  uint8_t phase4_degraded = 0;
-  uint32_t lastUpdateMs = 0;
-};
+static constexpr uint8_t kFwLogScanPerStep = 64;  // 分段导出每步最多跳过的不匹配/已覆盖条目
 
-AssistDebugSnapshot assistDbg;  // 控制循环内更新，sendGaitData/loop 中读取
+// 分段导出步骤（HostOut::startDump）：每步输出一条，job.next/last 为序号范围，job.arg 为标签掩码
+static bool fwlogTextStep(Print &out, HostOut::DumpJob &job) {
+  FwLog::Entry e;
+  for (uint8_t n = 0; n < kFwLogScanPerStep && job.next <= job.last; ++n) {
+    const uint32_t s = job.next++;
+    if (!FwLog::read(s, e) || !(job.arg & (1u << e.tag))) {
+      continue;
+    }
+    FwLog::printEntry(out, e);
+    job.shown++;
+    return job.next <= job.last;
+  }
+  if (job.next <= job.last) {
+    return true;
+  }
+  if (job.shown == 0) {
+    out.println("(empty)");
+  }
+  return false;
+}
 
-GaitDataCollection gaitCollection = {false, 0, 20}; // 默认20ms间隔（50Hz）
+static bool fwlogBinaryStep(Print &out, HostOut::DumpJob &job) {
+  FwLog::Entry e;
+  for (uint8_t n = 0; n < kFwLogScanPerStep && job.next <= job.last; ++n) {
+    if (!FwLog::read(job.next++, e)) {
+      continue;
+    }
+    uint8_t rec[16];
+    const uint32_t seq = e.seq;
+    memcpy(rec, &seq, 4);
+    memcpy(rec + 4, &e.us, 4);
+    rec[8] = e.tag;
+    rec[9] = e.a;
+    memcpy(rec + 10, &e.b, 2);
+    memcpy(rec + 12, &e.v, 4);
+    BinTelem::sendRecordTo(out, kSchemaFwLog, rec, sizeof(rec));
+    break;
+  }
+  return job.next <= job.last;
+}
 
-// 发送步态数据到串口（固定 JSON schema，便于上位机稳定解析）
-void sendGaitData() {
-  const uint32_t now = millis();
-  const float h = getHipDeg();
-  const float a = getAnkleDeg();
-
-  // 蓝牙模式先发送精简字段，降低带宽压力
-  if (useBluetoothTelemetry) {
-    const int ph = phase4Det.initialized ? ((int)getCurrentGaitPhase4() * 10) : 0;
-    const int ph4d = phase4Det.initialized ? (isPhase4Degraded() ? 1 : 0) : 0;
-    const int iqC_a = (int)assistDbg.ankle_iq_cmd;
-    const int iqC_h = (int)assistDbg.hip_iq_cmd;
-    telemetryPrintf("{\"t\":%lu,\"h\":%.2f,\"ank\":%.2f,\"ph\":%d,\"ph4d\":%d,\"iqC_a\":%d,\"iqC_h\":%d}\n",
-                    now, h, a, ph, ph4d, iqC_a, iqC_h);
-    return;
+// 登记一次文本导出（表头立即写出）；端口已有导出在进行时报错
+static void fwlogStartTextDump(HostOut::PortId id, uint32_t tagMask) {
+  uint32_t first, last;
+  FwLog::printDumpHeader(HostOut::replyWriter(id), first, last);
+  if (!HostOut::startDump(id, fwlogTextStep, first, last, tagMask)) {
+    HostOut::replyWriter(id).println("ERROR: another dump is still in progress on this port");
   }
+}
 
-  const float hf = hipProcessor.initialized ? hipProcessor.hip_f : h;
-  const float hvf = hipProcessor.initialized ? hipProcessor.hip_vel_f : 0.0f;
-  const int phase = gaitPhaseDetector.initialized ? (int)gaitPhaseDetector.currentPhase : 0;
-  const float s = swingProgress.initialized ? swingProgress.swing_progress : 0.0f;
-  const float ar = ankleAssist.initialized ? getAnkleReferenceAngle() : a;
-  const int act = controlLoop.anklePositionActive ? 1 : 0;
-  const float hm = gaitPhaseDetector.initialized ? gaitPhaseDetector.hip_max_last : 0.0f;
-
-  const int ph4 = phase4Det.initialized ? (int)getCurrentGaitPhase4() : 0;
-  const int ph4v = ph4 * 10;  // 0/10/20/30：用于上位机阶梯显示
-  const float ph4p = phase4Det.initialized ? getPhase4Progress() : 0.0f;
-  const float ph4o = phase4Det.initialized ? getPhase4ProfileOutput() : 0.0f;
-  const int ph4d = phase4Det.initialized ? (isPhase4Degraded() ? 1 : 0) : 0;
-
-  // 理论助力链路（当前阶段用于观察，不代表已下发电机）
-  const int iqT_a = (int)assistDbg.ankle_iq_target;
-  const int iqC_a = (int)assistDbg.ankle_iq_cmd;
-  const int iqT_h = (int)assistDbg.hip_iq_target;
-  const int iqC_h = (int)assistDbg.hip_iq_cmd;
-  const int PF = (int)assistDbg.pf;
-  const int DF = (int)assistDbg.df;
-  const int UL = (int)assistDbg.ul;
-  const int comp = (int)assistDbg.comp;
-  const int cool = (int)assistDbg.cool;
-  const int abn = (int)assistDbg.abn;
-  const float st = assistDbg.stance_pct;
-  const float ank = assistDbg.ankle_deg;
-  const float v = assistDbg.ankle_vel_f;
-  const float hip = assistDbg.hip_deg;
-  const float hipv = assistDbg.hip_vel_f;
-  const int ph = ph4v;  // 上位机现有 "ph" 曲线直接显示四相放大值
-  const int ph4tc = phase4Det.initialized ? (int)phase4Det.transitionCount : 0;
-
-  telemetryPrintf(
-      "{\"t\":%lu,\"h\":%.2f,\"hf\":%.2f,\"hvf\":%.2f,\"vf\":%.2f,"
-      "\"phase\":%d,\"s\":%.3f,\"a\":%.2f,\"ar\":%.2f,\"act\":%d,\"hm\":%.2f,"
-      "\"ph4\":%d,\"ph4v\":%d,\"ph4p\":%.3f,\"ph4o\":%.3f,\"ph4d\":%d,\"ph4tc\":%d,"
-      "\"ph\":%d,\"st\":%.3f,\"ank\":%.2f,\"v\":%.2f,\"hip\":%.2f,\"hipv\":%.2f,"
-      "\"iqT_a\":%d,\"iqC_a\":%d,\"iqT_h\":%d,\"iqC_h\":%d,"
-      "\"PF\":%d,\"DF\":%d,\"UL\":%d,\"comp\":%d,\"cool\":%d,\"abn\":%d}\n",
-      now, h, hf, hvf, hvf,
-      phase, s, a, ar, act, hm,
-      ph4, ph4v, ph4p, ph4o, ph4d, ph4tc,
-      ph, st, ank, v, hip, hipv,
-      iqT_a, iqC_a, iqT_h, iqC_h,
-      PF, DF, UL, comp, cool, abn);
+void sendGaitData() {
+  PROF_ZONE(ZONE_SEND_GAIT_DATA);
+  Telem::emit(millis());
 }
 
 // 启动/停止步态数据采集（只控制是否输出JSON）
@@ -3582,6 +7014,7 @@ void updateGaitCollection() {
 }
 
 void sendPhase4RealtimeData() {
+  PROF_ZONE(ZONE_SEND_PHASE4_RT);
   uint32_t now = millis();
   int phase4 = phase4Det.initialized ? (int)phase4Det.currentPhase : -1;
   int basePhase = gaitPhaseDetector.initialized ? (int)gaitPhaseDetector.currentPhase : -1;
@@ -3592,20 +7025,21 @@ void sendPhase4RealtimeData() {
       (now - phase4Det.degradedStartMs) : 0;
 
   // 结构化输出，便于上位机/脚本直接抓取
-  telemetryPrintf("{\"ph4rt\":1,\"t\":%lu,\"init\":%d,\"ph4\":%d,\"p\":%.3f,"
-                "\"out\":%.3f,\"deg\":%d,\"dur\":%lu,\"deg_ms\":%lu,"
-                "\"base\":%d,\"stance\":%.3f,\"trans\":%d}\n",
-                now,
-                phase4Det.initialized ? 1 : 0,
-                phase4,
-                phase4Det.initialized ? phase4Det.phaseProgress : 0.0f,
-                phase4Det.initialized ? phase4Det.profileOutput : 0.0f,
-                phase4Det.degraded ? 1 : 0,
-                phaseDurMs,
-                degradedMs,
-                basePhase,
-                stancePct,
-                phase4Det.transitionCount);
+  char buf[256];
+  Fmt::Writer w(buf, sizeof(buf));
+  w.str("{\"ph4rt\":1,\"t\":").u32(now)
+      .field("init", phase4Det.initialized ? 1 : 0)
+      .field("ph4", phase4)
+      .field("p", phase4Det.initialized ? phase4Det.phaseProgress : 0.0f, 3)
+      .field("out", phase4Det.initialized ? phase4Det.profileOutput : 0.0f, 3)
+      .field("deg", phase4Det.degraded ? 1 : 0)
+      .fieldU("dur", phaseDurMs)
+      .fieldU("deg_ms", degradedMs)
+      .field("base", basePhase)
+      .field("stance", stancePct, 3)
+      .field("trans", static_cast<int32_t>(phase4Det.transitionCount))
+      .str("}\n");
+  telemetryWrite(reinterpret_cast<const uint8_t *>(w.c_str()), w.length());
 }
 
 void updatePhase4RealtimeMonitor() {
@@ -3637,14 +7071,11 @@ void queryAndPrintAnkleIqTs() {
   sendCanCommand(ankleMotor.id, CMD_READ_STATUS2, nullptr, 0, false);
   uint32_t t0 = millis();
   while (millis() - t0 < 80) {
-    CAN_message_t inMsg;
-    while (can1.read(inMsg)) {
-      handleCanMessage(inMsg);
-    }
+    CanRx::dispatch();
     if (ankleStatus.lastUpdateMs > 0 && (millis() - ankleStatus.lastUpdateMs) < 120) {
       break;
     }
-    delay(5);
+    CanTx::serviceFor(5);
   }
 
   int16_t iqRaw = ankleStatus.iq;
@@ -3657,14 +7088,11 @@ void queryAndPrintHipIqTs() {
   sendCanCommand(hipMotor.id, CMD_READ_STATUS2, nullptr, 0, false);
   uint32_t t0 = millis();
   while (millis() - t0 < 80) {
-    CAN_message_t inMsg;
-    while (can1.read(inMsg)) {
-      handleCanMessage(inMsg);
-    }
+    CanRx::dispatch();
     if (hipStatus.lastUpdateMs > 0 && (millis() - hipStatus.lastUpdateMs) < 120) {
       break;
     }
-    delay(5);
+    CanTx::serviceFor(5);
   }
 
   int16_t iqRaw = hipStatus.iq;
@@ -3674,16 +7102,19 @@ void queryAndPrintHipIqTs() {
 }
 
 void printA1Params() {
-  hostPrintln(">>> A1 tunable params:");
-  hostPrintf(">>>   ankle_df_th=%.2f deg (range: 0.0~40.0)\n", torqueParams.ankle_df_th);
-  hostPrintf(">>>   hip_ext_th=%.2f deg (range: -40.0~20.0)\n", torqueParams.hip_ext_th);
-  hostPrintf(">>>   pushoff_max_ms=%lu ms (range: 50~1000)\n", (unsigned long)torqueParams.pushoff_max_ms);
-  hostPrintf(">>>   ankle_pf_target_deg=%.2f deg (range: -10.0~30.0, must < ankle_df_th)\n",
-                torqueParams.ankle_pf_target_deg);
-  hostPrintf(">>>   iq_pf_max=%d (range: 1~2000)\n", (int)torqueParams.iq_pf_max);
-  hostPrintf(">>>   iq_pf_floor=%d (range: 0~2000, must <= iq_pf_max)\n", (int)torqueParams.iq_pf_floor);
-  hostPrintf(">>>   diq_up_pf=%d (range: 1~1000)\n", (int)torqueParams.diq_up_pf);
-  hostPrintf(">>>   ankleBypassSafety=%d (0=安全管线, 1=旁路/测试)\n", torqueParams.ankleBypassSafety ? 1 : 0);
+  char buf[512];
+  Fmt::Writer w(buf, sizeof(buf));
+  w.str(">>> A1 tunable params:\n");
+  w.str(">>>   ankle_df_th=").fixed(torqueParams.ankle_df_th, 2).str(" deg (range: 0.0~40.0)\n");
+  w.str(">>>   hip_ext_th=").fixed(torqueParams.hip_ext_th, 2).str(" deg (range: -40.0~20.0)\n");
+  w.str(">>>   pushoff_max_ms=").u32(torqueParams.pushoff_max_ms).str(" ms (range: 50~1000)\n");
+  w.str(">>>   ankle_pf_target_deg=").fixed(torqueParams.ankle_pf_target_deg, 2)
+      .str(" deg (range: -10.0~30.0, must < ankle_df_th)\n");
+  w.str(">>>   iq_pf_max=").i32(torqueParams.iq_pf_max).str(" (range: 1~2000)\n");
+  w.str(">>>   iq_pf_floor=").i32(torqueParams.iq_pf_floor).str(" (range: 0~2000, must <= iq_pf_max)\n");
+  w.str(">>>   diq_up_pf=").i32(torqueParams.diq_up_pf).str(" (range: 1~1000)\n");
+  w.str(">>>   ankleBypassSafety=").i32(torqueParams.ankleBypassSafety ? 1 : 0).str(" (0=安全管线, 1=旁路/测试)\n");
+  hostWrite(w.c_str(), w.length());
 }
 
 bool setA1Param(const String& name, const String& valueStr) {
@@ -3828,34 +7259,132 @@ bool getA1Param(const String& name) {
   return false;
 }
 
+// ============================================================================
+// 串口命令行组装（非阻塞：每圈只读已到达的字节，固定缓冲，不分配堆）
+// ============================================================================
+// 原实现 readStringUntil('\n') 在半行到达时会阻塞至换行或 1s 流超时，期间 loop 与控制帧全部停住。
+// 现每个端口一个组装器，每圈最多消费 kLineMaxBytesPerPoll 字节，凑满一行才交给命令解析。
+// 超长行：接收步态数据（gaitDataReceive）时按块交出（该路径本身按花括号拼接）；否则整行丢弃并报错。
+static constexpr uint16_t kLineCap = 256;
+static constexpr uint16_t kLineMaxBytesPerPoll = 64;
+
+struct LineAssembler {
+  char buf[kLineCap];
+  uint16_t len;
+  bool discarding;     // 超长行：丢弃到下一个换行
+  bool chunked;        // 当前行已按块交出过前段（行尾这段不去首部空白）
+  uint32_t overflows;  // 超长丢弃的行数
+};
+
+static LineAssembler s_usbLine = {};
+static LineAssembler s_btLine = {};
+
+enum LineStatus : uint8_t { LINE_NONE = 0, LINE_READY, LINE_CHUNK, LINE_OVERFLOW };
+
+static LineStatus pollLine(Stream &port, LineAssembler &la) {
+  int avail = port.available();
+  if (avail > kLineMaxBytesPerPoll) {
+    avail = kLineMaxBytesPerPoll;
+  }
+  while (avail-- > 0) {
+    int c = port.read();
+    if (c < 0) {
+      break;
+    }
+    if (c == '\n') {
+      if (la.discarding) {
+        la.discarding = false;
+        la.len = 0;
+        continue;
+      }
+      la.buf[la.len] = '\0';
+      la.len = 0;
+      return LINE_READY;
+    }
+    if (c == '\r' || la.discarding) {
+      continue;
+    }
+    la.buf[la.len++] = static_cast<char>(c);
+    if (la.len == kLineCap - 1) {
+      la.buf[la.len] = '\0';
+      if (gaitDataReceive.receiving) {
+        la.len = 0;
+        return LINE_CHUNK;
+      }
+      la.len = 0;
+      la.discarding = true;
+      la.overflows++;
+      return LINE_OVERFLOW;
+    }
+  }
+  return LINE_NONE;
+}
+
+// 原地去掉首尾空白（同 String::trim），返回首个非空白字符
+static char *trimLine(char *buf, bool keepLeading) {
+  size_t n = strlen(buf);
+  while (n > 0 && isspace(static_cast<unsigned char>(buf[n - 1]))) {
+    buf[--n] = '\0';
+  }
+  char *p = buf;
+  while (!keepLeading && isspace(static_cast<unsigned char>(*p))) {
+    ++p;
+  }
+  return p;
+}
+
 // ============================================================================
 // 串口命令处理
 // ============================================================================
 
 void processSerialCommand() {
-  Stream* lineSrc = nullptr;
-  if (Serial.available()) {
-    lineSrc = &Serial;
-  } else if (BT_SERIAL.available()) {
+  Stream* lineSrc = &Serial;
+  LineAssembler* la = &s_usbLine;
+  LineStatus lineStatus = pollLine(Serial, s_usbLine);
+  if (lineStatus == LINE_NONE) {
     lineSrc = &BT_SERIAL;
-  } else {
+    la = &s_btLine;
+    lineStatus = pollLine(BT_SERIAL, s_btLine);
+  }
+  if (lineStatus == LINE_NONE) {
+    return;
+  }
+  if (lineStatus == LINE_OVERFLOW) {
+    CmdReplyScope replyScope(lineSrc);
+    hostPrintf("ERROR: Command line too long (>%u bytes), discarded\n", static_cast<unsigned>(kLineCap - 1));
     return;
   }
 
-  String line = lineSrc->readStringUntil('\n');
-  line.trim();
+  // 超长步态数据行的中间块：原样交出，不去空白（块边界上的空白属于数据本身）
+  if (lineStatus == LINE_CHUNK) {
+    la->chunked = true;
+    CmdReplyScope replyScope(lineSrc);
+    processReceivedGaitData(la->buf);
+    return;
+  }
 
-  if (line.length() == 0) return;
+  const bool tailOfChunked = la->chunked;
+  la->chunked = false;
+  const char *line = trimLine(la->buf, tailOfChunked && gaitDataReceive.receiving);
+  const size_t lineLen = strlen(line);
+
+  if (lineLen == 0) return;
 
   CmdReplyScope replyScope(lineSrc);
 
-  // 如果正在接收步态数据，将数据传递给处理函数
+  // 如果正在接收步态数据，将数据传递给处理函数（数据行不记 TAG_CMD，免得冲掉事件日志）
   if (gaitDataReceive.receiving) {
     processReceivedGaitData(line);
     return;
   }
 
-  String cmd = line;
+  int32_t head = 0;
+  memcpy(&head, line, lineLen < 4 ? lineLen : 4);
+  FwLog::append(FwLog::TAG_CMD, lineSrc == &BT_SERIAL ? 1 : 0,
+                static_cast<uint16_t>(lineLen), head);
+
+  // 下面的命令分派按 String 比较/截取参数，只在这里为命令行建一次 String
+  String cmd(line);
   cmd.toLowerCase();
 
   hostPrintf("> Command: %s\n", cmd.c_str());
@@ -3914,16 +7443,13 @@ void processSerialCommand() {
     bool hipOk = false, ankleOk = false;
     while (millis() - t_start < statusTimeoutMs) {
       // 处理CAN消息队列
-      CAN_message_t inMsg;
-      while (can1.read(inMsg)) {
-        handleCanMessage(inMsg);
-      }
+      CanRx::dispatch();
       // 检查数据新鲜性
       uint32_t now = millis();
       hipOk = (hipStatus.lastUpdateMs > 0) && ((now - hipStatus.lastUpdateMs) < 300);
       ankleOk = (ankleStatus.lastUpdateMs > 0) && ((now - ankleStatus.lastUpdateMs) < 300);
       if (hipOk && ankleOk) break;
-      delay(10);
+      CanTx::serviceFor(10);
     }
 
     // 再次确认
@@ -3940,21 +7466,30 @@ void processSerialCommand() {
     }
 
     // 数据新鲜，输出信息
-    hostPrintln("\n=== Motor Status ===");
-    hostPrintf("Hip:   angle=%.2f deg (logical, raw=%lld units), speed=%d dps, enabled=%d, state=0x%02X\n",
-                  getHipDeg(), static_cast<long long>(getHipRawUnits()),
-                  hipStatus.speed, hipStatus.enabled, hipStatus.motorState);
-    hostPrintf("Ankle: angle=%.2f deg (logical, raw=%lld units), speed=%d dps, enabled=%d, state=0x%02X\n",
-                  getAnkleDeg(), static_cast<long long>(getAnkleRawUnits()),
-                  ankleStatus.speed, ankleStatus.enabled, ankleStatus.motorState);
+    char buf[512];
+    Fmt::Writer w(buf, sizeof(buf));
+    w.str("\n=== Motor Status ===\n");
+    w.str("Hip:   angle=").fixed(getHipDeg(), 2)
+        .str(" deg (logical, raw=").i64(getHipRawUnits())
+        .str(" units), speed=").i32(hipStatus.speed)
+        .str(" dps, enabled=").i32(hipStatus.enabled)
+        .str(", state=0x").hex2(hipStatus.motorState).ch('\n');
+    w.str("Ankle: angle=").fixed(getAnkleDeg(), 2)
+        .str(" deg (logical, raw=").i64(getAnkleRawUnits())
+        .str(" units), speed=").i32(ankleStatus.speed)
+        .str(" dps, enabled=").i32(ankleStatus.enabled)
+        .str(", state=0x").hex2(ankleStatus.motorState).ch('\n');
+    hostWrite(w.c_str(), w.length());
 
     // 显示髋关节信号预处理状态
     if (hipProcessor.initialized) {
-      hostPrintln("\n=== Hip Signal Processing ===");
-      hostPrintf("Raw angle:     %.2f deg (logical)\n", getHipDeg());
-      hostPrintf("Filtered:      %.2f deg\n", hipProcessor.hip_f);
-      hostPrintf("Velocity:      %.2f deg/s\n", hipProcessor.hip_vel);
-      hostPrintf("Vel filtered:  %.2f deg/s\n", hipProcessor.hip_vel_f);
+      Fmt::Writer hw(buf, sizeof(buf));
+      hw.str("\n=== Hip Signal Processing ===\n");
+      hw.str("Raw angle:     ").fixed(getHipDeg(), 2).str(" deg (logical)\n");
+      hw.str("Filtered:      ").fixed(hipProcessor.hip_f, 2).str(" deg\n");
+      hw.str("Velocity:      ").fixed(hipProcessor.hip_vel, 2).str(" deg/s\n");
+      hw.str("Vel filtered:  ").fixed(hipProcessor.hip_vel_f, 2).str(" deg/s\n");
+      hostWrite(hw.c_str(), hw.length());
     } else {
       hostPrintln("\n=== Hip Signal Processing ===");
       hostPrintln("Not initialized (need hip angle data)");
@@ -3995,15 +7530,77 @@ void processSerialCommand() {
   // 蓝牙遥测开关：bt / bt on / bt off
   else if (cmd == "bt" || cmd == "bt status") {
     hostPrintf(">>> Bluetooth telemetry: %s\n",
-               useBluetoothTelemetry ? "ON (compact payload: t,h,a)" : "OFF (USB full payload)");
+               useBluetoothTelemetry ? "ON" : "OFF (USB)");
   }
   else if (cmd == "bt on" || cmd == "bton") {
+    // 蓝牙带宽有限：未自定义订阅时切到临床通道集，仍可用 tlm sub 改订阅
     useBluetoothTelemetry = true;
-    hostPrintln(">>> Bluetooth telemetry ENABLED (compact payload: t,h,a)");
+    Telem::onBluetooth(true);
+    const uint64_t m = Telem::mask();
+    hostPrintf(">>> Bluetooth telemetry ENABLED (channels: %s, mask=0x%08lx%08lx)\n",
+               m == Telem::clinicalMask() ? "clinical preset" : "user subscription",
+               static_cast<unsigned long>(m >> 32), static_cast<unsigned long>(m & 0xFFFFFFFFu));
   }
   else if (cmd == "bt off" || cmd == "btoff") {
     useBluetoothTelemetry = false;
-    hostPrintln(">>> Bluetooth telemetry DISABLED (USB full payload)");
+    Telem::onBluetooth(false);
+    const uint64_t m = Telem::mask();
+    hostPrintf(">>> Bluetooth telemetry DISABLED (USB, mask=0x%08lx%08lx)\n",
+               static_cast<unsigned long>(m >> 32), static_cast<unsigned long>(m & 0xFFFFFFFFu));
+  }
+  // 遥测格式：tlm / tlm bin / tlm json（二进制帧格式见 BinTelem，上位机解码 pc/telemetry_codec.py）
+  else if (cmd == "tlm") {
+    const uint64_t m = Telem::mask();
+    hostPrintf(">>> Telemetry format: %s (binary frames sent=%lu), mask=0x%08lx%08lx\n",
+               BinTelem::enabled() ? "BINARY (COBS, schema 2)" : "JSON",
+               static_cast<unsigned long>(BinTelem::framesSent()),
+               static_cast<unsigned long>(m >> 32), static_cast<unsigned long>(m & 0xFFFFFFFFu));
+  }
+  // 遥测通道订阅：tlm list / tlm sub all|clinical|<hexmask> / tlm dec <name|idx> <n>
+  else if (cmd == "tlm list") {
+    Telem::printList(cmdReplyPort ? *cmdReplyPort : Serial);
+  }
+  else if (cmd.startsWith("tlm sub ")) {
+    String arg = cmd.substring(8);
+    arg.trim();
+    if (arg == "all") {
+      Telem::setMask(Telem::kMaskAll);
+    } else if (arg == "clinical") {
+      Telem::setMask(Telem::clinicalMask());
+    } else {
+      if (arg.startsWith("0x")) {
+        arg = arg.substring(2);
+      }
+      Telem::setMask(strtoull(arg.c_str(), nullptr, 16));
+    }
+    const uint64_t m = Telem::mask();
+    hostPrintf(">>> Telemetry mask=0x%08lx%08lx\n",
+               static_cast<unsigned long>(m >> 32), static_cast<unsigned long>(m & 0xFFFFFFFFu));
+  }
+  else if (cmd.startsWith("tlm dec ")) {
+    String rest = cmd.substring(8);
+    rest.trim();
+    int sp = rest.indexOf(' ');
+    if (sp < 0) {
+      hostPrintln("ERROR: Usage: tlm dec <name|idx> <n>");
+    } else {
+      String key = rest.substring(0, sp);
+      int n = rest.substring(sp + 1).toInt();
+      int idx = (key.length() > 0 && isdigit(static_cast<unsigned char>(key.charAt(0)))) ? key.toInt() : Telem::indexOf(key.c_str());
+      if (idx < 0 || n < 1 || n > 255 || !Telem::setDecimation(static_cast<uint8_t>(idx), static_cast<uint8_t>(n))) {
+        hostPrintln("ERROR: Unknown channel or decimation out of range (1-255)");
+      } else {
+        hostPrintf(">>> Channel %s: every %d frame(s)\n", Telem::kChannels[idx].name, n);
+      }
+    }
+  }
+  else if (cmd == "tlm bin") {
+    BinTelem::setEnabled(true);
+    hostPrintln(">>> Telemetry format: BINARY (COBS + CRC16, full record on USB and Bluetooth)");
+  }
+  else if (cmd == "tlm json") {
+    BinTelem::setEnabled(false);
+    hostPrintln(">>> Telemetry format: JSON");
   }
   // 步态轨迹播放命令：
   //   - gp <freq>            ：只指定周期频率，最大速度由程序根据轨迹自动计算，保证尽量走完整幅度
@@ -4046,13 +7643,8 @@ void processSerialCommand() {
   else if (cmd == "az" || cmd == "anklezero") {
     // 先读取当前踝关节角度
     requestMotorAngle(ankleMotor);
-    delay(50);  // 等待回复
-    {
-      CAN_message_t inMsg;
-      while (can1.read(inMsg)) {
-        handleCanMessage(inMsg);
-      }
-    }
+    CanTx::serviceFor(50);  // 等待回复
+    CanRx::dispatch();
     
     // 如果成功读取到角度，保存为零点偏移
     if (ankleStatus.lastUpdateMs > 0 && 
@@ -4074,13 +7666,8 @@ void processSerialCommand() {
   else if (cmd == "hz" || cmd == "hipzero") {
     // 先读取当前髋关节角度
     requestMotorAngle(hipMotor);
-    delay(50);  // 等待回复
-    {
-      CAN_message_t inMsg;
-      while (can1.read(inMsg)) {
-        handleCanMessage(inMsg);
-      }
-    }
+    CanTx::serviceFor(50);  // 等待回复
+    CanRx::dispatch();
     
     // 如果成功读取到角度，保存为参考姿态偏移
     if (hipStatus.lastUpdateMs > 0 && 
@@ -4101,9 +7688,13 @@ void processSerialCommand() {
   else if (cmd == "th" || cmd == "threshold") {
     if (adaptiveThreshold.initialized) {
       hostPrintln(">>> Adaptive Threshold Status:");
-      hostPrintf(">>>   Window: %d/%d samples\n", adaptiveThreshold.windowCount, HIP_WINDOW_SIZE);
-      hostPrintf(">>>   Hip Mean: %.2f deg\n", adaptiveThreshold.hip_mean);
-      hostPrintf(">>>   Hip Amplitude: %.2f deg\n", adaptiveThreshold.hip_amp);
+      const SlidingWindowStats<HIP_WINDOW_SIZE> &win = adaptiveThreshold.window;
+      hostPrintf(">>>   Window: %d/%d samples\n", win.count(), HIP_WINDOW_SIZE);
+      hostPrintf(">>>   Hip Mean: %.2f deg (std %.2f)\n", adaptiveThreshold.hip_mean, win.stddev());
+      hostPrintf(">>>   Hip Amplitude: %.2f deg (min %.2f, max %.2f)\n", adaptiveThreshold.hip_amp,
+                 win.minValue(), win.maxValue());
+      hostPrintf(">>>   Hip P10/P50/P90: %.2f / %.2f / %.2f deg\n", win.percentile(0.1f), win.percentile(0.5f),
+                 win.percentile(0.9f));
       hostPrintf(">>>   A_up: %.2f deg\n", adaptiveThreshold.A_up);
       hostPrintf(">>>   A_dn: %.2f deg\n", adaptiveThreshold.A_dn);
       hostPrintf(">>>   V_up: %.2f deg/s\n", adaptiveThreshold.V_up);
@@ -4120,6 +7711,95 @@ void processSerialCommand() {
       hostPrintln(">>> Start gait collection (gc) to initialize threshold calculation");
     }
   }
+  // 关节状态估计器：est / est reset / est <hip|ank> q|r|rv <v> / est <hip|ank> spd on|off
+  else if (cmd == "est" || cmd.startsWith("est ")) {
+    if (cmd == "est reset") {
+      hipEst.initialized = false;
+      ankleEst.initialized = false;
+      hipProcessor.initialized = false;
+      ankleVel.initialized = false;
+      hostPrintln(">>> Estimators reset (re-initialize on next sample)");
+      return;
+    }
+    if (cmd.startsWith("est ")) {
+      String rest = cmd.substring(4);
+      rest.trim();
+      int sp1 = rest.indexOf(' ');
+      int sp2 = (sp1 < 0) ? -1 : rest.indexOf(' ', sp1 + 1);
+      if (sp1 < 0 || sp2 < 0) {
+        hostPrintln("ERROR: Usage: est <hip|ank> q|r|rv <value> | est <hip|ank> spd on|off | est reset");
+        return;
+      }
+      String joint = rest.substring(0, sp1);
+      String key = rest.substring(sp1 + 1, sp2);
+      String val = rest.substring(sp2 + 1);
+      val.trim();
+      JointEstimatorTuning *t = nullptr;
+      if (joint == "hip") t = &hipEstTuning;
+      else if (joint == "ank" || joint == "ankle") t = &ankleEstTuning;
+      if (t == nullptr) {
+        hostPrintln("ERROR: Joint must be hip or ank");
+        return;
+      }
+      if (key == "spd") {
+        t->useMotorSpeed = (val == "on" || val == "1");
+      } else {
+        float v = val.toFloat();
+        if (!(v > 0.0f)) {
+          hostPrintln("ERROR: Value must be > 0");
+          return;
+        }
+        if (key == "q") t->q_jerk = v;
+        else if (key == "r") t->r_angle = v;
+        else if (key == "rv") t->r_vel = v;
+        else {
+          hostPrintln("ERROR: Key must be q, r, rv or spd");
+          return;
+        }
+      }
+    }
+    hostPrintln(">>> Joint State Estimator (constant-accel Kalman):");
+    const char *names[2] = {"Hip", "Ankle"};
+    const JointEstimatorTuning *tunings[2] = {&hipEstTuning, &ankleEstTuning};
+    const JointStateEstimator *ests[2] = {&hipEst, &ankleEst};
+    for (uint8_t i = 0; i < 2; ++i) {
+      const JointEstimatorTuning &t = *tunings[i];
+      const JointStateEstimator &e = *ests[i];
+      hostPrintf(">>>   %s: q=%.3g r=%.3g rv=%.3g spd=%s (~%.1f Hz)\n", names[i], t.q_jerk, t.r_angle, t.r_vel,
+                 t.useMotorSpeed ? "on" : "off", jointEstimatorBandwidthHz(t));
+      if (e.initialized) {
+        hostPrintf(">>>     angle %.2f deg  vel %.2f deg/s  acc %.1f deg/s^2  (sd %.3f / %.2f / %.1f)\n", e.x[0], e.x[1],
+                   e.x[2], sqrtf(e.P[0][0]), sqrtf(e.P[1][1]), sqrtf(e.P[2][2]));
+        hostPrintf(">>>     innov %.3f deg  resets %lu  speed fused %lu\n", e.innov,
+                   static_cast<unsigned long>(e.resets), static_cast<unsigned long>(e.speedFused));
+      } else {
+        hostPrintln(">>>     NOT INITIALIZED");
+      }
+    }
+  }
+  // 时延补偿：lat / lat on|off / lat drv <us> / lat max <us> / lat reset
+  else if (cmd == "lat" || cmd.startsWith("lat ")) {
+    if (cmd == "lat on" || cmd == "lat off") {
+      LatComp::setEnabled(cmd == "lat on");
+    } else if (cmd == "lat reset") {
+      LatComp::reset();
+    } else if (cmd.startsWith("lat drv ") || cmd.startsWith("lat max ")) {
+      long us = cmd.substring(8).toInt();
+      if (us < 0 || us > 100000) {
+        hostPrintln("ERROR: Value must be 0~100000 us");
+        return;
+      }
+      if (cmd.startsWith("lat drv ")) {
+        LatComp::setDriverUs(static_cast<uint32_t>(us));
+      } else {
+        LatComp::setMaxLeadUs(static_cast<uint32_t>(us));
+      }
+    } else if (cmd.startsWith("lat ")) {
+      hostPrintln("ERROR: Usage: lat | lat on|off | lat drv <us> | lat max <us> | lat reset");
+      return;
+    }
+    LatComp::printStatus(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB));
+  }
   // 步态相位调试命令：phase
   else if (cmd == "phase" || cmd == "gaitphase") {
     if (gaitPhaseDetector.initialized) {
@@ -4129,7 +7809,7 @@ void processSerialCommand() {
       hostPrintf(">>>   Phase Duration: %lu ms (%.2f s)\n", 
                    getCurrentPhaseDurationMs(),
                    getCurrentPhaseDurationMs() / 1000.0f);
-      hostPrintf(">>>   Condition Hold Time: %lu ms\n", gaitPhaseDetector.conditionHoldMs);
+      hostPrintf(">>>   Condition Hold Time: %lu ms\n", gaitPhaseDetector.conditionHoldUs / 1000u);
       if (hipProcessor.initialized && adaptiveThreshold.initialized) {
         float hip_f = hipProcessor.hip_f;
         float hip_vel_f = hipProcessor.hip_vel_f;
@@ -4445,6 +8125,22 @@ void processSerialCommand() {
   else if (cmd == "ctrloff" || cmd == "controloff") {
     setControlLoopEnabled(false);
   }
+  // 广播转矩模式：bcast | bcast on | bcast off
+  else if (cmd == "bcast" || cmd.startsWith("bcast ")) {
+    String arg = cmd.substring(5);
+    arg.trim();
+    if (arg == "on") {
+      s_torqueBroadcastMode = true;
+    } else if (arg == "off") {
+      s_torqueBroadcastMode = false;
+      s_torqueTxDecimatePhase = 0;
+    } else if (arg.length() > 0) {
+      hostPrintln("ERROR: Usage: bcast | bcast on | bcast off");
+    }
+    hostPrintf(">>> Torque TX mode: %s (bcast_replaced=%lu)\n",
+               s_torqueBroadcastMode ? "BROADCAST 0x280 (every cycle)" : "PER-MOTOR A1 (decimated)",
+               static_cast<unsigned long>(CanTx::broadcastReplacedCount()));
+  }
   // A1 参数设置：set <name> <value>
   else if (cmd.startsWith("set ")) {
     int firstSpace = cmd.indexOf(' ');
@@ -4502,6 +8198,22 @@ void processSerialCommand() {
       }
     }
   }
+  // 控制帧频率：rate 查询；rate <hz> 设置（100~1000Hz，斜率限幅按周期自动缩放）
+  else if (cmd == "rate") {
+    hostPrintf(">>> Control rate: %luHz (period %luus, slew scale %.2f)\n",
+               static_cast<unsigned long>(1000000u / CycleExec::periodUs()),
+               static_cast<unsigned long>(CycleExec::periodUs()), CycleExec::slewScale());
+  }
+  else if (cmd.startsWith("rate ")) {
+    long hz = cmd.substring(5).toInt();
+    if (hz < 100 || hz > 1000 || !CycleExec::setPeriodUs(static_cast<uint32_t>(1000000L / hz))) {
+      hostPrintln("ERROR: Usage: rate <hz> (100~1000)");
+    } else {
+      controlLoop.controlIntervalMs = (CycleExec::periodUs() + 999u) / 1000u;
+      hostPrintf(">>> Control rate set to %ldHz (period %luus, diq_* scaled x%.2f per step)\n",
+                 hz, static_cast<unsigned long>(CycleExec::periodUs()), CycleExec::slewScale());
+    }
+  }
   // 查询当前踝关节电机速度参数
   else if (cmd == "speed" || cmd == "motorspeed") {
     hostPrintf(">>> Current ankle motor speed: %u (protocol units, motor axis speed dps)\n", 
@@ -4538,13 +8250,8 @@ void processSerialCommand() {
       float angle = cmd.substring(spaceIdx + 1).toFloat();
       // 先读取当前角度
       requestMotorAngle(hipMotor);
-      delay(50);  // 等待回复
-      {
-        CAN_message_t inMsg;
-        while (can1.read(inMsg)) {
-          handleCanMessage(inMsg);
-        }
-      }
+      CanTx::serviceFor(50);  // 等待回复
+      CanRx::dispatch();
 
       // 发送位置控制命令（使用带速度限制的命令，速度限制为30 dps，避免损坏设备）
       sendPositionCommandWithSpeed(hipMotor, angle, 30);
@@ -4557,13 +8264,8 @@ void processSerialCommand() {
       float angle = cmd.substring(spaceIdx + 1).toFloat();
       // 先读取当前角度
       requestMotorAngle(ankleMotor);
-      delay(50);  // 等待回复
-      {
-        CAN_message_t inMsg;
-        while (can1.read(inMsg)) {
-          handleCanMessage(inMsg);
-        }
-      }
+      CanTx::serviceFor(50);  // 等待回复
+      CanRx::dispatch();
       // 发送位置控制命令（使用带速度限制的命令，速度限制为30 dps，避免损坏设备）
       sendPositionCommandWithSpeed(ankleMotor, angle, 100);
     }
@@ -4609,6 +8311,8 @@ void processSerialCommand() {
     hostPrintln("Status:  s, status");
     hostPrintln("Gait:    gc, gc <interval>, gcs (gait collection start/stop)");
     hostPrintln("Bluetooth Telemetry: bt | bt on | bt off");
+    hostPrintln("Telemetry Format: tlm | tlm bin | tlm json (binary: COBS frames, ~1/7 of JSON size)");
+    hostPrintln("Telemetry Channels: tlm list | tlm sub all|clinical|<hexmask> | tlm dec <name|idx> <n>");
     hostPrintln("Move:    move1 <angle>, move2 <angle> (e.g., move2 10.5) - move to absolute joint angle");
     hostPrintln("Swing:   sw1 <amp>, sw2 <amp> (e.g., sw1 10)");
     hostPrintln("Stop:    stop1, stop2, stopsw1, stopsw2");
@@ -4617,6 +8321,8 @@ void processSerialCommand() {
     hostPrintln("Ankle Zero: az (ankle zero calibration)");
     hostPrintln("Hip Zero:   hz (hip zero calibration)");
     hostPrintln("Threshold:  th (show adaptive threshold status)");
+    hostPrintln("Estimator:  est | est <hip|ank> q|r|rv <v> | est <hip|ank> spd on|off | est reset (larger q / smaller r = less lag, more noise)");
+    hostPrintln("Latency:    lat | lat on|off | lat drv <us> | lat max <us> | lat reset (extrapolate assist inputs to torque actuation time)");
     hostPrintln("Gait Phase: phase (show gait phase detection status)");
     hostPrintln("4-Phase: ph4 (snapshot), ph4 on/off, ph4 <interval_ms> (realtime stream)");
     hostPrintln("Swing Progress: swing (show swing progress status)");
@@ -4626,23 +8332,198 @@ void processSerialCommand() {
     hostPrintln("Hip Torque Test: hk | hk on <iq> | hk off | hk read | hiptorque …");
     hostPrintln("Compliance: compliance (show compliance control status)");
     hostPrintln("Reset Fault: resetfault (reset fault state to normal)");
-    hostPrintln("Control Loop: ctrlon / ctrloff (enable/disable 100Hz control loop)");
+    hostPrintln("Control Loop: ctrlon / ctrloff (enable/disable control loop, default 100Hz)");
+    hostPrintln("Control Rate: rate [hz] (query/set control frame rate 100~1000Hz; diq_* per-10ms slews rescaled)");
+    hostPrintln("Torque TX: bcast | bcast on | bcast off (hip+ankle torque in one 0x280 broadcast frame)");
     hostPrintln("A1 Params: set <name> <value>, get <name>, params (auto-save EEPROM)");
     hostPrintln("Motor Speed: speed <value> / speed (set/query ankle motor speed, 100-10000)");
     hostPrintln("Dorsiflexion: dorsiflex <angle> / df <angle> (set/query ankle dorsiflexion target, 0-40 deg)");
-    hostPrintln("Firmware log: fwlog | logdump (ring buffer, e.g. CAN TX queue full)");
+    hostPrintln("Encoder Track: enc (0xA1/0x9C encoder unwrapping, 0x92 anchors)");
+    hostPrintln("CAN TX: txq (priority queue: pending, drops/coalesced per class)");
+    hostPrintln("Host Output: outq [reset] (per-port reply/telemetry rings, dropped/blocking bytes)");
+    hostPrintln("Black Box: bb | bb freeze | bb arm | bb dump (last ~10s of control snapshots, binary dump on USB)");
+    hostPrintln("Session Recorder: rec | rec start | rec stop (per-frame binary snapshots to SD, RECnnnnn.BIN)");
+    hostPrintln("Formatter: fmtbench [n] (snprintf vs fixed-point writer, cycles per telemetry line; control off only)");
+    hostPrintln("Cycle: cycle [reset] (control frame slots: budget/max/overrun, skipped frames)");
+    hostPrintln("Profile: prof [reset] (DWT cycle stats per hot-path zone; -D FW_PROFILING=0 compiles out)");
+    hostPrintln("CAN RX: canrx (mailbox filters, foreign/unhandled frame counters)");
+    hostPrintln("CAN RTT: rtt | rtt hist | rtt reset (per-motor/cmd reply latency min/p50/p99/max, timeouts)");
+    hostPrintln("Poll Sched: poll | poll auto on | poll auto off (adaptive angle/STATUS poll rates)");
+    hostPrintln("            poll lock on | poll lock off (phase-lock angle queries to the control frame; sample age)");
+    hostPrintln("CAN Bus: busstat | busstat reset (utilization %, per-ID/cmd frame counts, burst, TX queue high-water)");
+    hostPrintln("Event log: fwlog | fwlog <tag> [tag...] | fwlog bin | fwlog clear (phase/safety/abn/cmd/overrun... timeline)");
     hostPrintln("Help:    h, help");
   }
-  else if (cmd == "fwlog" || cmd == "logdump") {
-    if (cmdReplyPort) {
-      FwLog::printDump(*cmdReplyPort);
-      if (cmdReplyPort == static_cast<Print*>(&BT_SERIAL)) {
-        FwLog::printDump(Serial);
-      }
+  // 编码器展开跟踪状态：enc
+  else if (cmd == "enc") {
+    const EncoderTracker *tracks[2] = {&hipEncTrack, &ankleEncTrack};
+    const MotorConfig *motors[2] = {&hipMotor, &ankleMotor};
+    uint32_t usNow = micros();
+    for (int i = 0; i < 2; i++) {
+      const EncoderTracker &t = *tracks[i];
+      hostPrintf("%s: anchored=%d live=%d enc=%u unwrapped=%lld offset=%lld anchors=%lu last_corr=%ld units (age %lu us)\n",
+                 motors[i]->name, t.anchored ? 1 : 0, encoderTrackLive(t, usNow) ? 1 : 0,
+                 static_cast<unsigned>(t.lastEnc),
+                 static_cast<long long>(t.encUnwrapped), static_cast<long long>(t.unitsOffset),
+                 static_cast<unsigned long>(t.anchorCount), static_cast<long>(t.lastAnchorCorrUnits),
+                 static_cast<unsigned long>(usNow - t.lastSampleUs));
+    }
+  }
+  else if (cmd == "busstat" || cmd == "busstat reset") {
+    if (cmd == "busstat reset") {
+      BusStat::resetPeaks();
+    }
+    BusStat::printReport(cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial));
+  }
+  else if (cmd == "rtt" || cmd == "rtt hist" || cmd == "rtt reset") {
+    if (cmd == "rtt reset") {
+      Rtt::reset();
+      PollSched::resync();  // 丢包窗口快照随之归零，否则下一窗口差值下溢
+      hostPrintln(">>> RTT statistics cleared");
+    } else {
+      Rtt::printReport(cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial), cmd == "rtt hist");
+    }
+  }
+  // 自适应轮询：poll | poll auto on | poll auto off
+  else if (cmd == "poll" || cmd == "poll auto on" || cmd == "poll auto off" ||
+           cmd == "poll lock on" || cmd == "poll lock off") {
+    if (cmd == "poll auto on") {
+      PollSched::setAuto(true);
+    } else if (cmd == "poll auto off") {
+      PollSched::setAuto(false);
+    } else if (cmd == "poll lock on") {
+      PollSched::setPhaseLock(true);
+    } else if (cmd == "poll lock off") {
+      PollSched::setPhaseLock(false);
+    }
+    PollSched::printStatus(cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial));
+  }
+  else if (cmd == "cycle" || cmd == "cycle reset") {
+    Print &out = cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial);
+    CycleExec::printStatus(out);
+    if (cmd == "cycle reset") {
+      CycleExec::reset();
+      out.println(">>> Cycle stats reset");
+    }
+  }
+  else if (cmd == "fmtbench" || cmd.startsWith("fmtbench ")) {
+    // 每次迭代约 12 次 snprintf("%.*f")，5000 次要跑上百 ms：只在控制循环关闭时运行
+    if (controlLoop.controlEnabled) {
+      hostPrintln("ERROR: fmtbench not allowed while control loop is running (stop first)");
+      return;
+    }
+    uint32_t iters = (cmd.length() > 9) ? static_cast<uint32_t>(cmd.substring(9).toInt()) : 200;
+    iters = constrain(iters, 1u, 5000u);
+    Fmt::bench(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB), iters);
+  }
+  // 黑匣子：bb / bb freeze / bb arm / bb dump
+  else if (cmd == "bb") {
+    BlackBox::printStatus(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB));
+  }
+  else if (cmd == "bb freeze") {
+    BlackBox::trigger(BlackBox::REASON_MANUAL);
+    if (!BlackBox::frozen()) {
+      hostPrintln(">>> Black box already triggered, freezing after post-trigger frames");
+    }
+  }
+  else if (cmd == "bb arm") {
+    BlackBox::arm();
+    hostPrintln(">>> Black box re-armed (buffer cleared)");
+  }
+  else if (cmd == "bb dump") {
+    // 二进制帧固定走 USB（蓝牙带宽不足以导出整段缓冲）
+    if (BlackBox::dump(HostOut::PORT_USB)) {
+      hostPrintln(">>> Black box dump streaming on USB");
+    } else {
+      hostPrintln("ERROR: another dump is still in progress on USB");
+    }
+  }
+  // 会话记录：rec / rec start / rec stop
+  else if (cmd == "rec") {
+    SessionRec::printStatus(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB));
+  }
+  else if (cmd == "rec start") {
+    if (SessionRec::start()) {
+      hostPrintln(">>> Session recording STARTED");
+      SessionRec::printStatus(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB));
+    }
+  }
+  else if (cmd == "rec stop") {
+    SessionRec::stop();
+    hostPrintln(">>> Session recording STOPPED");
+    SessionRec::printStatus(cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB));
+  }
+  else if (cmd == "outq" || cmd == "outq reset") {
+    Print &out = cmdReplyPort ? *cmdReplyPort : HostOut::replyWriter(HostOut::PORT_USB);
+    HostOut::printStatus(out);
+    if (cmd == "outq reset") {
+      HostOut::resetStats();
+      out.println(">>> Output ring stats reset");
+    }
+  }
+  else if (cmd == "txq") {
+    CanTx::printStatus(cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial));
+  }
+  else if (cmd == "canrx") {
+    CanRx::printStatus(cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial));
+  }
+  else if (cmd == "prof" || cmd == "prof reset") {
+#if FW_PROFILING
+    Print &out = cmdReplyPort ? *cmdReplyPort : static_cast<Print&>(Serial);
+    Prof::printReport(out);
+    if (cmd == "prof reset") {
+      Prof::reset();
+      out.println(">>> Profile counters reset");
+    }
+#else
+    hostPrintln(">>> Profiling compiled out (build with -D FW_PROFILING=1)");
+#endif
+  }
+  // 事件日志：fwlog / fwlog <tag> [tag...] / fwlog bin / fwlog clear
+  else if (cmd == "fwlog bin") {
+    // 二进制帧固定走 USB，与 bb dump 相同；分段导出，不阻塞控制循环
+    uint32_t first, last;
+    FwLog::range(first, last);
+    if (HostOut::startDump(HostOut::PORT_USB, fwlogBinaryStep, first, last, 0)) {
+      hostPrintln(">>> Event log dump streaming on USB");
     } else {
-      FwLog::printDump(Serial);
+      hostPrintln("ERROR: another dump is still in progress on USB");
     }
   }
+  else if (cmd == "fwlog clear") {
+    FwLog::clear();
+    hostPrintln(">>> Event log cleared (older entries hidden from dumps)");
+  }
+  else if (cmd == "fwlog" || cmd == "logdump" || cmd.startsWith("fwlog ")) {
+    uint32_t mask = 0xFFFFFFFFu;
+    if (cmd.startsWith("fwlog ")) {
+      mask = 0;
+      String rest = cmd.substring(6);
+      rest.trim();
+      while (rest.length() > 0) {
+        int sp = rest.indexOf(' ');
+        String name = (sp < 0) ? rest : rest.substring(0, sp);
+        rest = (sp < 0) ? String("") : rest.substring(sp + 1);
+        rest.trim();
+        int8_t tag = FwLog::tagFromName(name.c_str());
+        if (tag < 0) {
+          hostPrintf("ERROR: Unknown tag '%s'\n", name.c_str());
+          hostPrintf("Tags:");
+          for (uint8_t t = 1; t < FwLog::TAG_COUNT; ++t) {
+            hostPrintf(" %s", FwLog::kTagNames[t]);
+          }
+          hostPrintln("");
+          return;
+        }
+        mask |= 1u << tag;
+      }
+    }
+    // 分段导出：HostOut::service() 按回显环余量逐条写出
+    if (replyIsBluetooth()) {
+      fwlogStartTextDump(HostOut::PORT_BT, mask);
+    }
+    fwlogStartTextDump(HostOut::PORT_USB, mask);
+  }
   else if (cmd == "p") {
     hostPrintln("=== System Status ===");
     hostPrintf("Control Loop: %s\n", controlLoop.controlEnabled ? "ON" : "OFF");
@@ -4664,6 +8545,7 @@ void processSerialCommand() {
 void setup() {
   Serial.begin(115200);
   BT_SERIAL.begin(BT_HC06_BAUD);
+  HostOut::begin();
   // 当前模式：实时数据仅走蓝牙，USB 保留命令与调试输出
   delay(30);
 
@@ -4673,9 +8555,17 @@ void setup() {
   hostPrintln("CAN Protocol V2.35 Implementation");
   hostPrintln("========================================");
   
+  // 电机注册表须先于 CAN 初始化（RX 滤波由注册表生成）
+  initMotorRegistry();
+#if FW_PROFILING
+  Prof::begin();
+#endif
+
   // 初始化 CAN：1Mbps，标准帧
   can1.begin();
   can1.setBaudRate(1000000);  // 1M
+  // 按电机注册表配置硬件验收滤波 + 中断接收 → 时间戳环形缓冲
+  CanRx::begin(motorRegistryList, motorRegistryCount);
   
   hostPrintln("CAN1 initialized at 1 Mbps.");
   hostPrintln("Control ID: 0x140 + MotorID");
@@ -4691,6 +8581,7 @@ void setup() {
   hostPrintln("  0x9C: Read Status 2");
   hostPrintln("  0xA3: Position Control 1");
   hostPrintln("  0xA4: Position Control 2 (with speed limit)");
+  hostPrintln("  0x280: Multi-motor Torque Broadcast (iq for ID 1~4)");
   hostPrintln("");
   hostPrintln("Type 'h' or 'help' for command list.");
   hostPrintln("");
@@ -4707,7 +8598,7 @@ void setup() {
   // 初始化默认步态轨迹
   initDefaultGaitTrajectory();
   // 方案二：定时器仅递增节拍，CAN 统一在 loop 中 runUnifiedCanCycle100Hz 处理
-  controlTimer.begin(onCanCycleTimerTick, 10000); // 10000 us = 10 ms
+  controlTimer.begin(onCanCycleTimerTick, CycleExec::periodUs()); // 默认 10000 us = 10 ms；rate 命令可切至 1kHz
   controlTimer.priority(128);
 }
 
@@ -4745,9 +8636,12 @@ void setControlLoopEnabled(bool enabled) {
     // 重置步态检测与滤波
     // hipProcessor.initialized = false; // 可选：是否重置滤波？暂时保留滤波历史可能更好
     
-    hostPrintln(">>> Control loop ENABLED (100Hz) - States Reset");
+    hostPrintf(">>> Control loop ENABLED (%luHz) - States Reset\n",
+               static_cast<unsigned long>(1000000u / CycleExec::periodUs()));
     s_torqueTxDecimatePhase = 0;
-    if (TORQUE_TX_CTRL_ON_DIVISOR > 1u) {
+    if (s_torqueBroadcastMode) {
+      hostPrintln(">>> CAN: broadcast torque 0x280 every cycle (hip+ankle in one frame) + STATUS 800ms");
+    } else if (TORQUE_TX_CTRL_ON_DIVISOR > 1u) {
       hostPrintln(">>> CAN: A1 torque decimated + STATUS 800ms while control ON (lower bus load for angle RX)");
     }
     // 自动启动传感器轮询（喂数据给状态机）
@@ -4759,40 +8653,125 @@ void setControlLoopEnabled(bool enabled) {
   }
 }
 
-// --- CAN 100Hz 节拍 ISR：只做计数，不做 CAN 读写 ---
+// --- CAN 100Hz 节拍 ISR：只记录节拍，不做 CAN 读写 ---
 void onCanCycleTimerTick() {
-  // 上限过小会导致 loop 偏慢时丢节拍 → 角度采样率掉到 20~40Hz；pending 仅作迟到补偿用
-  if (g_canCycleTicksPending < 64) {
-    g_canCycleTicksPending++;
-  }
+  CycleExec::onTimerTick();
 }
 
-// 统一的 100Hz CAN 周期：先收包 → 先发角度/STATUS（查询）→ 再 A1 转矩。
+// 估计槽位的输出，供同一帧的控制槽位使用
+struct ControlFrame {
+  uint32_t now;
+  bool hipDataOk;
+  bool ankleDataOk;
+  GaitPhase currentPhase;
+  float swing_pct;
+  float stance_pct;
+  float ankle_deg;
+  float hip_deg;
+  float ankle_vel_f;
+  float hip_vel_f;
+  // 时延补偿：外推到预计出力时刻的状态（lat off 时等于当前估计值），供助力律使用
+  uint32_t hipLeadUs;
+  uint32_t ankleLeadUs;
+  float swing_pct_act;
+  float stance_pct_act;
+  float ankle_deg_act;
+  float ankle_vel_act;
+  float hip_deg_act;
+  float hip_vel_act;
+};
+
+// 统一的 100Hz CAN 周期（循环执行器的帧内槽位）：先收包 → 先发角度/STATUS（查询）→ 估计 → 控制/A1 转矩 → 释放。
 // ctrlon 时若先转矩再查询，两路 100Hz 转矩会占满 TX/RX 时隙，踝 0x92 应答易丢（ank_rx 掉至 0 而 tx_ank 仍满）。
 // 转矩发出后再收一轮，减少应答积压在 MB。
+// 控制状态边沿记入事件日志（每帧比对一次，热路径内不打印）
+static void logControlEdges() {
+  static int8_t prevPhase = -1;
+  static int8_t prevPhase4 = -1;
+  static bool prevDegraded = false;
+  static bool prevCompliant[2] = {false, false};
+  static bool prevCooldown[2] = {false, false};
+  static AbnormalReason prevAbn = ABN_NONE;
+
+  if (gaitPhaseDetector.initialized) {
+    const int8_t ph = static_cast<int8_t>(gaitPhaseDetector.currentPhase);
+    if (ph != prevPhase) {
+      if (prevPhase >= 0) {  // 初始化后的第一相不是边沿
+        FwLog::append(FwLog::TAG_PHASE, ph, static_cast<uint16_t>(prevPhase));
+      }
+      prevPhase = ph;
+    }
+  }
+  if (phase4Det.initialized) {
+    const int8_t ph4 = static_cast<int8_t>(phase4Det.currentPhase);
+    if (ph4 != prevPhase4) {
+      if (prevPhase4 >= 0) {
+        FwLog::append(FwLog::TAG_PHASE4, ph4, static_cast<uint16_t>(prevPhase4));
+      }
+      prevPhase4 = ph4;
+    }
+    if (phase4Det.degraded != prevDegraded) {
+      FwLog::append(FwLog::TAG_PH4_DEGRADED, phase4Det.degraded ? 1 : 0);
+      prevDegraded = phase4Det.degraded;
+    }
+  }
+  const JointSafetyState *joints[2] = {&ankleSafety, &hipSafety};
+  for (uint8_t j = 0; j < 2; ++j) {
+    const JointSafetyState &st = *joints[j];
+    if (st.compliant && !prevCompliant[j]) {
+      FwLog::append(FwLog::TAG_SAFETY_COMPLIANT, j, 0, st.iq_cmd_prev);
+    }
+    if (st.in_cooldown && !prevCooldown[j]) {
+      FwLog::append(FwLog::TAG_SAFETY_COOLDOWN, j, 0, st.iq_cmd_prev);
+    }
+    prevCompliant[j] = st.compliant;
+    prevCooldown[j] = st.in_cooldown;
+  }
+  if (ankleAbn != prevAbn) {
+    if (ankleAbn != ABN_NONE) {
+      FwLog::append(FwLog::TAG_ABN, ankleAbn, 0, assistDbg.ankle_iq_target);
+    }
+    prevAbn = ankleAbn;
+  }
+}
+
 void runUnifiedCanCycle100Hz() {
   s_unifiedExeWindowCnt++;
   uint32_t now = millis();
+  ControlFrame frame;
 
-  auto canRxDrain = []() {
-    CAN_message_t inMsg;
-    while (can1.read(inMsg)) {
-      handleCanMessage(inMsg);
-    }
-  };
-
-  canRxDrain();
-  sensorPollingScheduledTx(now);
+  {
+    CycleExec::SlotTimer t(CycleExec::SLOT_RX);
+    CanRx::dispatch();
+    sensorPollingScheduledTx(now);
+  }
   if (controlLoop.controlEnabled) {
-    runControlAlgorithmOnce();
+    {
+      CycleExec::SlotTimer t(CycleExec::SLOT_EST);
+      runEstimationOnce(frame);
+    }
+    {
+      CycleExec::SlotTimer t(CycleExec::SLOT_CTRL);
+      runControlAlgorithmOnce(frame);
+    }
+    logControlEdges();
   }
-  canRxDrain();
-  angleDiagPrintIfDue(now);
+  {
+    CycleExec::SlotTimer t(CycleExec::SLOT_TX);
+    CanTx::service();
+    CanRx::dispatch();
+  }
+  // 会话记录：本帧快照拷入缓冲（写卡在后台 SLOT_REC）
+  SessionRec::capture();
+  // 黑匣子：RAM 环形快照，故障时冻结
+  BlackBox::capture();
 }
 
-// 100Hz 控制算法与转矩下发（假定已在同一周期内做过 RX drain）
-static void runControlAlgorithmOnce() {
+// 估计：数据新鲜性、相位识别与 gait 进度、关节角/角速度（假定已在同一周期内做过 RX drain）
+static void runEstimationOnce(ControlFrame &frame) {
+  PROF_ZONE(ZONE_ESTIMATION);
   uint32_t now = millis();
+  frame.now = now;
   controlLoop.lastControlMs = now;
   controlLoop.controlCount++;
   
@@ -4800,26 +8779,73 @@ static void runControlAlgorithmOnce() {
   // 1. 传感器更新（由传感器轮询定时器统一处理，这里只检查数据新鲜性）
   // ========================================================================
   // 检查传感器数据是否新鲜（500ms内）
-  bool hipDataOk = (hipStatus.lastUpdateMs > 0) && 
-                   ((now - hipStatus.lastUpdateMs) < COMM_TIMEOUT_MS);
-  bool ankleDataOk = (ankleStatus.lastUpdateMs > 0) && 
-                     ((now - ankleStatus.lastUpdateMs) < COMM_TIMEOUT_MS);
+  frame.hipDataOk = (hipStatus.lastUpdateMs > 0) && 
+                    ((now - hipStatus.lastUpdateMs) < COMM_TIMEOUT_MS);
+  frame.ankleDataOk = (ankleStatus.lastUpdateMs > 0) && 
+                      ((now - ankleStatus.lastUpdateMs) < COMM_TIMEOUT_MS);
+
+  // 时延补偿外推量（样本 → 预计出力时刻）；本帧样本登记给转矩帧写出时配对测量
+  const uint32_t frameUs = micros();
+  frame.hipLeadUs = LatComp::leadUs(hipMotor.id, hipStatus.sampleUs, frameUs);
+  frame.ankleLeadUs = LatComp::leadUs(ankleMotor.id, ankleStatus.sampleUs, frameUs);
+  LatComp::noteFrame(hipMotor.id, hipStatus.sampleUs, frameUs);
+  LatComp::noteFrame(ankleMotor.id, ankleStatus.sampleUs, frameUs);
+  // 支撑进度按 millis() 计时，只需补偿本帧 → 出力这一段（去掉样本年龄）
+  const uint32_t ankleAgeUs = frameUs - ankleStatus.sampleUs;
+  const uint32_t stanceLeadMs =
+      (frame.ankleLeadUs > ankleAgeUs) ? (frame.ankleLeadUs - ankleAgeUs + 500u) / 1000u : 0u;
   
   // ========================================================================
   // 2. 相位识别与 gait 进度
   // ========================================================================
-  GaitPhase currentPhase = gaitPhaseDetector.initialized ? 
-                           gaitPhaseDetector.currentPhase : PHASE_STANCE;
-  float swing_pct = getSwingProgress();   // 0~1
-  updateStanceProgress(currentPhase, now);
-  float stance_pct = getStancePct(currentPhase, now);
-  // 4相检测：必须在stanceProg和swingProgress更新后调用
+  frame.currentPhase = gaitPhaseDetector.initialized ? 
+                       gaitPhaseDetector.currentPhase : PHASE_STANCE;
+  frame.swing_pct = getSwingProgress();   // 0~1
+  updateStanceProgress(frame.currentPhase, now);
+  frame.stance_pct = getStancePct(frame.currentPhase, now);
+  // 4相检测：必须在stanceProg和swingProgress更新后调用（按当前时刻）
   updateGaitPhase4Detector();
-  float ankle_deg = getAnkleDeg();
-  float hip_deg   = getHipDeg();
-  updateAnkleVelEstimator(ankle_deg, now);
-  float ankle_vel_f = ankleVel.vel_f;
-  float hip_vel_f = hipProcessor.hip_vel_f;
+  frame.ankle_deg = getAnkleDeg();
+  frame.hip_deg   = getHipDeg();
+  PollSched::noteSampleAge(hipMotor, frameUs, hipStatus.sampleUs);
+  PollSched::noteSampleAge(ankleMotor, frameUs, ankleStatus.sampleUs);
+  updateAnkleVelEstimator(frame.ankle_deg, ankleStatus.sampleUs);
+  frame.ankle_vel_f = ankleVel.vel_f;
+  frame.hip_vel_f = hipProcessor.hip_vel_f;
+
+  // 外推到预计出力时刻：以估计器最近样本时间为起点（与 sampleUs 相同；样本重复时不重复计时）
+  frame.hip_deg_act = frame.hip_deg;
+  frame.hip_vel_act = frame.hip_vel_f;
+  frame.ankle_deg_act = frame.ankle_deg;
+  frame.ankle_vel_act = frame.ankle_vel_f;
+  frame.swing_pct_act = frame.swing_pct;
+  if (frame.hipLeadUs > 0 && hipEst.initialized) {
+    jointEstimatorExtrapolate(hipEst, frame.hipLeadUs, frame.hip_deg_act, frame.hip_vel_act);
+    if (frame.currentPhase == PHASE_SWING && swingProgress.initialized) {
+      frame.swing_pct_act = swingProgressAtHip(frame.hip_deg_act);
+    }
+  }
+  if (frame.ankleLeadUs > 0 && ankleEst.initialized) {
+    jointEstimatorExtrapolate(ankleEst, frame.ankleLeadUs, frame.ankle_deg_act, frame.ankle_vel_act);
+  }
+  frame.stance_pct_act = getStancePct(frame.currentPhase, now + stanceLeadMs);
+  // 推进期边界按踝的出力时刻另行评估，仅供助力律门控
+  updatePushOffGate(frame.stance_pct_act, stanceLeadMs, now);
+}
+
+// 100Hz 控制算法与转矩下发（输入为同一帧估计槽位的结果）
+static void runControlAlgorithmOnce(const ControlFrame &frame) {
+  PROF_ZONE(ZONE_CONTROL_ALGO);
+  const uint32_t now = frame.now;
+  const bool hipDataOk = frame.hipDataOk;
+  const bool ankleDataOk = frame.ankleDataOk;
+  const GaitPhase currentPhase = frame.currentPhase;
+  const float swing_pct = frame.swing_pct;
+  const float stance_pct = frame.stance_pct;
+  const float ankle_deg = frame.ankle_deg;
+  const float hip_deg = frame.hip_deg;
+  const float ankle_vel_f = frame.ankle_vel_f;
+  const float hip_vel_f = frame.hip_vel_f;
 
   // 相位边沿记录（保持与旧逻辑兼容）
   if (currentPhase != controlLoop.prevPhase) {
@@ -4839,13 +8865,14 @@ static void runControlAlgorithmOnce() {
     ankleSafety.compliant   = false;
     ankleSafety.in_cooldown = false;
   }
+  // 助力律使用外推到预计出力时刻的状态（LatComp）；异常检测与安全管线仍用当前测量值
   int16_t ankle_iq_target = computeAnkleIqTarget(
-      currentPhase, swing_pct, stance_pct,
-      ankle_deg, ankle_vel_f, hip_deg, now);
+      currentPhase, frame.swing_pct_act, frame.stance_pct_act,
+      frame.ankle_deg_act, frame.ankle_vel_act, frame.hip_deg_act, now);
 
   int16_t hip_iq_target = computeHipIqTarget(
-      currentPhase, swing_pct,
-      hipProcessor.hip_f, hip_vel_f);
+      currentPhase, frame.swing_pct_act,
+      frame.hip_deg_act, frame.hip_vel_act);
 
   // 更新 act 标志：有非零踝 iq 视为“位置追踪/助力中”
   controlLoop.anklePositionActive = (ankle_iq_target != 0);
@@ -4894,29 +8921,46 @@ static void runControlAlgorithmOnce() {
       now);
   
   // ========================================================================
-  // 5. 下发 A1 转矩命令（ctrlon 时按 TORQUE_TX_CTRL_ON_DIVISOR 降频，减轻 CAN 过载）
+  // 5. 下发转矩命令
+  //    广播模式：髋/踝合为一帧 0x280，每周期发送；数据不新鲜的关节该槽位填 0
+  //    单发模式：两帧 A1，按 TORQUE_TX_CTRL_ON_DIVISOR 降频，减轻 CAN 过载
+  //    ak/hk 手动测试模式占用对应节点时退回单发路径，避免与手动 A1 抢同一节点
   // ========================================================================
-  s_torqueTxDecimatePhase++;
-  const bool torqueTxThisCycle =
-      (TORQUE_TX_CTRL_ON_DIVISOR <= 1u) ||
-      ((s_torqueTxDecimatePhase % TORQUE_TX_CTRL_ON_DIVISOR) == 1u);
-
-  if (ankleDataOk) {
-    // 与 ak 测试模式互斥：手动转矩由 loop 周期发送，避免与助力 A1 抢同一节点
-    if (!ankleTorqueMode && torqueTxThisCycle) {
-      sendTorqueCommand(ankleMotor, ankle_iq_cmd);
+  if (s_torqueBroadcastMode && !ankleTorqueMode && !hipTorqueMode) {
+    if (!ankleDataOk) {
+      ankleSafety.iq_cmd_prev = 0;
+    }
+    if (!hipDataOk) {
+      hipSafety.iq_cmd_prev = 0;
     }
+    const MotorConfig *const bcastMotors[2] = {&hipMotor, &ankleMotor};
+    const int16_t bcastIq[2] = {
+        hipDataOk ? hip_iq_cmd : (int16_t)0,
+        ankleDataOk ? ankle_iq_cmd : (int16_t)0};
+    sendBroadcastTorqueCommand(bcastMotors, bcastIq, 2);
   } else {
-    ankleSafety.iq_cmd_prev = 0;
-  }
+    s_torqueTxDecimatePhase++;
+    const bool torqueTxThisCycle =
+        (TORQUE_TX_CTRL_ON_DIVISOR <= 1u) ||
+        ((s_torqueTxDecimatePhase % TORQUE_TX_CTRL_ON_DIVISOR) == 1u);
+
+    if (ankleDataOk) {
+      // 与 ak 测试模式互斥：手动转矩由 loop 周期发送，避免与助力 A1 抢同一节点
+      if (!ankleTorqueMode && torqueTxThisCycle) {
+        sendTorqueCommand(ankleMotor, ankle_iq_cmd);
+      }
+    } else {
+      ankleSafety.iq_cmd_prev = 0;
+    }
 
-  if (hipDataOk) {
-    // 与 hk 测试模式互斥：手动转矩由 loop 周期发送，避免与助力 A1 抢同一节点
-    if (!hipTorqueMode && torqueTxThisCycle) {
-      sendTorqueCommand(hipMotor, hip_iq_cmd);
+    if (hipDataOk) {
+      // 与 hk 测试模式互斥：手动转矩由 loop 周期发送，避免与助力 A1 抢同一节点
+      if (!hipTorqueMode && torqueTxThisCycle) {
+        sendTorqueCommand(hipMotor, hip_iq_cmd);
+      }
+    } else {
+      hipSafety.iq_cmd_prev = 0;
     }
-  } else {
-    hipSafety.iq_cmd_prev = 0;
   }
 
   // 记录调试快照，供 loop 中按需打印
@@ -4950,15 +8994,20 @@ void runControlLoopOnce() {
 }
 void loop() {
 
-  // 方案二：消费 100Hz 节拍；单圈多消化几拍以追上积压（否则 pending 封顶 + 每圈只跑 4 拍 → 有效远低于 100Hz）
-  {
-    uint16_t processed = 0;
-    while (g_canCycleTicksPending > 0 && processed < 48) {
-      g_canCycleTicksPending--;
-      runUnifiedCanCycle100Hz();
-      processed++;
-    }
-  }
+  // 串口输出环：按各端口可写空间非阻塞排空
+  HostOut::service();
+
+  // 释放保护窗已到期的待发 CAN 帧（sendCanCommand 只入队，不再忙等）
+  CanTx::service();
+  BusStat::tick(millis(), CanTx::pendingHighWater());
+  Rtt::tick(micros());
+  // 分发 ISR 已收下的应答帧（统一周期内还会再分发）
+  CanRx::dispatch();
+
+  // 循环执行器：有新节拍则执行一帧（落后的帧跳过，不补跑）
+  CycleExec::runFrameIfDue();
+  // 相位锁定角度查询：在下一帧前 lead 时刻发出
+  sensorPollingAlignedTx();
 
   // ========================================================================
   // 严重错误处理
@@ -4982,8 +9031,11 @@ void loop() {
     // 错误状态下只保留基本串口命令处理，不运行其他逻辑
   }
 
-  // 处理串口命令（非阻塞）
-  processSerialCommand();
+  // 处理串口命令（非阻塞）；新节拍已到时先让出给下一帧
+  if (CycleExec::backgroundSlotFits(CycleExec::SLOT_CMD)) {
+    CycleExec::SlotTimer t(CycleExec::SLOT_CMD);
+    processSerialCommand();
+  }
 
   // 更新传感器轮询（在ctrlon开启时自动运行，喂数据给状态机）
   updateSensorPolling();
@@ -5049,11 +9101,22 @@ void loop() {
   updateSwing(hipSwing);
   updateSwing(ankleSwing);
   
-  // 更新步态数据采集
-  updateGaitCollection();
-  // 更新 4 相步态实时输出
-  updatePhase4RealtimeMonitor();
+  // 遥测槽位：距下一帧时间不足时推迟到下一空闲窗口（各输出自带间隔判断，推迟不丢输出）
+  if (CycleExec::backgroundSlotFits(CycleExec::SLOT_TELEM)) {
+    CycleExec::SlotTimer t(CycleExec::SLOT_TELEM);
+    angleDiagPrintIfDue(millis());
+    // 更新步态数据采集
+    updateGaitCollection();
+    // 更新 4 相步态实时输出
+    updatePhase4RealtimeMonitor();
+  }
   
+  // 会话记录槽位：逐块写出已满的 SD 缓冲 / 定期 flush
+  if (SessionRec::pending() && CycleExec::backgroundSlotFits(CycleExec::SLOT_REC)) {
+    CycleExec::SlotTimer t(CycleExec::SLOT_REC);
+    SessionRec::service();
+  }
+
   // 更新步态轨迹播放
   updateGaitPlayback();
 }
@@ -0,0 +1,485 @@
+#pragma once
+// 会话记录文件格式与分块写入器（固件与主机端测试共用，不依赖 Arduino 头文件）
+// 固件端采集与 SD 后端见 main.cpp 的 SessionRec；上位机解析见 pc/session_record.py（布局变更须同步修改）
+// 主机测试：firmware/test/host/test_session_rec.py（经 StdioBackend 写文件，再用 session_record.py 读回比对）
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// 文件格式（小端，块大小 512）：
+//   块 0：文件头 FileHeader（魔数 "EXOREC\0\0"、版本、记录长度、每块记录数、帧周期、起始 millis、文件序号）
+//   块 1..：BlockHeader（魔数 'RB'、版本、本块有效记录数、块序号）+ kRecordsPerBlock 条 RecordV1，余下补 0
+//   记录不跨块：掉电或拔卡最多丢失未写出的缓冲，已写出的块均可独立解析；
+//   预分配区中未写到的块全 0（魔数不符），解析时跳过。
+// 双缓冲：控制帧内 capture() 只拷贝到当前缓冲；写满 kBlocksPerBuffer 块后切换，
+// 另一缓冲由后台槽位逐块写出（每次 service() 至多写 1 块 512B 或做 1 次 flush，不在 loop 中长时间阻塞）。
+// 两个缓冲都未写完时丢弃新记录并计入 dropped。
+// 换文件：start（命令上下文）时新建 RECnnnnn.BIN 和下一个序号的备用文件，均按 kMaxFileBytes 预分配
+// 连续空间并写好文件头（写入期间不再分配簇）。写满后后台槽位只切到备用文件，旧文件的关闭另占一次 service()；
+// 建文件、预分配（FAT 扫描，可达数十 ms）和写文件头都不在后台槽位里做。
+// 用掉的备用文件由 prepareSpare() 在允许阻塞时补上（固件：控制循环关闭时）；补上之前写满的文件继续普通追加写
+// （逐簇分配，不预分配）。关闭时截断到实际长度，未用的备用文件删除。
+namespace SessionRec {
+
+static constexpr uint16_t kBlockSize = 512;
+static constexpr uint8_t kVersion = 1;
+static constexpr uint8_t kBlocksPerBuffer = 8;  // 每个缓冲 4KB，1kHz 下约 48ms 数据
+static constexpr uint32_t kMaxFileBytes = 256ul * 1024ul * 1024ul;  // 单文件（即预分配）上限，1kHz 约 50 分钟
+static constexpr uint32_t kHardMaxFileBytes = 0xFFFFFE00ul;         // 无备用文件时追加写的上限（FAT32 单文件 4GB）
+static constexpr uint32_t kFlushIntervalMs = 2000;  // 定期 flush，更新目录项以防掉电丢整个文件
+static constexpr uint16_t kBlockMagic = 0x4252;     // "RB"
+
+// 存储后端：文件按块顺序追加写入；同时打开两个文件槽（当前文件 + 备用文件）
+class Backend {
+ public:
+  static constexpr uint8_t kFileSlots = 2;
+
+  virtual ~Backend() {}
+  virtual bool begin() = 0;
+  virtual bool exists(const char *name) = 0;
+  virtual bool remove(const char *name) = 0;
+  // 在 slot 新建文件并尽量预分配 preallocBytes 连续空间（不支持预分配的后端可忽略）
+  virtual bool open(uint8_t slot, const char *name, uint32_t preallocBytes) = 0;
+  // 介质忙（上一次写入的内部编程/擦除未完成）：此时写入会阻塞，调用方改到下一次再写
+  virtual bool busy() { return false; }
+  virtual bool write(uint8_t slot, const uint8_t *data, size_t len) = 0;
+  virtual void flush(uint8_t slot) = 0;
+  // 关闭并截断预分配的未用部分
+  virtual void close(uint8_t slot) = 0;
+};
+
+#ifndef ARDUINO
+// 主机端后端（测试用）：stdio 写到 dir 目录下
+class StdioBackend : public Backend {
+ public:
+  explicit StdioBackend(const char *dir) : dir_(dir) {}
+  bool begin() override { return true; }
+  bool exists(const char *name) override {
+    char path[512];
+    makePath(name, path, sizeof(path));
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) {
+      return false;
+    }
+    fclose(f);
+    return true;
+  }
+  bool remove(const char *name) override {
+    char path[512];
+    makePath(name, path, sizeof(path));
+    return ::remove(path) == 0;
+  }
+  bool open(uint8_t slot, const char *name, uint32_t /*preallocBytes*/) override {
+    char path[512];
+    makePath(name, path, sizeof(path));
+    file_[slot] = fopen(path, "wb");
+    return file_[slot] != nullptr;
+  }
+  bool write(uint8_t slot, const uint8_t *data, size_t len) override {
+    return file_[slot] != nullptr && fwrite(data, 1, len, file_[slot]) == len;
+  }
+  void flush(uint8_t slot) override {
+    if (file_[slot] != nullptr) fflush(file_[slot]);
+  }
+  void close(uint8_t slot) override {
+    if (file_[slot] != nullptr) {
+      fclose(file_[slot]);
+      file_[slot] = nullptr;
+    }
+  }
+
+ private:
+  void makePath(const char *name, char *path, size_t cap) const { snprintf(path, cap, "%s/%s", dir_, name); }
+
+  const char *dir_;
+  FILE *file_[kFileSlots] = {};
+};
+#endif
+
+#pragma pack(push, 1)
+struct FileHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t recordSize;
+  uint16_t recordsPerBlock;
+  uint16_t blockSize;
+  uint32_t periodUs;
+  uint32_t startMs;
+  uint32_t fileIndex;
+};
+
+struct BlockHeader {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;
+  uint32_t seq;
+};
+
+struct MotorRec {
+  int32_t rawUnits;  // 多圈角原始单位（0.01°/LSB）
+  int16_t speed;
+  int16_t iq;
+  uint16_t ageUs;    // 角度样本到本帧节拍的时间（饱和 65535）
+  int8_t temperature;
+  uint8_t motorState;
+  uint8_t errorState;
+  uint8_t enabled;
+};
+
+struct RecordV1 {
+  uint32_t tickUs;
+  uint32_t tick;
+  MotorRec hip;
+  MotorRec ankle;
+  uint8_t phase;
+  uint8_t phase4;
+  uint8_t abn;
+  uint8_t flags;  // bit0 PF, bit1 DF, bit2 UL, bit3 comp, bit4 cool, bit5 ph4 降级, bit6 控制循环开, bit7 踝助力开
+  float swingPct;
+  float stancePct;
+  float ankleDeg;
+  float ankleVelF;
+  float hipDeg;
+  float hipVelF;
+  float ph4Progress;
+  float ph4Output;
+  int16_t ankleIqTarget;
+  int16_t ankleIqCmd;
+  int16_t hipIqTarget;
+  int16_t hipIqCmd;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(FileHeader) <= kBlockSize, "file header must fit block 0");
+static constexpr uint8_t kRecordsPerBlock = (kBlockSize - sizeof(BlockHeader)) / sizeof(RecordV1);
+static_assert(kRecordsPerBlock > 0, "record larger than a block");
+
+// 双缓冲分块写入器：capture() 在控制帧内调用（只拷贝），service() 在后台槽位调用
+class Writer {
+ public:
+  enum ServiceResult : uint8_t {
+    SERVICE_IDLE = 0, SERVICE_WROTE, SERVICE_FLUSHED, SERVICE_CLOSED, SERVICE_BUSY, SERVICE_ERROR
+  };
+
+  void setBackend(Backend *backend) {
+    if (!active_ && backend != nullptr) {
+      backend_ = backend;
+    }
+  }
+
+  bool active() const { return active_; }
+
+  // 单文件上限（默认 kMaxFileBytes；主机测试用小值覆盖换文件路径）
+  void setMaxFileBytes(uint32_t bytes) {
+    if (!active_ && bytes >= 2u * kBlockSize) {
+      maxFileBytes_ = bytes;
+    }
+  }
+
+  // 返回 false：后端不可用或建文件失败（lastError() 给出原因）。同时建好备用文件（失败不影响录制）
+  bool start(uint32_t periodUs, uint32_t startMs, uint32_t nowMs) {
+    if (active_) {
+      return true;
+    }
+    if (backend_ == nullptr || !backend_->begin()) {
+      error_ = "Storage not available (SD card missing?)";
+      return false;
+    }
+    periodUs_ = periodUs;
+    startMs_ = startMs;
+    cur_ = 0;
+    spareReady_ = false;
+    closePending_ = false;
+    if (!createFile(cur_, fileIndex_)) {
+      error_ = "Failed to create recording file";
+      return false;
+    }
+    fileBytes_ = kBlockSize;
+    files_++;
+    error_ = "";
+    for (Buffer &b : buf_) {
+      b.blocks = 0;
+      b.written = 0;
+      b.ready = false;
+    }
+    fill_ = 0;
+    recInBlock_ = 0;
+    blockSeq_ = 0;
+    records_ = dropped_ = unpreallocBlocks_ = 0;
+    lastFlushMs_ = nowMs;
+    active_ = true;
+    prepareSpare();
+    return true;
+  }
+
+  // 建好下一次换文件用的备用文件（新建 + 预分配 + 文件头，可能耗时数十 ms：
+  // 只在命令上下文或允许阻塞时调用）；返回备用文件是否就绪
+  bool prepareSpare() {
+    if (!active_ || spareReady_ || closePending_) {
+      return spareReady_;
+    }
+    spareReady_ = createFile(cur_ ^ 1, spareIndex_);
+    return spareReady_;
+  }
+
+  bool needsSpare() const { return active_ && !spareReady_ && !closePending_; }
+
+  // 停止：封口未满的块，阻塞写出剩余缓冲并关闭文件（命令上下文调用）
+  void stop() {
+    if (!active_) {
+      return;
+    }
+    active_ = false;
+    Buffer &cur = buf_[fill_];
+    if (recInBlock_ > 0 && !cur.ready) {
+      sealBlock(cur);
+    }
+    Buffer &other = buf_[fill_ ^ 1];
+    bool ok = true;
+    while (ok && other.ready) {
+      ok = writeNextBlock(other);
+    }
+    cur.ready = cur.blocks > cur.written;
+    while (ok && cur.ready) {
+      ok = writeNextBlock(cur);
+    }
+    if (!ok) {
+      writeErrors_++;
+    }
+    backend_->flush(cur_);
+    closeFiles();
+  }
+
+  // 返回 false：两个缓冲都未写完，本条丢弃
+  bool capture(const RecordV1 &r) {
+    if (!active_) {
+      return false;
+    }
+    Buffer &b = buf_[fill_];
+    if (b.ready) {
+      dropped_++;  // 当前缓冲已满且另一缓冲尚未写出
+      return false;
+    }
+    uint8_t *blk = blockPtr(b, b.blocks);
+    memcpy(blk + sizeof(BlockHeader) + static_cast<size_t>(recInBlock_) * sizeof(RecordV1), &r, sizeof(r));
+    recInBlock_++;
+    records_++;
+    if (recInBlock_ < kRecordsPerBlock) {
+      return true;
+    }
+    sealBlock(b);
+    if (b.blocks < kBlocksPerBuffer) {
+      return true;
+    }
+    b.ready = true;
+    if (!buf_[fill_ ^ 1].ready) {
+      fill_ ^= 1;
+    }
+    return true;
+  }
+
+  // 有待写出的块，或已到 flush 时间
+  bool pending(uint32_t nowMs) const {
+    return active_ && (closePending_ || buf_[0].ready || buf_[1].ready || nowMs - lastFlushMs_ >= kFlushIntervalMs);
+  }
+
+  // 后台槽位：至多写出 1 块（先写较早写满的缓冲），或关闭 1 个已写满的旧文件，或到期时做 1 次 flush；
+  // 介质忙则本次不写
+  ServiceResult service(uint32_t nowMs) {
+    if (!active_) {
+      return SERVICE_IDLE;
+    }
+    if (closePending_) {
+      if (backend_->busy()) {
+        busySkips_++;
+        return SERVICE_BUSY;
+      }
+      backend_->close(cur_ ^ 1);
+      closePending_ = false;
+      return SERVICE_CLOSED;
+    }
+    Buffer *b = nullptr;
+    if (buf_[fill_ ^ 1].ready) {
+      b = &buf_[fill_ ^ 1];
+    } else if (buf_[fill_].ready) {
+      b = &buf_[fill_];
+    }
+    const bool flushDue = nowMs - lastFlushMs_ >= kFlushIntervalMs;
+    if (b == nullptr && !flushDue) {
+      return SERVICE_IDLE;
+    }
+    if (backend_->busy()) {
+      busySkips_++;
+      return SERVICE_BUSY;
+    }
+    if (b == nullptr) {
+      lastFlushMs_ = nowMs;
+      backend_->flush(cur_);
+      return SERVICE_FLUSHED;
+    }
+    if (!writeNextBlock(*b)) {
+      writeErrors_++;
+      active_ = false;
+      closeFiles();
+      return SERVICE_ERROR;
+    }
+    // 当前缓冲在等待时已写满：另一缓冲写完后切过去
+    if (!b->ready && buf_[fill_].ready && !buf_[fill_ ^ 1].ready) {
+      fill_ ^= 1;
+    }
+    return SERVICE_WROTE;
+  }
+
+  const char *lastError() const { return error_; }
+  uint32_t fileIndex() const { return fileIndex_; }
+  uint32_t files() const { return files_; }
+  uint32_t fileBytes() const { return fileBytes_; }
+  uint32_t records() const { return records_; }
+  uint32_t dropped() const { return dropped_; }
+  uint32_t writeErrors() const { return writeErrors_; }
+  uint32_t busySkips() const { return busySkips_; }
+  bool spareReady() const { return spareReady_; }
+  uint32_t spareIndex() const { return spareIndex_; }
+  uint32_t unpreallocatedBlocks() const { return unpreallocBlocks_; }
+
+ private:
+  struct Buffer {
+    alignas(32) uint8_t data[kBlocksPerBuffer * kBlockSize];
+    uint8_t blocks;   // 已封口的块数
+    uint8_t written;  // 已写出的块数
+    bool ready;       // 待后台写出（写满或 stop 时封口）
+  };
+
+  static uint8_t *blockPtr(Buffer &b, uint8_t blk) { return b.data + static_cast<size_t>(blk) * kBlockSize; }
+
+  static void makeName(uint32_t index, char *name, size_t cap) {
+    snprintf(name, cap, "REC%05lu.BIN", static_cast<unsigned long>(index));
+  }
+
+  // 在 slot 新建下一个空闲序号的文件、预分配并写文件头
+  bool createFile(uint8_t slot, uint32_t &index) {
+    char name[20];
+    while (nextIndex_ < 100000) {
+      makeName(nextIndex_, name, sizeof(name));
+      if (!backend_->exists(name)) {
+        break;
+      }
+      nextIndex_++;
+    }
+    if (nextIndex_ >= 100000 || !backend_->open(slot, name, maxFileBytes_)) {
+      return false;
+    }
+    index = nextIndex_++;
+
+    uint8_t block[kBlockSize];
+    memset(block, 0, sizeof(block));
+    FileHeader hdr;
+    memcpy(hdr.magic, "EXOREC\0\0", 8);
+    hdr.version = kVersion;
+    hdr.recordSize = sizeof(RecordV1);
+    hdr.recordsPerBlock = kRecordsPerBlock;
+    hdr.blockSize = kBlockSize;
+    hdr.periodUs = periodUs_;
+    hdr.startMs = startMs_;
+    hdr.fileIndex = index;
+    memcpy(block, &hdr, sizeof(hdr));
+    if (!backend_->write(slot, block, sizeof(block))) {
+      backend_->close(slot);
+      backend_->remove(name);
+      return false;
+    }
+    return true;
+  }
+
+  // 关闭当前文件与待关闭的旧文件；未用的备用文件删除并归还其序号
+  void closeFiles() {
+    if (closePending_) {
+      backend_->close(cur_ ^ 1);
+      closePending_ = false;
+    }
+    backend_->close(cur_);
+    if (spareReady_) {
+      char name[20];
+      backend_->close(cur_ ^ 1);
+      makeName(spareIndex_, name, sizeof(name));
+      backend_->remove(name);
+      nextIndex_ = spareIndex_;
+      spareReady_ = false;
+    }
+  }
+
+  // 封口当前块：写块头，余下补 0
+  void sealBlock(Buffer &b) {
+    uint8_t *blk = blockPtr(b, b.blocks);
+    BlockHeader bh = {kBlockMagic, kVersion, recInBlock_, blockSeq_++};
+    memcpy(blk, &bh, sizeof(bh));
+    const size_t used = sizeof(BlockHeader) + static_cast<size_t>(recInBlock_) * sizeof(RecordV1);
+    memset(blk + used, 0, kBlockSize - used);
+    b.blocks++;
+    recInBlock_ = 0;
+  }
+
+  // 写出 b 的下一块；整缓冲写完后释放
+  bool writeNextBlock(Buffer &b) {
+    if (b.written < b.blocks) {
+      if (fileBytes_ + kBlockSize > maxFileBytes_ && spareReady_) {
+        // 只切换到已建好的备用文件；旧文件由下一次 service() 关闭
+        cur_ ^= 1;
+        closePending_ = true;
+        spareReady_ = false;
+        fileIndex_ = spareIndex_;
+        fileBytes_ = kBlockSize;
+        files_++;
+      }
+      if (fileBytes_ + kBlockSize > kHardMaxFileBytes) {
+        error_ = "File size limit reached with no spare file";
+        return false;
+      }
+      if (!backend_->write(cur_, blockPtr(b, b.written), kBlockSize)) {
+        error_ = "Write failed";
+        return false;
+      }
+      fileBytes_ += kBlockSize;
+      if (fileBytes_ > maxFileBytes_) {
+        unpreallocBlocks_++;  // 备用文件未就绪，超出预分配部分逐簇追加
+      }
+      b.written++;
+    }
+    if (b.written >= b.blocks) {
+      b.blocks = 0;
+      b.written = 0;
+      b.ready = false;
+    }
+    return true;
+  }
+
+  Backend *backend_ = nullptr;
+  Buffer buf_[2] = {};
+  uint8_t fill_ = 0;        // 正在填充的缓冲
+  uint8_t recInBlock_ = 0;  // 当前块已写记录数
+  uint8_t cur_ = 0;         // 当前文件所在的后端文件槽（备用文件在 cur_ ^ 1）
+  bool active_ = false;
+  bool spareReady_ = false;
+  bool closePending_ = false;  // 刚换文件，旧文件（cur_ ^ 1）待关闭
+  uint32_t periodUs_ = 0;
+  uint32_t startMs_ = 0;
+  uint32_t fileIndex_ = 0;
+  uint32_t spareIndex_ = 0;
+  uint32_t nextIndex_ = 1;
+  uint32_t maxFileBytes_ = kMaxFileBytes;
+  uint32_t fileBytes_ = 0;
+  uint32_t blockSeq_ = 0;
+  uint32_t lastFlushMs_ = 0;
+  const char *error_ = "";
+  // 统计
+  uint32_t records_ = 0;
+  uint32_t dropped_ = 0;
+  uint32_t writeErrors_ = 0;
+  uint32_t busySkips_ = 0;
+  uint32_t files_ = 0;
+  uint32_t unpreallocBlocks_ = 0;
+};
+
+}  // namespace SessionRec
@@ -0,0 +1,176 @@
+#pragma once
+// 滑动窗口统计模板（固件与主机端测试共用，不依赖 Arduino 头文件）
+// 主机测试：firmware/test/host/test_sliding_window_stats.cpp
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+// ============================================================================
+// 滑动窗口统计（O(1) 均摊更新：补偿求和 + 单调队列 min/max）
+// ============================================================================
+// push() 均摊 O(1)：
+//   - 均值/方差：Kahan 补偿的滑动和与平方和（移出最旧值 = 加上其相反数）；
+//     每推入 kResyncPushes 个样本用精确求和重建一次，防止长时间运行的舍入漂移（均摊 O(1)）
+//   - min/max：单调双端队列（存值与样本序号，序号差判过期，计数回绕安全），每个样本最多入队、出队各一次
+// variance() 为总体方差；percentile() 为 O(N) 期望的快速选择（拷贝到栈上），用于状态显示等低频场合，不要放在 RX 热路径。
+// 窗口未满时按已有样本计算。
+template <uint16_t N>
+class SlidingWindowStats {
+ public:
+  static constexpr uint32_t kResyncPushes = static_cast<uint32_t>(N) * 8u;
+
+  void reset() {
+    count_ = 0;
+    pos_ = 0;
+    pushes_ = 0;
+    sum_ = sumComp_ = 0.0f;
+    sq_ = sqComp_ = 0.0f;
+    minHead_ = minLen_ = 0;
+    maxHead_ = maxLen_ = 0;
+  }
+
+  // 用同一值填满窗口（与旧实现的初始化方式一致）
+  void fill(float x) {
+    reset();
+    for (uint16_t i = 0; i < N; ++i) {
+      push(x);
+    }
+  }
+
+  void push(float x) {
+    const uint32_t k = pushes_++;
+    if (count_ == N) {
+      const float old = buf_[pos_];
+      kahanAdd(sum_, sumComp_, -old);
+      kahanAdd(sq_, sqComp_, -old * old);
+    } else {
+      count_++;
+    }
+    buf_[pos_] = x;
+    pos_ = static_cast<uint16_t>((pos_ + 1) % N);
+    kahanAdd(sum_, sumComp_, x);
+    kahanAdd(sq_, sqComp_, x * x);
+
+    // min 队列：队尾 ≥ x 的样本不可能再成为最小值；max 队列同理
+    pushMono(minQ_, minHead_, minLen_, x, k, true);
+    pushMono(maxQ_, maxHead_, maxLen_, x, k, false);
+
+    if (pushes_ % kResyncPushes == 0) {
+      resync();
+    }
+  }
+
+  uint16_t count() const { return count_; }
+  static constexpr uint16_t capacity() { return N; }
+
+  float mean() const { return count_ ? sum_ / count_ : 0.0f; }
+
+  float variance() const {
+    if (count_ == 0) {
+      return 0.0f;
+    }
+    const float m = sum_ / count_;
+    const float v = sq_ / count_ - m * m;
+    return v > 0.0f ? v : 0.0f;
+  }
+
+  float stddev() const { return sqrtf(variance()); }
+  float minValue() const { return minLen_ ? minQ_[minHead_].v : 0.0f; }
+  float maxValue() const { return maxLen_ ? maxQ_[maxHead_].v : 0.0f; }
+  float range() const { return maxValue() - minValue(); }
+
+  // p ∈ [0,1]；最近秩法（不插值）
+  float percentile(float p) const {
+    if (count_ == 0) {
+      return 0.0f;
+    }
+    float tmp[N];
+    memcpy(tmp, buf_, sizeof(float) * count_);
+    if (p < 0.0f) p = 0.0f;
+    if (p > 1.0f) p = 1.0f;
+    const uint16_t r = static_cast<uint16_t>(p * (count_ - 1) + 0.5f);
+    return select(tmp, count_, r);
+  }
+
+ private:
+  static void kahanAdd(float &sum, float &comp, float x) {
+    const float y = x - comp;
+    const float t = sum + y;
+    comp = (t - sum) - y;
+    sum = t;
+  }
+
+  // 快速选择：返回 a[0..n) 中第 r 小的值（会打乱 a）
+  static float select(float *a, uint16_t n, uint16_t r) {
+    uint16_t lo = 0;
+    uint16_t hi = static_cast<uint16_t>(n - 1);
+    while (lo < hi) {
+      const float pivot = a[(lo + hi) / 2];
+      int32_t i = lo;
+      int32_t j = hi;
+      while (i <= j) {
+        while (a[i] < pivot) i++;
+        while (a[j] > pivot) j--;
+        if (i <= j) {
+          const float t = a[i];
+          a[i] = a[j];
+          a[j] = t;
+          i++;
+          j--;
+        }
+      }
+      if (r <= j) {
+        hi = static_cast<uint16_t>(j);
+      } else if (r >= i) {
+        lo = static_cast<uint16_t>(i);
+      } else {
+        return a[r];
+      }
+    }
+    return a[r];
+  }
+
+  struct Item {
+    float v;
+    uint32_t seq;
+  };
+
+  // 先移出过期队首再入队：队中序号落在 [k-N+1, k]，长度 ≤ N，入队不会覆盖队首
+  // （若先入队，N+1 个单调样本时新样本会写到队首所在槽位）
+  static void pushMono(Item *q, uint16_t &head, uint16_t &len, float x, uint32_t k, bool isMin) {
+    // 队首过期：序号差 ≥ N 即已移出窗口
+    while (len > 0 && k - q[head].seq >= N) {
+      head = static_cast<uint16_t>((head + 1) % N);
+      len--;
+    }
+    while (len > 0) {
+      const float back = q[(head + len - 1) % N].v;
+      if (isMin ? (back < x) : (back > x)) {
+        break;
+      }
+      len--;
+    }
+    q[(head + len) % N] = {x, k};
+    len++;
+  }
+
+  void resync() {
+    sum_ = sumComp_ = sq_ = sqComp_ = 0.0f;
+    for (uint16_t i = 0; i < count_; ++i) {
+      kahanAdd(sum_, sumComp_, buf_[i]);
+      kahanAdd(sq_, sqComp_, buf_[i] * buf_[i]);
+    }
+  }
+
+  float buf_[N];
+  Item minQ_[N];
+  Item maxQ_[N];
+  uint32_t pushes_ = 0;
+  uint16_t count_ = 0;
+  uint16_t pos_ = 0;
+  uint16_t minHead_ = 0, minLen_ = 0;
+  uint16_t maxHead_ = 0, maxLen_ = 0;
+  float sum_ = 0.0f, sumComp_ = 0.0f;
+  float sq_ = 0.0f, sqComp_ = 0.0f;
+};
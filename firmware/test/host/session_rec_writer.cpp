@@ -0,0 +1,89 @@
+// SessionRec::Writer 主机端驱动：经 StdioBackend 写出记录文件，供 test_session_rec.py 用 pc/session_record.py 读回比对
+// 用法：session_rec_writer <目录> <记录数>
+// 第 i 条记录各字段由 i 确定（与 test_session_rec.py 中 expected() 一致）；后端每 3 次查询报一次忙，
+// 以覆盖「卡忙跳过」路径；每条 capture 后调用一次 service()（至多写 1 块），与固件后台槽位节奏相当。
+// 单文件上限压到 32 块以触发多次换文件；备用文件每 400 条才补建一次，覆盖「无备用文件时继续追加写」路径。
+
+#include <stdlib.h>
+
+#include "session_rec_format.h"
+
+using namespace SessionRec;
+
+class FlakyBackend : public StdioBackend {
+ public:
+  explicit FlakyBackend(const char *dir) : StdioBackend(dir) {}
+  bool busy() override { return (++calls_ % 3) == 0; }
+
+ private:
+  uint32_t calls_ = 0;
+};
+
+static void fillRecord(RecordV1 &r, uint32_t i) {
+  memset(&r, 0, sizeof(r));
+  r.tickUs = 1000u * i + 7u;
+  r.tick = i;
+  r.hip.rawUnits = static_cast<int32_t>(i * 36) - 50000;
+  r.hip.speed = static_cast<int16_t>(i % 200) - 100;
+  r.hip.iq = static_cast<int16_t>(i % 1000);
+  r.hip.ageUs = static_cast<uint16_t>(i % 5000);
+  r.hip.temperature = 30;
+  r.hip.enabled = 1;
+  r.ankle.rawUnits = -static_cast<int32_t>(i * 10);
+  r.ankle.speed = static_cast<int16_t>(-(static_cast<int32_t>(i % 300)));
+  r.ankle.iq = static_cast<int16_t>(-(static_cast<int32_t>(i % 700)));
+  r.ankle.errorState = static_cast<uint8_t>(i % 2);
+  r.phase = static_cast<uint8_t>(i % 2);
+  r.phase4 = static_cast<uint8_t>(i % 4);
+  r.abn = 0;
+  r.flags = static_cast<uint8_t>(i & 0xFF);
+  r.swingPct = 0.001f * static_cast<float>(i % 1000);
+  r.stancePct = 0.5f;
+  r.ankleDeg = 0.25f * static_cast<float>(i % 80) - 10.0f;
+  r.ankleVelF = -1.5f;
+  r.hipDeg = 0.5f * static_cast<float>(i % 60) - 15.0f;
+  r.hipVelF = 2.0f;
+  r.ph4Progress = 0.125f;
+  r.ph4Output = 0.75f;
+  r.ankleIqTarget = static_cast<int16_t>(i % 900);
+  r.ankleIqCmd = static_cast<int16_t>(i % 800);
+  r.hipIqTarget = static_cast<int16_t>(-(static_cast<int32_t>(i % 600)));
+  r.hipIqCmd = static_cast<int16_t>(i % 500);
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    fprintf(stderr, "usage: %s <dir> <records>\n", argv[0]);
+    return 2;
+  }
+  const uint32_t n = static_cast<uint32_t>(strtoul(argv[2], nullptr, 10));
+  static FlakyBackend backend(argv[1]);
+  static Writer w;
+  w.setBackend(&backend);
+  w.setMaxFileBytes(32u * kBlockSize);
+  if (!w.start(10000, 1234, 0)) {
+    fprintf(stderr, "start failed: %s\n", w.lastError());
+    return 1;
+  }
+  const uint32_t firstIndex = w.fileIndex();
+  uint32_t wrote = 0;
+  for (uint32_t i = 0; i < n; ++i) {
+    RecordV1 r;
+    fillRecord(r, i);
+    w.capture(r);
+    if (w.service(i) == Writer::SERVICE_WROTE) {
+      wrote++;
+    }
+    if (i % 400 == 399 && w.needsSpare()) {
+      w.prepareSpare();
+    }
+  }
+  w.stop();
+  // 输出给 Python 端检查：首/末文件序号、文件数、未预分配块数、记录数、丢弃数、卡忙跳过次数、错误数
+  printf("%lu %lu %lu %lu %lu %lu %lu %lu\n", static_cast<unsigned long>(firstIndex),
+         static_cast<unsigned long>(w.fileIndex()), static_cast<unsigned long>(w.files()),
+         static_cast<unsigned long>(w.unpreallocatedBlocks()), static_cast<unsigned long>(w.records()),
+         static_cast<unsigned long>(w.dropped()), static_cast<unsigned long>(w.busySkips()),
+         static_cast<unsigned long>(w.writeErrors()));
+  return 0;
+}
@@ -0,0 +1,80 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+会话记录格式往返测试：编译 session_rec_writer.cpp（固件 session_rec_format.h + StdioBackend），
+写出 RECnnnnn.BIN（单文件上限压小，跨多次换文件）后用 pc/session_record.py 逐个读回，逐条比对字段。
+
+用法（需要 g++）：python3 firmware/test/host/test_session_rec.py
+"""
+
+import glob
+import os
+import subprocess
+import sys
+import tempfile
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FIRMWARE = os.path.normpath(os.path.join(HERE, '..', '..'))
+sys.path.insert(0, os.path.join(FIRMWARE, '..', 'pc'))
+
+import session_record  # noqa: E402
+
+RECORDS = 1000  # 多于两个缓冲（2 × 8 块 × 6 条），覆盖缓冲切换与 stop 时的半满块
+
+
+def expected(i):
+    """与 session_rec_writer.cpp 中 fillRecord() 一致"""
+    return {
+        'tick_us': 1000 * i + 7, 'tick': i,
+        'hip_raw': i * 36 - 50000, 'hip_speed': i % 200 - 100, 'hip_iq': i % 1000, 'hip_age_us': i % 5000,
+        'hip_temp': 30, 'hip_en': 1,
+        'ank_raw': -i * 10, 'ank_speed': -(i % 300), 'ank_iq': -(i % 700), 'ank_err': i % 2,
+        'phase': i % 2, 'phase4': i % 4, 'abn': 0,
+        'PF': i & 1, 'assist': (i >> 7) & 1,
+        'swing_pct': 0.001 * (i % 1000), 'stance_pct': 0.5,
+        'ank': 0.25 * (i % 80) - 10.0, 'v': -1.5, 'hip': 0.5 * (i % 60) - 15.0, 'hipv': 2.0,
+        'ph4p': 0.125, 'ph4o': 0.75,
+        'iqT_a': i % 900, 'iqC_a': i % 800, 'iqT_h': -(i % 600), 'iqC_h': i % 500,
+    }
+
+
+def main():
+    with tempfile.TemporaryDirectory() as tmp:
+        exe = os.path.join(tmp, 'session_rec_writer')
+        subprocess.check_call(['g++', '-std=c++17', '-O2', '-Wall', '-I', os.path.join(FIRMWARE, 'src'),
+                               os.path.join(HERE, 'session_rec_writer.cpp'), '-o', exe])
+        out = subprocess.check_output([exe, tmp, str(RECORDS)]).decode().split()
+        first_index, last_index, files, unprealloc, records, dropped, busy_skips, errors = (int(x) for x in out)
+        assert records == RECORDS and dropped == 0 and errors == 0, out
+        assert busy_skips > 0, 'busy path not exercised'
+        assert files > 2 and last_index == first_index + files - 1, out
+        assert unprealloc > 0, 'no-spare append path not exercised'
+
+        # 未用的备用文件在 stop 时应已删除：目录里恰好是 files 个连续编号的文件
+        paths = sorted(glob.glob(os.path.join(tmp, 'REC*.BIN')))
+        want_paths = [os.path.join(tmp, 'REC%05d.BIN' % k) for k in range(first_index, last_index + 1)]
+        assert paths == want_paths, (paths, want_paths)
+
+        recs = []
+        for k, path in zip(range(first_index, last_index + 1), paths):
+            with open(path, 'rb') as f:
+                data = f.read()
+            hdr = session_record.read_header(data)
+            assert hdr['period_us'] == 10000 and hdr['start_ms'] == 1234 and hdr['file_index'] == k, hdr
+            assert len(data) % hdr['block_size'] == 0
+            file_recs = list(session_record.iter_records(path))
+            blocks = [r['block'] for r in file_recs]
+            assert blocks == sorted(blocks), 'blocks out of order in %s' % path
+            recs.extend(file_recs)
+
+        assert len(recs) == RECORDS, (len(recs), RECORDS)
+        for i, rec in enumerate(recs):
+            for key, want in expected(i).items():
+                got = rec[key]
+                ok = abs(got - want) < 1e-5 if isinstance(want, float) else got == want
+                assert ok, 'record %d field %s: got %r want %r' % (i, key, got, want)
+    print('OK: %d records round-tripped through %d files' % (RECORDS, files))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,92 @@
+// SlidingWindowStats 主机端测试（与暴力计算逐样本比对）
+// 构建运行（在 firmware 目录下）：
+//   g++ -std=c++17 -O2 -Wall -I src test/host/test_sliding_window_stats.cpp -o /tmp/test_sws && /tmp/test_sws
+// 覆盖单调递增/递减斜坡（min/max 单调队列长度达到窗口上限的情形）、锯齿、常值与随机序列。
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "sliding_window_stats.h"
+
+static int g_failures = 0;
+
+#define CHECK_NEAR(what, got, want, tol, i)                                                        \
+  do {                                                                                             \
+    if (fabs((double)(got) - (double)(want)) > (tol)) {                                            \
+      if (g_failures < 20) {                                                                       \
+        printf("  FAIL %s: i=%d got %.6f want %.6f\n", what, (int)(i), (double)(got), (double)(want)); \
+      }                                                                                            \
+      g_failures++;                                                                                \
+    }                                                                                              \
+  } while (0)
+
+// 对序列 gen(i) 逐样本推入，每步与窗口内暴力 min/max/mean/variance 比对
+template <uint16_t N, typename Gen>
+static void runCase(const char *name, int samples, Gen gen) {
+  printf("%s (N=%u, %d samples)\n", name, (unsigned)N, samples);
+  static float hist[200000];
+  SlidingWindowStats<N> w;
+  w.reset();
+  for (int i = 0; i < samples; ++i) {
+    const float x = gen(i);
+    hist[i] = x;
+    w.push(x);
+    const int n = (i + 1 < (int)N) ? i + 1 : (int)N;
+    float mn = hist[i], mx = hist[i];
+    double sum = 0.0, sq = 0.0;
+    for (int j = i - n + 1; j <= i; ++j) {
+      if (hist[j] < mn) mn = hist[j];
+      if (hist[j] > mx) mx = hist[j];
+      sum += hist[j];
+    }
+    const double mean = sum / n;
+    for (int j = i - n + 1; j <= i; ++j) {
+      sq += (hist[j] - mean) * (hist[j] - mean);
+    }
+    const double var = sq / n;
+    const double scale = fabs(mean) + sqrt(var) + 1.0;
+    if (w.count() != n) {
+      printf("  FAIL count: i=%d got %u want %d\n", i, (unsigned)w.count(), n);
+      g_failures++;
+    }
+    CHECK_NEAR("min", w.minValue(), mn, 0.0, i);
+    CHECK_NEAR("max", w.maxValue(), mx, 0.0, i);
+    CHECK_NEAR("range", w.range(), mx - mn, 1e-4 * scale, i);
+    CHECK_NEAR("mean", w.mean(), mean, 1e-4 * scale, i);
+    CHECK_NEAR("variance", w.variance(), var, 1e-3 * scale * scale, i);
+  }
+}
+
+int main() {
+  srand(1);
+  // 单调斜坡：超过 N+1 个样本，覆盖队列写满后首个过期的情形
+  runCase<8>("ramp up", 40, [](int i) { return (float)i; });
+  runCase<8>("ramp down", 40, [](int i) { return (float)-i; });
+  runCase<1>("ramp up", 10, [](int i) { return (float)i; });
+  runCase<2>("ramp down", 10, [](int i) { return (float)-i; });
+  runCase<400>("ramp up", 2000, [](int i) { return 0.01f * i; });
+  runCase<400>("ramp down", 2000, [](int i) { return -0.01f * i; });
+  runCase<8>("sawtooth", 200, [](int i) { return (float)(i % 11); });
+  runCase<8>("constant", 50, [](int) { return 3.5f; });
+  runCase<400>("hip-like sine + noise", 20000, [](int i) {
+    return 25.0f * sinf(0.0628f * i) + 0.5f * ((float)rand() / RAND_MAX - 0.5f);
+  });
+  runCase<400>("random", 20000, [](int) { return 60.0f * ((float)rand() / RAND_MAX) - 30.0f; });
+
+  // percentile：常值窗口与单调窗口
+  {
+    SlidingWindowStats<8> w;
+    w.reset();
+    for (int i = 0; i < 20; ++i) w.push((float)i);  // 窗口 = 12..19
+    CHECK_NEAR("p0", w.percentile(0.0f), 12.0f, 0.0, 0);
+    CHECK_NEAR("p100", w.percentile(1.0f), 19.0f, 0.0, 0);
+    CHECK_NEAR("p50", w.percentile(0.5f), 16.0f, 0.0, 0);
+  }
+
+  if (g_failures) {
+    printf("FAILED: %d mismatches\n", g_failures);
+    return 1;
+  }
+  printf("OK\n");
+  return 0;
+}
@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+黑匣子导出工具（与固件 BlackBox 对应）
+功能：
+1. 经 USB 串口发送 bb dump，接收二进制帧（结构 3 元数据 + 结构 4 逐帧快照）
+2. 按序号检查缺帧，保存为 CSV（元数据写在文件头注释行）
+
+用法：python blackbox_dump.py <串口> [out.csv]
+建议先 bb freeze（或故障自动冻结后）再导出，避免导出期间缓冲继续滚动。
+"""
+
+import csv
+import sys
+import time
+
+import serial
+
+from telemetry_codec import TelemetryStreamDemux
+
+SERIAL_BAUDRATE = 115200
+DUMP_TIMEOUT_S = 10.0
+
+
+def dump_blackbox(port, out_path):
+    demux = TelemetryStreamDemux()
+    header = None
+    samples = {}
+    with serial.Serial(port, SERIAL_BAUDRATE, timeout=0.1) as ser:
+        ser.reset_input_buffer()
+        ser.write(b'bb dump\n')
+        deadline = time.time() + DUMP_TIMEOUT_S
+        while time.time() < deadline:
+            for kind, item in demux.feed(ser.read(4096)):
+                if kind != 'record' or 'bb' not in item:
+                    continue
+                if item['bb'] == 'header':
+                    header = item
+                    samples.clear()
+                else:
+                    samples[item['index']] = item
+            if header is not None and len(samples) >= header['count']:
+                break
+
+    if header is None:
+        raise RuntimeError('未收到黑匣子元数据（固件是否支持 bb dump？）')
+    missing = header['count'] - len(samples)
+    rows = [samples[i] for i in sorted(samples)]
+    with open(out_path, 'w', newline='', encoding='utf-8') as f:
+        f.write('# reason=%s trigger_index=%s trigger_ms=%d period_us=%d error_motor=%d error_code=0x%02X\n' % (
+            header['reason'], header['trigger_index'], header['trigger_ms'], header['period_us'],
+            header['error_motor'], header['error_code']))
+        if rows:
+            fields = [k for k in rows[0].keys() if k != 'bb' and k != 'seq']
+            writer = csv.DictWriter(f, fieldnames=fields, extrasaction='ignore')
+            writer.writeheader()
+            writer.writerows(rows)
+    return header, len(rows), missing
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print('用法: python blackbox_dump.py <串口> [out.csv]')
+        sys.exit(1)
+    out = sys.argv[2] if len(sys.argv) > 2 else 'blackbox_%s.csv' % time.strftime('%Y%m%d_%H%M%S')
+    hdr, n, lost = dump_blackbox(sys.argv[1], out)
+    print('触发原因: %s，共 %d 帧（缺 %d 帧）-> %s' % (hdr['reason'], n, lost, out))
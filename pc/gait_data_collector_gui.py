@@ -33,6 +33,7 @@ import sys
 
 from patient_manager import PatientManager
 from training_session import TrainingSession
+from telemetry_codec import TelemetryStreamDemux
 try:
     from pypinyin import lazy_pinyin, Style
     _PYPINYIN_OK = True
@@ -371,18 +372,23 @@ class GaitDataCollector:
         # 数据会保留在缓冲区中，直到用户重新启动采集或手动清空
     
     def _collect_data(self):
-        """数据读取线程（统一从串口读取数据，解析JSON，放入队列）"""
-        buffer = ""
+        """数据读取线程（统一从串口读取数据，解析JSON或二进制遥测帧，放入队列）"""
+        demux = TelemetryStreamDemux()  # 文本行与二进制帧（固件 tlm bin）分流
         last_diagnostic_time = time.time()
         while self.collect_thread and self.collect_thread.is_alive():
             try:
                 if self.serial_port and self.serial_port.in_waiting > 0:
-                    data = self.serial_port.read(self.serial_port.in_waiting).decode('utf-8', errors='ignore')
-                    buffer += data
+                    data = self.serial_port.read(self.serial_port.in_waiting)
                     
-                    # 按行处理数据
-                    while '\n' in buffer:
-                        line, buffer = buffer.split('\n', 1)
+                    # 按行/帧处理数据
+                    for kind, item in demux.feed(data):
+                        if kind == 'record':
+                            # 二进制记录已还原为与 JSON 相同的键名
+                            self.data_queue.put(item)
+                            self.total_received += 1
+                            self.last_received_time = time.time()
+                            continue
+                        line = item
                         original_line = line  # 保存原始行
                         line = line.strip()
                         
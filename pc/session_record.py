@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+SD 会话记录解析（与固件 SessionRec 对应）
+功能：
+1. 读取 SD 卡上的 RECnnnnn.BIN，校验文件头与块头
+2. 按块解出每个控制帧的快照记录（dict）
+3. 命令行导出 CSV：python session_record.py REC00001.BIN [out.csv]
+
+文件格式（小端，块大小 512）：
+  块 0：文件头（魔数 "EXOREC\\0\\0"、版本、记录长度、每块记录数、块大小、帧周期 µs、起始 millis、文件序号）
+  块 1..：块头（魔数 'RB'、版本、有效记录数、块序号）+ 记录，余下补 0
+  固件预分配文件空间：异常断电时文件尾部可能残留全 0 块（魔数不符），解析时跳过
+固件端 RecordV1（firmware/src/session_rec_format.h）字段顺序变化时须同步修改 _RECORD_V1_*，
+并运行 firmware/test/host/test_session_rec.py。
+"""
+
+import csv
+import struct
+import sys
+
+FILE_MAGIC = b'EXOREC\x00\x00'
+BLOCK_MAGIC = 0x4252
+
+_FILE_HEADER_FORMAT = '<8sHHHHIII'
+_BLOCK_HEADER_FORMAT = '<HBBI'
+_BLOCK_HEADER_SIZE = struct.calcsize(_BLOCK_HEADER_FORMAT)
+
+# MotorRec：rawUnits i32, speed i16, iq i16, ageUs u16, temperature i8, motorState u8, errorState u8, enabled u8
+_MOTOR_FORMAT = 'ihhHbBBB'
+_MOTOR_FIELDS = ('raw', 'speed', 'iq', 'age_us', 'temp', 'state', 'err', 'en')
+
+_RECORD_V1_FORMAT = '<II' + _MOTOR_FORMAT * 2 + 'BBBB' + 'f' * 8 + 'h' * 4
+_RECORD_V1_SIZE = struct.calcsize(_RECORD_V1_FORMAT)
+
+_FLAG_NAMES = ('PF', 'DF', 'UL', 'comp', 'cool', 'ph4d', 'ctrl', 'assist')
+
+
+def _decode_record_v1(raw: bytes) -> dict:
+    v = struct.unpack(_RECORD_V1_FORMAT, raw)
+    rec = {'tick_us': v[0], 'tick': v[1]}
+    n = len(_MOTOR_FIELDS)
+    for i, name in enumerate(_MOTOR_FIELDS):
+        rec['hip_' + name] = v[2 + i]
+        rec['ank_' + name] = v[2 + n + i]
+    rec['hip_raw_deg'] = rec['hip_raw'] / 100.0
+    rec['ank_raw_deg'] = rec['ank_raw'] / 100.0
+    k = 2 + 2 * n
+    rec['phase'], rec['phase4'], rec['abn'], flags = v[k:k + 4]
+    for bit, name in enumerate(_FLAG_NAMES):
+        rec[name] = 1 if flags & (1 << bit) else 0
+    (rec['swing_pct'], rec['stance_pct'], rec['ank'], rec['v'],
+     rec['hip'], rec['hipv'], rec['ph4p'], rec['ph4o']) = v[k + 4:k + 12]
+    rec['iqT_a'], rec['iqC_a'], rec['iqT_h'], rec['iqC_h'] = v[k + 12:k + 16]
+    return rec
+
+
+def read_header(data: bytes) -> dict:
+    """解析块 0 文件头；魔数/版本不符抛 ValueError"""
+    fields = struct.unpack_from(_FILE_HEADER_FORMAT, data, 0)
+    magic, version, record_size, per_block, block_size, period_us, start_ms, file_index = fields
+    if magic != FILE_MAGIC:
+        raise ValueError('not a session recording (bad magic)')
+    if version != 1 or record_size != _RECORD_V1_SIZE:
+        raise ValueError('unsupported recording version %d / record size %d' % (version, record_size))
+    return {
+        'version': version, 'record_size': record_size, 'records_per_block': per_block,
+        'block_size': block_size, 'period_us': period_us, 'start_ms': start_ms, 'file_index': file_index,
+    }
+
+
+def iter_records(path):
+    """逐条产出记录 dict；块头损坏的块跳过（记录不跨块）"""
+    with open(path, 'rb') as f:
+        data = f.read()
+    header = read_header(data)
+    bs = header['block_size']
+    size = header['record_size']
+    for off in range(bs, len(data) - bs + 1, bs):
+        magic, version, count, seq = struct.unpack_from(_BLOCK_HEADER_FORMAT, data, off)
+        if magic != BLOCK_MAGIC or version != header['version'] or count > header['records_per_block']:
+            continue
+        pos = off + _BLOCK_HEADER_SIZE
+        for _ in range(count):
+            rec = _decode_record_v1(data[pos:pos + size])
+            rec['block'] = seq
+            yield rec
+            pos += size
+
+
+def export_csv(path, out_path):
+    rows = 0
+    writer = None
+    with open(out_path, 'w', newline='', encoding='utf-8') as out:
+        for rec in iter_records(path):
+            if writer is None:
+                writer = csv.DictWriter(out, fieldnames=list(rec.keys()))
+                writer.writeheader()
+            writer.writerow(rec)
+            rows += 1
+    return rows
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 2:
+        print('用法: python session_record.py RECnnnnn.BIN [out.csv]')
+        sys.exit(1)
+    src = sys.argv[1]
+    dst = sys.argv[2] if len(sys.argv) > 2 else src.rsplit('.', 1)[0] + '.csv'
+    with open(src, 'rb') as f:
+        info = read_header(f.read(512))
+    print('文件 %d：周期 %d us，起始 %d ms' % (info['file_index'], info['period_us'], info['start_ms']))
+    print('已导出 %d 条记录 -> %s' % (export_csv(src, dst), dst))
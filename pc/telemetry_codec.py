@@ -0,0 +1,266 @@
+#!/usr/bin/env python3
+# -*- coding: utf-8 -*-
+"""
+二进制遥测解码（与固件 BinTelem 对应）
+功能：
+1. COBS 解帧 + CRC-16/CCITT-FALSE 校验
+2. 按 结构 ID 解出记录，还原成与 JSON 遥测相同键名的 dict
+   结构 2（通道帧，当前固件）：只含已订阅且本帧到期的通道
+   结构 1（旧固件的定长步态记录）：保留解码以兼容旧固件
+   结构 3/4（黑匣子导出，bb dump）：元数据 + 逐帧快照，见 blackbox_dump.py
+   结构 5（事件日志导出，fwlog bin）：每条事件一帧
+3. 串口字节流分流：文本行（命令回显 / >>> 响应 / JSON）与二进制帧混在同一流中
+
+线上格式：0x00 | COBS( ver u8 | schema u8 | seq u16 | record... | crc16 u16 ) | 0x00
+多字节字段为小端。固件端 Telem::kChannels 通道顺序/类型/缩放变化时须同步修改 CHANNELS。
+"""
+
+import struct
+
+TELEMETRY_VERSION = 1
+SCHEMA_GAIT = 1
+SCHEMA_CHANNELS = 2
+SCHEMA_BB_HEADER = 3
+SCHEMA_BB_SAMPLE = 4
+SCHEMA_FWLOG = 5
+
+# 固件 Telem::kChannels：(名称, struct 类型, 缩放, 是否整数)，序号即位图位号
+CHANNELS = [
+    ('h', 'h', 100.0, False), ('hf', 'h', 100.0, False), ('hvf', 'h', 10.0, False),
+    ('phase', 'B', 1.0, True), ('s', 'H', 1000.0, False), ('a', 'h', 100.0, False),
+    ('ar', 'h', 100.0, False), ('act', 'B', 1.0, True), ('hm', 'h', 100.0, False),
+    ('ph4', 'B', 1.0, True), ('ph4v', 'B', 1.0, True), ('ph4p', 'H', 1000.0, False),
+    ('ph4o', 'H', 1000.0, False), ('ph4d', 'B', 1.0, True), ('ph4tc', 'B', 1.0, True),
+    ('ph', 'B', 1.0, True), ('st', 'H', 1000.0, False), ('ank', 'h', 100.0, False),
+    ('v', 'h', 10.0, False), ('hip', 'h', 100.0, False), ('hipv', 'h', 10.0, False),
+    ('iqT_a', 'h', 1.0, True), ('iqC_a', 'h', 1.0, True),
+    ('iqT_h', 'h', 1.0, True), ('iqC_h', 'h', 1.0, True),
+    ('PF', 'B', 1.0, True), ('DF', 'B', 1.0, True), ('UL', 'B', 1.0, True),
+    ('comp', 'B', 1.0, True), ('cool', 'B', 1.0, True), ('abn', 'B', 1.0, True),
+    ('bus', 'H', 10.0, False), ('age_h', 'H', 10.0, False), ('age_a', 'H', 10.0, False),
+]
+_MASK_BYTES = (len(CHANNELS) + 7) // 8
+
+# 旧固件 BinTelem::GaitRecordV1（#pragma pack(1)）
+_GAIT_V1_FORMAT = '<I' + 'h' * 10 + 'H' * 4 + 'h' * 4 + 'H' * 3 + 'B' * 5
+_GAIT_V1_SIZE = struct.calcsize(_GAIT_V1_FORMAT)
+
+_HEADER_SIZE = 4
+_CRC_SIZE = 2
+
+
+def crc16_ccitt(data: bytes) -> int:
+    """CRC-16/CCITT-FALSE：多项式 0x1021，初值 0xFFFF，不反射"""
+    crc = 0xFFFF
+    for byte in data:
+        crc ^= byte << 8
+        for _ in range(8):
+            crc = ((crc << 1) ^ 0x1021) if (crc & 0x8000) else (crc << 1)
+            crc &= 0xFFFF
+    return crc
+
+
+def cobs_decode(data: bytes):
+    """COBS 解码；格式错误返回 None"""
+    out = bytearray()
+    i = 0
+    n = len(data)
+    while i < n:
+        code = data[i]
+        if code == 0:
+            return None
+        end = i + code
+        if end > n:
+            return None  # 末块被截断
+        out += data[i + 1:end]
+        i = end
+        if code != 0xFF and i < n:
+            out.append(0)
+    return bytes(out)
+
+
+def _decode_gait_v1(rec: bytes) -> dict:
+    (t, h, hf, hvf, a, ar, hm, ank, v, hip, hipv,
+     s, st, ph4p, ph4o,
+     iqT_a, iqC_a, iqT_h, iqC_h,
+     bus, age_h, age_a,
+     phase, ph4, ph4tc, abn, flags) = struct.unpack(_GAIT_V1_FORMAT, rec[:_GAIT_V1_SIZE])
+    ph4v = ph4 * 10
+    return {
+        't': t,
+        'h': h / 100.0, 'hf': hf / 100.0, 'hvf': hvf / 10.0, 'vf': hvf / 10.0,
+        'phase': phase, 's': s / 1000.0, 'a': a / 100.0, 'ar': ar / 100.0,
+        'act': 1 if flags & 0x20 else 0, 'hm': hm / 100.0,
+        'ph4': ph4, 'ph4v': ph4v, 'ph4p': ph4p / 1000.0, 'ph4o': ph4o / 1000.0,
+        'ph4d': 1 if flags & 0x40 else 0, 'ph4tc': ph4tc,
+        'ph': ph4v, 'st': st / 1000.0, 'ank': ank / 100.0, 'v': v / 10.0,
+        'hip': hip / 100.0, 'hipv': hipv / 10.0,
+        'iqT_a': iqT_a, 'iqC_a': iqC_a, 'iqT_h': iqT_h, 'iqC_h': iqC_h,
+        'PF': 1 if flags & 0x01 else 0, 'DF': 1 if flags & 0x02 else 0,
+        'UL': 1 if flags & 0x04 else 0, 'comp': 1 if flags & 0x08 else 0,
+        'cool': 1 if flags & 0x10 else 0, 'abn': abn,
+        'bus': bus / 10.0, 'age_h': age_h / 10.0, 'age_a': age_a / 10.0,
+    }
+
+
+def _decode_channels(rec: bytes) -> dict:
+    t = int.from_bytes(rec[0:4], 'little')
+    mask = int.from_bytes(rec[4:4 + _MASK_BYTES], 'little')
+    out = {'t': t}
+    pos = 4 + _MASK_BYTES
+    for i, (name, fmt, scale, is_int) in enumerate(CHANNELS):
+        if not mask & (1 << i):
+            continue
+        size = struct.calcsize(fmt)
+        if pos + size > len(rec):
+            raise ValueError('truncated channel record')
+        (raw,) = struct.unpack_from('<' + fmt, rec, pos)
+        pos += size
+        out[name] = raw if is_int else raw / scale
+    if 'hvf' in out:
+        out['vf'] = out['hvf']  # 与固件 JSON 一致：旧键 vf 为 hvf 的别名
+    return out
+
+
+# 固件 BlackBox::DumpHeader / Snapshot（#pragma pack(1)）
+_BB_HEADER_FORMAT = '<BBBBHHIIH'
+_BB_SAMPLE_FORMAT = '<HI' + 'h' * 4 + 'B' * 7 + 'h' * 4 + 'H' * 5
+_BB_REASONS = ('none', 'system_error', 'fault_safe', 'abnormal', 'manual')
+_BB_FLAG_NAMES = ('PF', 'DF', 'UL', 'comp', 'cool', 'ph4d', 'ctrl', 'assist')
+
+
+def _decode_bb_header(rec: bytes) -> dict:
+    (reason, err_id, err_code, frozen, count, trig_idx,
+     trig_ms, period_us, snap_size) = struct.unpack_from(_BB_HEADER_FORMAT, rec)
+    return {
+        'bb': 'header', 'reason': _BB_REASONS[reason] if reason < len(_BB_REASONS) else reason,
+        'error_motor': err_id, 'error_code': err_code, 'frozen': frozen, 'count': count,
+        'trigger_index': None if trig_idx == 0xFFFF else trig_idx,
+        'trigger_ms': trig_ms, 'period_us': period_us, 'snapshot_size': snap_size,
+    }
+
+
+def _decode_bb_sample(rec: bytes) -> dict:
+    v = struct.unpack_from(_BB_SAMPLE_FORMAT, rec)
+    out = {
+        'bb': 'sample', 'index': v[0], 'tick_us': v[1],
+        'hip': v[2] / 100.0, 'ank': v[3] / 100.0, 'hipv': v[4] / 10.0, 'v': v[5] / 10.0,
+        'phase': v[6], 'phase4': v[7], 'abn': v[9], 'compliance': v[10],
+        'hip_err': v[11], 'ank_err': v[12],
+        'iqT_a': v[13], 'iqC_a': v[14], 'iqT_h': v[15], 'iqC_h': v[16],
+        'bus': v[17] / 10.0, 'tx_dropped': v[18], 'tx_fail': v[19], 'rx_ovf': v[20], 'skipped': v[21],
+    }
+    for bit, name in enumerate(_BB_FLAG_NAMES):
+        out[name] = 1 if v[8] & (1 << bit) else 0
+    return out
+
+
+# 固件 FwLog::Tag（顺序须一致）
+FWLOG_TAGS = ('none', 'can_tx_fail', 'phase', 'phase4', 'ph4_degraded', 'compliant', 'cooldown',
+              'abn', 'eeprom', 'cmd', 'overrun', 'skip', 'estop', 'bb_freeze',
+              'canrx_cfg')
+_FWLOG_FORMAT = '<IIBBHi'
+
+
+def _decode_fwlog(rec: bytes) -> dict:
+    seq, us, tag, a, b, v = struct.unpack_from(_FWLOG_FORMAT, rec)
+    return {
+        'fwlog': FWLOG_TAGS[tag] if tag < len(FWLOG_TAGS) else tag,
+        'log_seq': seq, 'us': us, 'a': a, 'b': b, 'v': v,
+    }
+
+
+_SCHEMA_DECODERS = {
+    SCHEMA_GAIT: (_GAIT_V1_SIZE, _decode_gait_v1),
+    SCHEMA_CHANNELS: (4 + _MASK_BYTES, _decode_channels),
+    SCHEMA_BB_HEADER: (struct.calcsize(_BB_HEADER_FORMAT), _decode_bb_header),
+    SCHEMA_BB_SAMPLE: (struct.calcsize(_BB_SAMPLE_FORMAT), _decode_bb_sample),
+    SCHEMA_FWLOG: (struct.calcsize(_FWLOG_FORMAT), _decode_fwlog),
+}
+
+
+def decode_frame(encoded: bytes):
+    """解一帧（不含 0x00 分隔符）；校验失败或未知结构返回 None"""
+    raw = cobs_decode(encoded)
+    if raw is None or len(raw) < _HEADER_SIZE + _CRC_SIZE:
+        return None
+    body, crc_bytes = raw[:-_CRC_SIZE], raw[-_CRC_SIZE:]
+    if crc16_ccitt(body) != int.from_bytes(crc_bytes, 'little'):
+        return None
+    ver, schema, seq = body[0], body[1], int.from_bytes(body[2:4], 'little')
+    if ver != TELEMETRY_VERSION or schema not in _SCHEMA_DECODERS:
+        return None
+    size, decoder = _SCHEMA_DECODERS[schema]
+    record = body[_HEADER_SIZE:]
+    if len(record) < size:
+        return None
+    try:
+        data = decoder(record)
+    except ValueError:
+        return None
+    data['seq'] = seq
+    return data
+
+
+class TelemetryStreamDemux:
+    """
+    串口字节流分流器：feed(bytes) 返回事件列表
+      ('text', str)    —— 一行文本（不含换行符）
+      ('record', dict) —— 一条二进制遥测记录（键名与 JSON 遥测一致，另含 seq）
+    文本中不会出现 0x00：遇到 0x00 进入帧模式，直到下一个 0x00 结束。
+    中途接入导致错位时，校验失败的“帧”把结尾 0x00 当作新帧开头继续，下一帧即可恢复同步；
+    若校验失败后先遇到换行，说明后面是文本而非帧，退出帧模式并把这段当作文本行。
+    """
+
+    MAX_FRAME = 512
+
+    def __init__(self):
+        self._text = bytearray()
+        self._frame = bytearray()
+        self._in_frame = False
+        self._resync = False  # 上一帧校验失败，帧模式可能错位
+        self.frames_ok = 0
+        self.frames_bad = 0
+
+    def feed(self, data: bytes):
+        events = []
+        for byte in data:
+            if self._in_frame:
+                if byte == 0x0A and self._resync:
+                    if not any(b < 0x09 for b in self._frame):
+                        events.append(('text', self._frame.decode('utf-8', errors='ignore')))
+                    self._frame.clear()
+                    self._in_frame = False
+                    self._resync = False
+                    continue
+                if byte != 0:
+                    self._frame.append(byte)
+                    if len(self._frame) > self.MAX_FRAME:
+                        self._frame.clear()
+                        self._in_frame = False
+                        self.frames_bad += 1
+                        self._resync = False
+                    continue
+                if not self._frame:
+                    continue  # 连续分隔符
+                record = decode_frame(bytes(self._frame))
+                self._frame.clear()
+                if record is None:
+                    self.frames_bad += 1
+                    self._resync = True
+                    continue  # 保持帧模式（重同步）
+                self.frames_ok += 1
+                self._in_frame = False
+                self._resync = False
+                events.append(('record', record))
+            elif byte == 0:
+                self._in_frame = True
+                # 文本不含控制字节：缓冲中若有，说明是中途接入时的半帧残余，丢弃
+                if any(b < 0x09 for b in self._text):
+                    self._text.clear()
+            elif byte == 0x0A:
+                events.append(('text', self._text.decode('utf-8', errors='ignore')))
+                self._text.clear()
+            else:
+                self._text.append(byte)
+        return events